@@ -1,29 +1,196 @@
 #include "cbuild.h"
 
+#include <stdio.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <elf.h>
+#include <pthread.h>
+
 #define function static
 #define global_variable static
 
 typedef int32_t  i32;
+typedef int64_t  i64;
 typedef uint64_t u64;
+typedef uint8_t  u8;
+typedef uint32_t u32;
 
-typedef struct PathLastModValue {
-    u64      thisFileLastMod;
-    prb_Str* directIncludes;
-    bool     haveLastModWithDeps;
-    bool     beingResolved;
-    u64      lastModWithDeps;
-} PathLastModValue;
-
-typedef struct FileLastMod {
-    char*            key;
-    PathLastModValue value;
-} FileLastMod;
-
+// NOTE(khvorov) Absolute (prb_getParentDir makes it so) and spelled the same in every path below, getRootRelative relies on that
+global_variable prb_Str globalRootDir;
 global_variable prb_Str globalLLVMRootDir;
 global_variable prb_Str globalClangSrcDir;
 global_variable prb_Str globalBuildDir;
 global_variable prb_Str* globalAllFilesInSrc;
-global_variable FileLastMod* globalLastModTable;
+
+// NOTE(khvorov) --profile=<name>, each one builds into build/<name>.
+// The flags are part of every command so the object cache never mixes profiles up.
+typedef struct BuildProfile {
+    const char* name;
+    const char* compileFlags;
+    const char* linkFlags;
+    // NOTE(khvorov) Objects are summary bitcode, archived with llvm-ar and linked by lld with a ThinLTO cache in the build dir
+    bool thinLto;
+    // NOTE(khvorov) -gsplit-dwarf, every x.obj has its debug info in x.dwo next to it and the linker only sees skeleton units
+    bool splitDwarf;
+} BuildProfile;
+
+global_variable BuildProfile globalProfiles[] = {
+    {
+        .name = "debug",
+        .compileFlags = "-g -DLLVM_ENABLE_ABI_BREAKING_CHECKS=1",
+        .linkFlags = "",
+    },
+    {
+        .name = "debug-split",
+        .compileFlags = "-g -gsplit-dwarf -ggnu-pubnames -DLLVM_ENABLE_ABI_BREAKING_CHECKS=1",
+        .linkFlags = "-Wl,--gdb-index",
+        .splitDwarf = true,
+    },
+    {
+        .name = "release",
+        .compileFlags = "-O2 -DNDEBUG -DLLVM_ENABLE_ABI_BREAKING_CHECKS=0 -fno-semantic-interposition -fomit-frame-pointer -ffunction-sections -fdata-sections",
+        .linkFlags = "-Wl,--gc-sections -Wl,-O1",
+    },
+    {
+        // NOTE(khvorov) Frame pointers stay so that perf can still walk the stack
+        .name = "release-asserts",
+        .compileFlags = "-O2 -g1 -DLLVM_ENABLE_ABI_BREAKING_CHECKS=1 -fno-semantic-interposition -fno-omit-frame-pointer -ffunction-sections -fdata-sections",
+        .linkFlags = "-Wl,--gc-sections -Wl,-O1",
+    },
+    {
+        .name = "release-thinlto",
+        .compileFlags = "-O2 -DNDEBUG -DLLVM_ENABLE_ABI_BREAKING_CHECKS=0 -fno-semantic-interposition -fomit-frame-pointer -ffunction-sections -fdata-sections -flto=thin",
+        .linkFlags = "-flto=thin -Wl,--gc-sections -Wl,-O1 -Wl,--thinlto-jobs=all",
+        .thinLto = true,
+    },
+};
+
+global_variable BuildProfile globalProfile;
+
+// NOTE(khvorov) --dwp: also package the .dwo files of every exe into <exe>.dwp next to it so the exe can be debugged
+// (or moved) without the build dir. Each lib gets its own .dwp first, on its own, then the exe's one merges those.
+global_variable bool globalDwpMode;
+
+function prb_Str
+getDwoPath(prb_Arena* arena, prb_Str objPath) {
+    prb_Str result = prb_replaceExt(arena, objPath, prb_STR("dwo"));
+    return result;
+}
+
+// NOTE(khvorov) --pgo builds an instrumented clang, trains it and then builds again with the profile.
+// The two builds are the stages below and can also be run by hand with --pgo-stage=<generate|use>.
+typedef enum PgoStage {
+    PgoStage_None,
+    PgoStage_Generate,
+    PgoStage_Use,
+} PgoStage;
+
+global_variable PgoStage globalPgoStage;
+
+// NOTE(khvorov) Goes into every compile and link command, ends with a space when not empty
+global_variable prb_Str globalPgoFlags;
+
+// NOTE(khvorov) Every object depends on the profile it was optimized with
+global_variable prb_Str globalPgoProfdataPath;
+
+// NOTE(khvorov) INSTR_PROF_RAW_MAGIC_64 and INSTR_PROF_RAW_VERSION from llvm_include_llvm_ProfileData_InstrProfData.inc,
+// the one raw profile version profdata-merge.exe can read
+#define PROFRAW_MAGIC_64 ((u64)255 << 56 | (u64)'l' << 48 | (u64)'p' << 40 | (u64)'r' << 32 | (u64)'o' << 24 | (u64)'f' << 16 | (u64)'r' << 8 | (u64)129)
+#define PROFRAW_VERSION_THIS_TREE 8ull
+
+// NOTE(khvorov) --unity[=<size>]: each library is compiled as TUs that include up to <size> of its .cpp files
+global_variable i32 globalUnitySize;
+
+// NOTE(khvorov) --pch: each library gets a PCH of the leading includes most of its TUs share
+global_variable bool globalPchMode;
+
+// NOTE(khvorov) --watch: stay resident after the build and build again whenever something in clang_src changes.
+// The logs and the stats of everything in clang_src stay in memory between builds, inotify says which stats went stale.
+// Not with --pgo, a rebuild there is two full builds and a training run.
+global_variable bool globalWatchMode;
+
+// NOTE(khvorov) Files that break when they share a TU with others in the same library in ways the name scan
+// in getUnitySources doesn't see. They would only cost one failed unity compile each (see startUnityFallback)
+global_variable const char* globalUnityBlacklist[] = {
+    "llvm_lib_MC_MCParser_MasmParser.cpp",
+    "llvm_lib_CodeGen_GlobalISel_InlineAsmLowering.cpp",
+    "llvm_lib_Transforms_Instrumentation_DataFlowSanitizer.cpp",
+    "llvm_lib_Transforms_Instrumentation_GCOVProfiling.cpp",
+    "llvm_lib_Transforms_Instrumentation_MemProfiler.cpp",
+    "llvm_lib_Transforms_Coroutines_CoroCleanup.cpp",
+    "llvm_lib_Transforms_Coroutines_CoroEarly.cpp",
+    "llvm_lib_Transforms_Coroutines_CoroFrame.cpp",
+    "llvm_lib_Analysis_LegacyDivergenceAnalysis.cpp",
+    "llvm_lib_Demangle_RustDemangle.cpp",
+    "llvm_utils_TableGen_X86FoldTablesEmitter.cpp",
+    "clang_utils_TableGen_NeonEmitter.cpp",
+    "clang_lib_Analysis_UninitializedValues.cpp",
+};
+
+typedef struct BuildLogEntry {
+    u64 cmdHash;
+    u64 inputHash;
+    u64 durationMs;
+    i64 maxRssBytes;
+} BuildLogEntry;
+
+typedef struct BuildLogKV {
+    char*         key;
+    BuildLogEntry value;
+} BuildLogKV;
+
+// NOTE(khvorov) Keyed by output path. Persisted in build/.buildlog, one line per output:
+// <cmd hash> <input hash> <duration ms> <peak rss bytes> <output path>
+global_variable prb_Str     globalBuildLogPath;
+global_variable BuildLogKV* globalBuildLog;
+
+typedef struct PathIdKV {
+    char* key;
+    u32   value;
+} PathIdKV;
+
+typedef struct DepsKV {
+    u32  key;
+    u32* value;
+} DepsKV;
+
+// NOTE(khvorov) Exact dependencies of every object as reported by the compiler (-MD).
+// Every path (outputs and deps) is interned once. Persisted in build/.depslog:
+// magic, u32 path count, (u32 len, bytes) per path, u32 record count, (u32 out id, u32 dep count, u32 dep ids) per record
+#define DEPS_LOG_MAGIC "DEPSLOG1"
+global_variable prb_Str   globalDepsLogPath;
+global_variable prb_Str*  globalDepsLogPaths;
+global_variable PathIdKV* globalDepsLogPathIds;
+global_variable DepsKV*   globalDepsLog;
+
+typedef struct FileStatKV {
+    char*        key;
+    prb_FileStat value;
+} FileStatKV;
+
+// NOTE(khvorov) Most headers are deps of hundreds of objects, stat each one once per phase
+global_variable FileStatKV* globalFileStats;
+
+typedef struct HashCacheEntry {
+    prb_FileStat stat;
+    u64          hash;
+} HashCacheEntry;
+
+typedef struct HashCacheKV {
+    char*          key;
+    HashCacheEntry value;
+} HashCacheKV;
+
+// NOTE(khvorov) Content hash of every file we've looked at along with the stat it was taken at.
+// A file whose mtime, size and inode all match is never read again.
+// Persisted in build/.hashcache, one line per file: <hash> <mtime> <size> <inode> <path>
+global_variable prb_Str      globalHashCachePath;
+global_variable HashCacheKV* globalHashCache;
+
+// NOTE(khvorov) --hash: decide rebuilds by the content of the TU and its includes rather than by mtimes
+global_variable bool globalHashMode;
 
 function prb_Str
 replaceSeps(prb_Arena* arena, prb_Str str) {
@@ -42,178 +209,3170 @@ isSrcFile(prb_Str path) {
     return result;
 }
 
+function u64
+hashStr(prb_Str str) {
+    u64 result = prb_stbds_hash_bytes((void*)str.ptr, str.len, 0);
+    return result;
+}
+
+function void
+loadBuildLog(prb_Arena* arena) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    sh_new_strdup(globalBuildLog);
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, globalBuildLogPath);
+    if (readRes.success) {
+        prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(readRes.content));
+        while (prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak}, prb_StrScannerSide_AfterMatch)) {
+            prb_Str        fields[5] = {};
+            i32            fieldCount = 0;
+            prb_StrScanner fieldScanner = prb_createStrScanner(lineScanner.betweenLastMatches);
+            while (fieldCount < prb_arrayCount(fields) && prb_strScannerMove(&fieldScanner, (prb_StrFindSpec) {.pattern = prb_STR(" "), .alwaysMatchEnd = true}, prb_StrScannerSide_AfterMatch)) {
+                fields[fieldCount++] = fieldScanner.betweenLastMatches;
+            }
+
+            // NOTE(khvorov) Skip anything malformed, the worst that can happen is a rebuild
+            if (fieldCount == prb_arrayCount(fields)) {
+                prb_ParseUintResult cmdHash = prb_parseUint(fields[0], 16);
+                prb_ParseUintResult inputHash = prb_parseUint(fields[1], 16);
+                prb_ParseUintResult durationMs = prb_parseUint(fields[2], 10);
+                prb_ParseUintResult maxRssBytes = prb_parseUint(fields[3], 10);
+                if (cmdHash.success && inputHash.success && durationMs.success && maxRssBytes.success && fields[4].len > 0) {
+                    BuildLogEntry entry = {cmdHash.number, inputHash.number, durationMs.number, (i64)maxRssBytes.number};
+                    shput(globalBuildLog, (char*)prb_strGetNullTerminated(arena, fields[4]), entry);
+                }
+            }
+        }
+    }
+    prb_endTempMemory(temp);
+}
+
+function void
+saveBuildLog(prb_Arena* arena) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    prb_GrowingStr logBuilder = prb_beginStr(arena);
+    for (i32 entryIndex = 0; entryIndex < shlen(globalBuildLog); entryIndex++) {
+        BuildLogKV kv = globalBuildLog[entryIndex];
+        prb_addStrSegment(
+            &logBuilder,
+            "%016llx %016llx %llu %lld %s\n",
+            (unsigned long long)kv.value.cmdHash,
+            (unsigned long long)kv.value.inputHash,
+            (unsigned long long)kv.value.durationMs,
+            (long long)kv.value.maxRssBytes,
+            kv.key
+        );
+    }
+    prb_Str logStr = prb_endStr(&logBuilder);
+    prb_assert(prb_writeEntireFile(arena, globalBuildLogPath, logStr.ptr, logStr.len));
+    prb_endTempMemory(temp);
+}
+
+// NOTE(khvorov) Changing flags/defines has to rebuild even if no file changed
+function bool
+commandChanged(prb_Arena* arena, prb_Str out, prb_Str cmd) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    i32            entryIndex = shgeti(globalBuildLog, (char*)prb_strGetNullTerminated(arena, out));
+    bool           result = entryIndex == -1 || globalBuildLog[entryIndex].value.cmdHash != hashStr(cmd);
+    prb_endTempMemory(temp);
+    return result;
+}
+
+function u32
+internPath(prb_Arena* arena, prb_Str path) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    char*          key = (char*)prb_strGetNullTerminated(arena, path);
+    i32            pathIndex = shgeti(globalDepsLogPathIds, key);
+    u32            result = 0;
+    if (pathIndex == -1) {
+        // NOTE(khvorov) The table owns a copy of the key so the interned string can just point at that
+        result = arrlen(globalDepsLogPaths);
+        shput(globalDepsLogPathIds, key, result);
+        char* ownedKey = globalDepsLogPathIds[shgeti(globalDepsLogPathIds, key)].key;
+        arrput(globalDepsLogPaths, ((prb_Str) {ownedKey, path.len}));
+    } else {
+        result = globalDepsLogPathIds[pathIndex].value;
+    }
+    prb_endTempMemory(temp);
+    return result;
+}
+
+typedef struct BytesReader {
+    prb_Bytes bytes;
+    i32       offset;
+    bool      ok;
+} BytesReader;
+
+function u32
+readU32(BytesReader* reader) {
+    u32 result = 0;
+    if (reader->ok && reader->offset + (i32)sizeof(u32) <= reader->bytes.len) {
+        prb_memcpy(&result, reader->bytes.data + reader->offset, sizeof(u32));
+        reader->offset += sizeof(u32);
+    } else {
+        reader->ok = false;
+    }
+    return result;
+}
+
+function void
+loadDepsLog(prb_Arena* arena) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    sh_new_strdup(globalDepsLogPathIds);
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, globalDepsLogPath);
+    prb_Str                  magic = prb_STR(DEPS_LOG_MAGIC);
+    if (readRes.success && readRes.content.len >= magic.len && prb_memeq(readRes.content.data, magic.ptr, magic.len)) {
+        BytesReader reader = {readRes.content, magic.len, true};
+
+        // NOTE(khvorov) Ids in the file are just positions in its own path table
+        u32  pathCount = readU32(&reader);
+        u32* fileIdToId = 0;
+        for (u32 pathIndex = 0; pathIndex < pathCount && reader.ok; pathIndex++) {
+            u32 len = readU32(&reader);
+            if (reader.ok && (i64)reader.offset + (i64)len <= (i64)reader.bytes.len) {
+                prb_Str path = {(const char*)reader.bytes.data + reader.offset, (i32)len};
+                reader.offset += len;
+                arrput(fileIdToId, internPath(arena, path));
+            } else {
+                reader.ok = false;
+            }
+        }
+
+        u32 recordCount = readU32(&reader);
+        for (u32 recordIndex = 0; recordIndex < recordCount && reader.ok; recordIndex++) {
+            u32  outId = readU32(&reader);
+            u32  depCount = readU32(&reader);
+            u32* deps = 0;
+            for (u32 depIndex = 0; depIndex < depCount && reader.ok; depIndex++) {
+                u32 depId = readU32(&reader);
+                if (depId < (u32)arrlen(fileIdToId)) {
+                    arrput(deps, fileIdToId[depId]);
+                } else {
+                    reader.ok = false;
+                }
+            }
+            if (reader.ok && outId < (u32)arrlen(fileIdToId)) {
+                hmput(globalDepsLog, fileIdToId[outId], deps);
+            } else {
+                arrfree(deps);
+            }
+        }
+        arrfree(fileIdToId);
+    }
+    prb_endTempMemory(temp);
+}
+
+function void
+saveDepsLog(prb_Arena* arena) {
+    u8*     bytes = 0;
+    prb_Str magic = prb_STR(DEPS_LOG_MAGIC);
+    prb_memcpy(arraddnptr(bytes, magic.len), magic.ptr, magic.len);
+
+#define writeU32(val) \
+    do { \
+        u32 val_ = (val); \
+        prb_memcpy(arraddnptr(bytes, sizeof(u32)), &val_, sizeof(u32)); \
+    } while (0)
+
+    writeU32(arrlen(globalDepsLogPaths));
+    for (i32 pathIndex = 0; pathIndex < arrlen(globalDepsLogPaths); pathIndex++) {
+        prb_Str path = globalDepsLogPaths[pathIndex];
+        writeU32(path.len);
+        prb_memcpy(arraddnptr(bytes, path.len), path.ptr, path.len);
+    }
+
+    writeU32(hmlen(globalDepsLog));
+    for (i32 recordIndex = 0; recordIndex < hmlen(globalDepsLog); recordIndex++) {
+        DepsKV record = globalDepsLog[recordIndex];
+        writeU32(record.key);
+        writeU32(arrlen(record.value));
+        for (i32 depIndex = 0; depIndex < arrlen(record.value); depIndex++) {
+            writeU32(record.value[depIndex]);
+        }
+    }
+
+#undef writeU32
+
+    prb_assert(prb_writeEntireFile(arena, globalDepsLogPath, bytes, arrlen(bytes)));
+    arrfree(bytes);
+}
+
 function prb_Str
-readFile(prb_Arena* arena, prb_Str path) {
-    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, path);
-    if (!readRes.success) {
-        prb_writelnToStdout(arena, path);
-        prb_assert(!"couldn't read the file");
+getDepfilePath(prb_Arena* arena, prb_Str out) {
+    prb_Str result = prb_fmt(arena, "%.*s.d", prb_LIT(out));
+    return result;
+}
+
+// NOTE(khvorov) Takes ownership of deps
+function void
+setRecordedDeps(prb_Arena* arena, prb_Str out, u32* deps) {
+    u32 outId = internPath(arena, out);
+    i32 existingIndex = hmgeti(globalDepsLog, outId);
+    if (existingIndex != -1) {
+        arrfree(globalDepsLog[existingIndex].value);
+    }
+    hmput(globalDepsLog, outId, deps);
+}
+
+function void
+addRecordedDep(prb_Arena* arena, prb_Str out, prb_Str dep) {
+    u32 outId = internPath(arena, out);
+    u32 depId = internPath(arena, dep);
+    i32 recordIndex = hmgeti(globalDepsLog, outId);
+    prb_assert(recordIndex != -1);
+    arrput(globalDepsLog[recordIndex].value, depId);
+}
+
+// NOTE(khvorov) Makefile syntax: "out: dep1 dep2 \<newline> dep3", spaces and # in paths are escaped with a backslash, $ is written as $$
+function void
+ingestDepfile(prb_Arena* arena, prb_Str out, prb_Str depfilePath) {
+    prb_TempMemory           temp = prb_beginTempMemory(arena);
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, depfilePath);
+    prb_assert(readRes.success);
+    prb_Str content = prb_strFromBytes(readRes.content);
+
+    u32* deps = 0;
+    {
+        char* pathBuf = prb_arenaAllocArray(arena, char, content.len + 1);
+        i32   pathLen = 0;
+        bool  pastTarget = false;
+        for (i32 charIndex = 0; charIndex <= content.len; charIndex++) {
+            char ch = charIndex < content.len ? content.ptr[charIndex] : ' ';
+            char nextCh = charIndex + 1 < content.len ? content.ptr[charIndex + 1] : ' ';
+            bool endOfPath = false;
+            if (ch == '\\' && (nextCh == ' ' || nextCh == '#')) {
+                pathBuf[pathLen++] = nextCh;
+                charIndex += 1;
+            } else if (ch == '$' && nextCh == '$') {
+                pathBuf[pathLen++] = '$';
+                charIndex += 1;
+            } else if (ch == '\\' && (nextCh == '\n' || nextCh == '\r')) {
+                endOfPath = true;
+            } else if (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t') {
+                endOfPath = true;
+            } else if (ch == ':' && !pastTarget && (nextCh == ' ' || nextCh == '\n' || nextCh == '\r')) {
+                pastTarget = true;
+                pathLen = 0;
+            } else {
+                pathBuf[pathLen++] = ch;
+            }
+
+            if (endOfPath && pathLen > 0) {
+                if (pastTarget) {
+                    u32 depId = internPath(arena, (prb_Str) {pathBuf, pathLen});
+                    arrput(deps, depId);
+                }
+                pathLen = 0;
+            }
+        }
+    }
+
+    setRecordedDeps(arena, out, deps);
+    prb_assert(prb_removePathIfExists(arena, depfilePath));
+    prb_endTempMemory(temp);
+}
+
+function prb_FileStat
+getFileStatCached(prb_Arena* arena, prb_Str path) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    char*          key = (char*)prb_strGetNullTerminated(arena, path);
+    i32            cacheIndex = shgeti(globalFileStats, key);
+    prb_FileStat   result = {};
+    if (cacheIndex == -1) {
+        result = prb_getFileStat(arena, path);
+        shput(globalFileStats, key, result);
+    } else {
+        result = globalFileStats[cacheIndex].value;
+    }
+    prb_endTempMemory(temp);
+    return result;
+}
+
+function void
+forgetFileStat(prb_Arena* arena, prb_Str path) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    char*          key = (char*)prb_strGetNullTerminated(arena, path);
+    if (shgeti(globalFileStats, key) != -1) {
+        (void)shdel(globalFileStats, key);
     }
-    prb_Str str = prb_strFromBytes(readRes.content);
-    return str;
+    prb_endTempMemory(temp);
+}
+
+function bool
+fileStatsEqual(prb_FileStat stat1, prb_FileStat stat2) {
+    bool result = stat1.valid && stat2.valid && stat1.lastMod == stat2.lastMod && stat1.size == stat2.size && stat1.inode == stat2.inode;
+    return result;
 }
 
 function void
-resolveEntry(FileLastMod* entry) {
-    prb_assert(!entry->value.beingResolved);
-    if (!entry->value.haveLastModWithDeps) {
-        entry->value.beingResolved = true;
-        prb_Str* directIncludes = entry->value.directIncludes;
-        i32      directIncludesCount = arrlen(directIncludes);
-        for (i32 includeIndex = 0; includeIndex < directIncludesCount; includeIndex++) {
-            prb_Str includeName = directIncludes[includeIndex];
-            i32     includeIndex = shgeti(globalLastModTable, includeName.ptr);
-            if (includeIndex != -1) {
-                FileLastMod* includeEntry = globalLastModTable + includeIndex;
-                if (!includeEntry->value.beingResolved) {
-                    resolveEntry(includeEntry);
-                    entry->value.lastModWithDeps = prb_max(entry->value.lastModWithDeps, includeEntry->value.lastModWithDeps);
+loadHashCache(prb_Arena* arena) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    sh_new_strdup(globalHashCache);
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, globalHashCachePath);
+    if (readRes.success) {
+        prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(readRes.content));
+        while (prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak}, prb_StrScannerSide_AfterMatch)) {
+            prb_Str        fields[5] = {};
+            i32            fieldCount = 0;
+            prb_StrScanner fieldScanner = prb_createStrScanner(lineScanner.betweenLastMatches);
+            while (fieldCount < prb_arrayCount(fields) - 1 && prb_strScannerMove(&fieldScanner, (prb_StrFindSpec) {.pattern = prb_STR(" "), .alwaysMatchEnd = true}, prb_StrScannerSide_AfterMatch)) {
+                fields[fieldCount++] = fieldScanner.betweenLastMatches;
+            }
+            // NOTE(khvorov) Path is whatever is left, it can have spaces in it
+            fields[fieldCount++] = fieldScanner.afterMatch;
+
+            if (fieldCount == prb_arrayCount(fields)) {
+                prb_ParseUintResult hash = prb_parseUint(fields[0], 16);
+                prb_ParseUintResult lastMod = prb_parseUint(fields[1], 10);
+                prb_ParseUintResult size = prb_parseUint(fields[2], 10);
+                prb_ParseUintResult inode = prb_parseUint(fields[3], 10);
+                if (hash.success && lastMod.success && size.success && inode.success && fields[4].len > 0) {
+                    HashCacheEntry entry = {{true, lastMod.number, size.number, inode.number}, hash.number};
+                    shput(globalHashCache, (char*)prb_strGetNullTerminated(arena, fields[4]), entry);
                 }
             }
         }
-        entry->value.beingResolved = false;
-        entry->value.haveLastModWithDeps = true;
     }
+    prb_endTempMemory(temp);
 }
 
 function void
-resolveFileLastMod(prb_Arena* arena) {
+saveHashCache(prb_Arena* arena) {
     prb_TempMemory temp = prb_beginTempMemory(arena);
-    prb_Arena      includesArena = prb_createArenaFromArena(arena, 10 * prb_MEGABYTE);
+    prb_GrowingStr cacheBuilder = prb_beginStr(arena);
+    for (i32 entryIndex = 0; entryIndex < shlen(globalHashCache); entryIndex++) {
+        HashCacheKV kv = globalHashCache[entryIndex];
+        if (kv.value.stat.valid) {
+            prb_addStrSegment(
+                &cacheBuilder,
+                "%016llx %llu %llu %llu %s\n",
+                (unsigned long long)kv.value.hash,
+                (unsigned long long)kv.value.stat.lastMod,
+                (unsigned long long)kv.value.stat.size,
+                (unsigned long long)kv.value.stat.inode,
+                kv.key
+            );
+        }
+    }
+    prb_Str cacheStr = prb_endStr(&cacheBuilder);
+    prb_assert(prb_writeEntireFile(arena, globalHashCachePath, cacheStr.ptr, cacheStr.len));
+    prb_endTempMemory(temp);
+}
+
+function prb_FileHash
+getFileHashCached(prb_Arena* arena, prb_Str path) {
+    prb_FileHash result = {};
+    prb_FileStat stat = getFileStatCached(arena, path);
+    if (stat.valid) {
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+        char*          key = (char*)prb_strGetNullTerminated(arena, path);
+        i32            cacheIndex = shgeti(globalHashCache, key);
+        if (cacheIndex != -1 && fileStatsEqual(globalHashCache[cacheIndex].value.stat, stat)) {
+            result = (prb_FileHash) {true, globalHashCache[cacheIndex].value.hash};
+        } else {
+            result = prb_getFileHash(arena, path);
+            if (result.valid) {
+                HashCacheEntry entry = {stat, result.hash};
+                shput(globalHashCache, key, entry);
+            }
+        }
+        prb_endTempMemory(temp);
+    }
+    return result;
+}
+
+typedef struct HashFilesSpec {
+    prb_Str*      paths;
+    prb_FileHash* hashes;
+} HashFilesSpec;
 
-    i32 pathCount = arrlen(globalAllFilesInSrc);
-    for (i32 pathIndex = 0; pathIndex < pathCount; pathIndex++) {
-        prb_TempMemory tempPath = prb_beginTempMemory(arena);
+function void
+hashFiles(prb_Arena* arena, void* data) {
+    HashFilesSpec* spec = (HashFilesSpec*)data;
+    for (i32 pathIndex = 0; pathIndex < arrlen(spec->paths); pathIndex++) {
+        spec->hashes[pathIndex] = prb_getFileHash(arena, spec->paths[pathIndex]);
+    }
+}
+
+// NOTE(khvorov) Stat everything we might depend on, then read and hash whatever changed since the last run on all cores.
+// Called before building each phase since tablegen writes into the source dir between phases.
+function void
+refreshFileHashes(prb_Arena* arena) {
+    FileStatKV* keptStats = 0;
+    sh_new_strdup(keptStats);
+    if (globalWatchMode) {
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+        prb_Str        srcDirPrefix = prb_fmt(arena, "%.*s/", prb_LIT(globalClangSrcDir));
+        for (i32 statIndex = 0; statIndex < shlen(globalFileStats); statIndex++) {
+            if (prb_strStartsWith(prb_STR(globalFileStats[statIndex].key), srcDirPrefix)) {
+                shput(keptStats, globalFileStats[statIndex].key, globalFileStats[statIndex].value);
+            }
+        }
+        prb_endTempMemory(temp);
+    }
+    shfree(globalFileStats);
+    globalFileStats = keptStats;
+
+    if (globalHashMode) {
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+
+        prb_Str* candidates = 0;
+        for (i32 pathIndex = 0; pathIndex < arrlen(globalAllFilesInSrc); pathIndex++) {
+            arrput(candidates, globalAllFilesInSrc[pathIndex]);
+        }
+        for (i32 pathIndex = 0; pathIndex < arrlen(globalDepsLogPaths); pathIndex++) {
+            arrput(candidates, globalDepsLogPaths[pathIndex]);
+        }
 
-        prb_Str           path = globalAllFilesInSrc[pathIndex];
-        prb_FileTimestamp pathLastMod = prb_getLastModified(arena, path);
-        prb_assert(pathLastMod.valid);
-        PathLastModValue val = {.thisFileLastMod = pathLastMod.timestamp, .lastModWithDeps = pathLastMod.timestamp};
+        prb_CoreCountResult cores = prb_getCoreCount(arena);
+        prb_assert(cores.success);
+        HashFilesSpec* specs = prb_arenaAllocArray(arena, HashFilesSpec, cores.cores);
+        u64*           specBytes = prb_arenaAllocArray(arena, u64, cores.cores);
+        u64*           specLargestFile = prb_arenaAllocArray(arena, u64, cores.cores);
 
-        prb_Str        content = readFile(arena, path);
-        prb_StrScanner scanner = prb_createStrScanner(content);
-        while (prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR("#include ")}, prb_StrScannerSide_AfterMatch)) {
-            prb_assert(scanner.afterMatch.len > 0);
-            char quoteCh1 = scanner.afterMatch.ptr[0];
-            if (quoteCh1 == '"' || quoteCh1 == '<') {
-                char quoteCh2 = '"';
-                if (quoteCh1 == '<') {
-                    quoteCh2 = '>';
+        // NOTE(khvorov) Give each file to whichever job has the least bytes to read so far
+        for (i32 pathIndex = 0; pathIndex < arrlen(candidates); pathIndex++) {
+            prb_Str      path = candidates[pathIndex];
+            prb_FileStat stat = getFileStatCached(arena, path);
+            i32          cacheIndex = shgeti(globalHashCache, (char*)prb_strGetNullTerminated(arena, path));
+            bool         alreadyQueued = cacheIndex != -1 && globalHashCache[cacheIndex].value.stat.valid == false;
+            if (stat.valid && !alreadyQueued && (cacheIndex == -1 || !fileStatsEqual(globalHashCache[cacheIndex].value.stat, stat))) {
+                i32 specIndex = 0;
+                for (i32 otherIndex = 1; otherIndex < cores.cores; otherIndex++) {
+                    if (specBytes[otherIndex] < specBytes[specIndex]) {
+                        specIndex = otherIndex;
+                    }
                 }
+                arrput(specs[specIndex].paths, path);
+                specBytes[specIndex] += stat.size;
+                specLargestFile[specIndex] = prb_max(specLargestFile[specIndex], stat.size);
+
+                // NOTE(khvorov) Same file can come from both lists.
+                // The placeholder never matches a real stat and is not saved if the file can't be read.
+                HashCacheEntry placeholder = {};
+                shput(globalHashCache, (char*)prb_strGetNullTerminated(arena, path), placeholder);
+            }
+        }
 
-                prb_assert(prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_fmt(arena, "%c", quoteCh1)}, prb_StrScannerSide_AfterMatch));
-                prb_assert(prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_fmt(arena, "%c", quoteCh2)}, prb_StrScannerSide_AfterMatch));
+        prb_Job* jobs = 0;
+        for (i32 specIndex = 0; specIndex < cores.cores; specIndex++) {
+            HashFilesSpec* spec = specs + specIndex;
+            if (arrlen(spec->paths) > 0) {
+                spec->hashes = prb_arenaAllocArray(arena, prb_FileHash, arrlen(spec->paths));
+                prb_Job job = prb_createJob(hashFiles, spec, arena, specLargestFile[specIndex] + prb_MEGABYTE);
+                arrput(jobs, job);
+            }
+        }
+        prb_assert(prb_launchJobs(jobs, arrlen(jobs), prb_Background_Yes));
+        prb_assert(prb_waitForJobs(jobs, arrlen(jobs)));
 
-                prb_Str includedFile = prb_fmt(&includesArena, "%.*s", prb_LIT(scanner.betweenLastMatches));
-                arrput(val.directIncludes, includedFile);
+        for (i32 specIndex = 0; specIndex < cores.cores; specIndex++) {
+            HashFilesSpec* spec = specs + specIndex;
+            for (i32 pathIndex = 0; pathIndex < arrlen(spec->paths); pathIndex++) {
+                prb_Str path = spec->paths[pathIndex];
+                char*   key = (char*)prb_strGetNullTerminated(arena, path);
+                if (spec->hashes[pathIndex].valid) {
+                    HashCacheEntry entry = {getFileStatCached(arena, path), spec->hashes[pathIndex].hash};
+                    shput(globalHashCache, key, entry);
+                }
             }
+            arrfree(spec->paths);
         }
 
-        prb_Str name = prb_getLastEntryInPath(path);
-        shput(globalLastModTable, name.ptr, val);
+        arrfree(jobs);
+        arrfree(candidates);
+        prb_endTempMemory(temp);
+    }
+}
+
+function u32*
+getRecordedDeps(prb_Arena* arena, prb_Str out) {
+    u32*           result = 0;
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    i32            outIdIndex = shgeti(globalDepsLogPathIds, (char*)prb_strGetNullTerminated(arena, out));
+    prb_endTempMemory(temp);
+    if (outIdIndex != -1) {
+        i32 recordIndex = hmgeti(globalDepsLog, globalDepsLogPathIds[outIdIndex].value);
+        if (recordIndex != -1) {
+            result = globalDepsLog[recordIndex].value;
+            // NOTE(khvorov) Distinguish "no deps" from "no record"
+            prb_assert(result != 0);
+        }
+    }
+    return result;
+}
 
-        prb_endTempMemory(tempPath);
+// NOTE(khvorov) One hash for the TU and everything it includes, in the order the compiler reported them
+function prb_FileHash
+getDepsHash(prb_Arena* arena, prb_Str out) {
+    prb_FileHash result = {};
+    u32*         deps = getRecordedDeps(arena, out);
+    if (deps) {
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+        u64*           depHashes = prb_arenaAllocArray(arena, u64, arrlen(deps));
+        result.valid = true;
+        for (i32 depIndex = 0; depIndex < arrlen(deps) && result.valid; depIndex++) {
+            prb_FileHash depHash = getFileHashCached(arena, globalDepsLogPaths[deps[depIndex]]);
+            result.valid = depHash.valid;
+            depHashes[depIndex] = depHash.hash;
+        }
+        if (result.valid) {
+            result.hash = prb_hashBytes(depHashes, arrlen(deps) * sizeof(*depHashes), 0);
+        }
+        prb_endTempMemory(temp);
+    }
+    return result;
+}
+
+// NOTE(khvorov) Out of date if out is missing, we don't know its deps, or any dep is missing or changed.
+// Changed means newer than out by default and different bytes with --hash.
+function bool
+depsChanged(prb_Arena* arena, prb_Str out) {
+    bool         result = true;
+    prb_FileStat outStat = prb_getFileStat(arena, out);
+    if (outStat.valid) {
+        if (globalHashMode) {
+            prb_TempMemory temp = prb_beginTempMemory(arena);
+            i32            entryIndex = shgeti(globalBuildLog, (char*)prb_strGetNullTerminated(arena, out));
+            prb_endTempMemory(temp);
+            prb_FileHash depsHash = getDepsHash(arena, out);
+            result = entryIndex == -1 || !depsHash.valid || depsHash.hash != globalBuildLog[entryIndex].value.inputHash;
+        } else {
+            u32* deps = getRecordedDeps(arena, out);
+            if (deps) {
+                result = false;
+                for (i32 depIndex = 0; depIndex < arrlen(deps) && !result; depIndex++) {
+                    prb_FileStat depStat = getFileStatCached(arena, globalDepsLogPaths[deps[depIndex]]);
+                    result = !depStat.valid || depStat.lastMod > outStat.lastMod;
+                }
+            }
+        }
     }
+    return result;
+}
+
+// NOTE(khvorov) Objects keyed by what went into them, outside of build/ so that wiping build/ or switching branches
+// restores objects instead of recompiling them. Same scheme as ccache direct mode:
+// manifests/<cmd hash> lists the deps the compiler reported the last time it ran that command (one path per line),
+// objects/<hash of the cmd hash and the content hash of every one of those deps> is the object.
+// Everything under the root is hashed and listed as ./<path from the root> so that checkouts in different places
+// (and the remote cache) share keys.
+// Evicted least recently used first once it grows past globalObjCacheMaxBytes.
+global_variable prb_Str globalObjCacheDir;
+global_variable u64     globalObjCacheMaxBytes = 20ull * prb_GIGABYTE;
 
-    for (i32 pathIndex = 0; pathIndex < pathCount; pathIndex++) {
-        resolveEntry(globalLastModTable + pathIndex);
+// NOTE(khvorov) Every path in str that starts with the root starts with . instead
+function prb_Str
+getRootRelative(prb_Arena* arena, prb_Str str) {
+    prb_GrowingStr builder = prb_beginStr(arena);
+    i32            copiedUpTo = 0;
+    for (i32 index = 0; globalRootDir.len > 0 && index + globalRootDir.len <= str.len;) {
+        i32  after = index + globalRootDir.len;
+        bool atPathStart = index == 0 || str.ptr[index - 1] == ' ' || str.ptr[index - 1] == '=';
+        bool isRoot = atPathStart && prb_memeq(str.ptr + index, globalRootDir.ptr, globalRootDir.len)
+            && (after == str.len || str.ptr[after] == '/' || str.ptr[after] == ' ' || str.ptr[after] == '=');
+        if (isRoot) {
+            prb_addStrSegment(&builder, "%.*s.", index - copiedUpTo, str.ptr + copiedUpTo);
+            copiedUpTo = after;
+            index = after;
+        } else {
+            index += 1;
+        }
     }
+    prb_addStrSegment(&builder, "%.*s", str.len - copiedUpTo, str.ptr + copiedUpTo);
+    prb_Str result = prb_endStr(&builder);
+    return result;
+}
 
+function u64
+getObjCacheCmdHash(prb_Arena* arena, prb_Str cmd) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    u64            result = hashStr(getRootRelative(arena, cmd));
     prb_endTempMemory(temp);
-    prb_arenaChangeUsed(arena, includesArena.used);
+    return result;
 }
 
-typedef struct CompileObjsResult {
-    prb_Str objs;
-    bool    anyRecompiled;
-} CompileObjsResult;
+function prb_Str
+getObjCacheManifestPath(prb_Arena* arena, prb_Str cmd) {
+    prb_Str result = prb_fmt(arena, "%.*s/manifests/%016llx", prb_LIT(globalObjCacheDir), (unsigned long long)getObjCacheCmdHash(arena, cmd));
+    return result;
+}
 
-function CompileObjsResult
-compileObjs(prb_Arena* arena, prb_Str outdir, prb_Str* srcFiles, i32 srcFileCount) {
+// NOTE(khvorov) Empty when one of the deps is gone
+function prb_Str
+getObjCacheObjPath(prb_Arena* arena, prb_Str cmd, u32* deps) {
+    prb_Str        result = {};
     prb_TempMemory temp = prb_beginTempMemory(arena);
-    prb_Arena      objListArena = prb_createArenaFromArena(arena, 1 * prb_MEGABYTE);
-    prb_GrowingStr objListBuilder = prb_beginStr(&objListArena);
+    u64*           keyHashes = prb_arenaAllocArray(arena, u64, arrlen(deps) + 1);
+    bool           allDepsHashed = true;
+    keyHashes[0] = getObjCacheCmdHash(arena, cmd);
+    for (i32 depIndex = 0; depIndex < arrlen(deps) && allDepsHashed; depIndex++) {
+        prb_FileHash depHash = getFileHashCached(arena, globalDepsLogPaths[deps[depIndex]]);
+        allDepsHashed = depHash.valid;
+        keyHashes[depIndex + 1] = depHash.hash;
+    }
+    u64 key = prb_hashBytes(keyHashes, (arrlen(deps) + 1) * sizeof(*keyHashes), 0);
+    prb_endTempMemory(temp);
+    if (allDepsHashed) {
+        result = prb_fmt(arena, "%.*s/objects/%016llx", prb_LIT(globalObjCacheDir), (unsigned long long)key);
+    }
+    return result;
+}
 
-    prb_Process* objProcs = 0;
-    for (i32 srcIndex = 0; srcIndex < srcFileCount; srcIndex++) {
-        prb_Str srcpath = srcFiles[srcIndex];
-        prb_assert(isSrcFile(srcpath));
-        prb_Str filename = prb_getLastEntryInPath(srcpath);
-        prb_Str outname = prb_replaceExt(arena, filename, prb_STR("obj"));
-        prb_Str out = prb_pathJoin(arena, outdir, outname);
-        prb_addStrSegment(&objListBuilder, " %.*s", prb_LIT(out));
+function bool
+copyFile(prb_Arena* arena, prb_Str from, prb_Str to) {
+    prb_TempMemory           temp = prb_beginTempMemory(arena);
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, from);
+    bool                     result = readRes.success && prb_writeEntireFile(arena, to, readRes.content.data, readRes.content.len);
+    prb_endTempMemory(temp);
+    return result;
+}
 
-        // NOTE(khvorov) Recompile if src or any of its includes are newer than out (or if out does not exist)
-        bool              shouldRecompile = true;
-        prb_FileTimestamp outLastMod = prb_getLastModified(arena, out);
-        if (outLastMod.valid) {
-            i32 srcEntryIndex = shgeti(globalLastModTable, filename.ptr);
-            prb_assert(srcEntryIndex != -1);
-            FileLastMod* srcLastModEntry = globalLastModTable + srcEntryIndex;
-            prb_assert(srcLastModEntry->value.haveLastModWithDeps);
-            shouldRecompile = srcLastModEntry->value.lastModWithDeps > outLastMod.timestamp;
-        }
-
-        if (shouldRecompile) {
-            prb_Str defines = prb_STR(
-                "-DLLVM_ON_UNIX -DPACKAGE_NAME=\"LLVM\" -DPACKAGE_VERSION=\"420.69\" "
-                "-DHAVE_FCNTL_H=1 -DHAVE_UNISTD_H=1 -DLLVM_ENABLE_THREADS=1 -DHAVE_SYSEXITS_H=1 "
-                "-DHAVE_SYS_STAT_H=1 -DLLVM_WINDOWS_PREFER_FORWARD_SLASH=1 -DHAVE_SYS_MMAN_H=1 "
-                "-DHAVE_FUTIMENS=1 -DLLVM_ENABLE_CRASH_DUMPS=1 -DHAVE_GETRUSAGE=1 -DHAVE_SYS_RESOURCE_H=1 "
-                "-DHAVE_GETPAGESIZE=1 -DHAVE_MALLINFO2=1 -DHAVE_PTHREAD_H -DHAVE_ERRNO_H -DHAVE_STRERROR_R "
-                "-DBUG_REPORT_URL=\"hawtdawgadverntures.xyz\" -DCLANG_SPAWN_CC1=0 "
-                "-DCLANG_INSTALL_LIBDIR_BASENAME=\"\" -DENABLE_X86_RELAX_RELOCATIONS=1 -DDEFAULT_SYSROOT=\"\" "
-                "-DCLANG_RESOURCE_DIR=\"\" -DPPC_LINUX_DEFAULT_IEEELONGDOUBLE=0 -DCLANG_DEFAULT_OPENMP_RUNTIME=\"libomp\" "
-                "-DCLANG_DEFAULT_LINKER=\"\" -DLLVM_HOST_TRIPLE=\"x86_64-unknown-linux-gnu\" -DCLANG_DEFAULT_RTLIB=\"\" "
-                "-DCLANG_DEFAULT_UNWINDLIB=\"\" -DCLANG_DEFAULT_CXX_STDLIB=\"\" -DLLVM_DEFAULT_TARGET_TRIPLE=\"x86_64-unknown-linux-gnu\" "
-                "-DC_INCLUDE_DIRS=\"\" -DCLANG_DEFAULT_PIE_ON_LINUX=1 -DCLANG_DEFAULT_OBJCOPY=\"objcopy\" -DGCC_INSTALL_PREFIX=\"\" "
-                "-DLLVM_VERSION_STRING=\"420.69\" -DCLANG_OPENMP_NVPTX_DEFAULT_ARCH=\"sm_35\" "
-                "-DCLANG_SYSTEMZ_DEFAULT_ARCH=\"z10\" -DLLVM_ENABLE_ABI_BREAKING_CHECKS=1 -DLLVM_VERSION_MAJOR=69 "
-                "-DLLVM_VERSION_MINOR=420 -DLLVM_VERSION_PATCH=1337 "
-                "-DBLAKE3_NO_AVX512=1 -DBLAKE3_NO_AVX2 -DBLAKE3_NO_SSE41 -DBLAKE3_NO_SSE2"
-            );
-            prb_Str flags = prb_STR("-std=c++17");
-            if (prb_strEndsWith(srcpath, prb_STR(".c"))) {
-                flags = prb_STR("");
+// NOTE(khvorov) Caller owns the array, null when there is no manifest
+function u32*
+readObjCacheManifest(prb_Arena* arena, prb_Str cmd) {
+    u32*                     result = 0;
+    prb_TempMemory           temp = prb_beginTempMemory(arena);
+    prb_ReadEntireFileResult manifest = prb_readEntireFile(arena, getObjCacheManifestPath(arena, cmd));
+    if (manifest.success) {
+        prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(manifest.content));
+        while (prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak}, prb_StrScannerSide_AfterMatch)) {
+            prb_Str path = lineScanner.betweenLastMatches;
+            if (prb_strStartsWith(path, prb_STR("./"))) {
+                path = prb_fmt(arena, "%.*s%.*s", prb_LIT(globalRootDir), path.len - 1, path.ptr + 1);
+            }
+            if (path.len > 0) {
+                arrput(result, internPath(arena, path));
+            }
+        }
+    }
+    prb_endTempMemory(temp);
+    return result;
+}
+
+// NOTE(khvorov) On a hit out and its deps record end up exactly as if the compiler had just run
+function bool
+restoreFromObjCache(prb_Arena* arena, prb_Str cmd, prb_Str out) {
+    bool result = false;
+    if (globalObjCacheDir.len > 0) {
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+        u32*           deps = readObjCacheManifest(arena, cmd);
+        if (deps) {
+            prb_Str objPath = getObjCacheObjPath(arena, cmd, deps);
+            if (objPath.len > 0 && prb_isFile(arena, objPath)) {
+                prb_createDirIfNotExists(arena, prb_getParentDir(arena, out));
+                // NOTE(khvorov) The skeleton in the object refers to the .dwo by its path from the root, which is out's
+                bool dwoRestored = !globalProfile.splitDwarf || copyFile(arena, getDwoPath(arena, objPath), getDwoPath(arena, out));
+                if (dwoRestored && copyFile(arena, objPath, out)) {
+                    // NOTE(khvorov) Eviction goes by mtime
+                    utimensat(AT_FDCWD, prb_strGetNullTerminated(arena, objPath), 0, 0);
+                    if (globalProfile.splitDwarf) {
+                        utimensat(AT_FDCWD, prb_strGetNullTerminated(arena, getDwoPath(arena, objPath)), 0, 0);
+                    }
+                    setRecordedDeps(arena, out, deps);
+                    deps = 0;
+                    result = true;
+                }
+            }
+            arrfree(deps);
+        }
+        prb_endTempMemory(temp);
+    }
+    return result;
+}
+
+typedef struct ObjCacheEntry {
+    prb_Str manifestPath;
+    prb_Str objPath;
+} ObjCacheEntry;
+
+// NOTE(khvorov) Paths are empty when nothing was stored
+function ObjCacheEntry
+storeInObjCache(prb_Arena* arena, prb_Str cmd, prb_Str out) {
+    ObjCacheEntry result = {};
+    if (globalObjCacheDir.len > 0) {
+        u32*    deps = getRecordedDeps(arena, out);
+        prb_Str objPath = getObjCacheObjPath(arena, cmd, deps);
+        if (objPath.len > 0) {
+            prb_Str        manifestPath = getObjCacheManifestPath(arena, cmd);
+            prb_TempMemory temp = prb_beginTempMemory(arena);
+            prb_Str*       depLines = prb_arenaAllocArray(arena, prb_Str, arrlen(deps));
+            for (i32 depIndex = 0; depIndex < arrlen(deps); depIndex++) {
+                depLines[depIndex] = getRootRelative(arena, globalDepsLogPaths[deps[depIndex]]);
             }
-            prb_Str cmd = prb_fmt(arena, "clang -g %.*s %.*s -Werror -Wfatal-errors -c %.*s -o %.*s", prb_LIT(defines), prb_LIT(flags), prb_LIT(srcpath), prb_LIT(out));
-            prb_writelnToStdout(arena, cmd);
-            prb_Process proc = prb_createProcess(cmd, (prb_ProcessSpec) {});
-            arrput(objProcs, proc);
+            prb_GrowingStr manifestBuilder = prb_beginStr(arena);
+            for (i32 depIndex = 0; depIndex < arrlen(deps); depIndex++) {
+                prb_addStrSegment(&manifestBuilder, "%.*s\n", prb_LIT(depLines[depIndex]));
+            }
+            prb_Str manifest = prb_endStr(&manifestBuilder);
+            prb_createDirIfNotExists(arena, prb_getParentDir(arena, manifestPath));
+            prb_createDirIfNotExists(arena, prb_getParentDir(arena, objPath));
+            if (globalProfile.splitDwarf) {
+                prb_assert(copyFile(arena, getDwoPath(arena, out), getDwoPath(arena, objPath)));
+            }
+            prb_assert(copyFile(arena, out, objPath));
+            prb_assert(prb_writeEntireFile(arena, manifestPath, manifest.ptr, manifest.len));
+            prb_endTempMemory(temp);
+            result = (ObjCacheEntry) {manifestPath, objPath};
         }
     }
-    prb_Str objList = prb_endStr(&objListBuilder);
+    return result;
+}
 
-    i32                 totalObjCount = arrlen(objProcs);
-    prb_CoreCountResult chunkSize = prb_getCoreCount(arena);
-    prb_assert(chunkSize.success);
-    i32 chunkCount = (totalObjCount / chunkSize.cores) + 1;
-    i32 procsDoneCount = 0;
-    for (i32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++) {
-        prb_Process* thisProcSet = objProcs + procsDoneCount;
-        i32          procsLeft = totalObjCount - procsDoneCount;
-        i32          thisChunkSize = prb_min(procsLeft, chunkSize.cores);
-        prb_assert(prb_launchProcesses(arena, thisProcSet, thisChunkSize, prb_Background_Yes));
-        prb_assert(prb_waitForProcesses(thisProcSet, thisChunkSize));
-        procsDoneCount += thisChunkSize;
+// NOTE(khvorov) Shares the local cache over HTTP using the Bazel remote cache REST layout:
+// GET/PUT <prefix>/ac/<cmd hash> is a manifest, GET/PUT <prefix>/cas/<object key> is an object.
+// Keys are the same 64-bit hashes the local cache uses rather than sha256, so use a server that doesn't validate them
+// (like cacheserver.c). Everything fetched lands in the local cache first. Failures just mean a cache miss.
+typedef struct RemoteCache {
+    prb_Str host;
+    prb_Str port;
+    prb_Str prefix;
+} RemoteCache;
+
+global_variable RemoteCache globalRemoteCache;
+
+// NOTE(khvorov) http://host[:port][/prefix]
+function bool
+parseRemoteCacheUrl(prb_Str url, RemoteCache* remote) {
+    bool    result = false;
+    prb_Str scheme = prb_STR("http://");
+    if (prb_strStartsWith(url, scheme)) {
+        prb_Str        rest = prb_strSlice(url, scheme.len, url.len);
+        prb_StrScanner scanner = prb_createStrScanner(rest);
+        prb_Str        hostPort = rest;
+        remote->prefix = prb_STR("");
+        if (prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR("/")}, prb_StrScannerSide_AfterMatch)) {
+            hostPort = scanner.betweenLastMatches;
+            remote->prefix = prb_strSlice(rest, hostPort.len, rest.len);
+            if (prb_strEndsWith(remote->prefix, prb_STR("/"))) {
+                remote->prefix.len -= 1;
+            }
+        }
+        remote->host = hostPort;
+        remote->port = prb_STR("80");
+        prb_StrScanner portScanner = prb_createStrScanner(hostPort);
+        if (prb_strScannerMove(&portScanner, (prb_StrFindSpec) {.pattern = prb_STR(":")}, prb_StrScannerSide_AfterMatch)) {
+            remote->host = portScanner.betweenLastMatches;
+            remote->port = portScanner.afterMatch;
+        }
+        result = remote->host.len > 0 && remote->port.len > 0;
+    }
+    return result;
+}
+
+typedef struct HttpConn {
+    int fd;
+} HttpConn;
+
+function void
+httpDisconnect(HttpConn* conn) {
+    if (conn->fd != -1) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
+
+function bool
+httpConnect(prb_Arena* arena, HttpConn* conn) {
+    if (conn->fd == -1) {
+        prb_TempMemory   temp = prb_beginTempMemory(arena);
+        struct addrinfo  hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+        struct addrinfo* addrs = 0;
+        if (getaddrinfo(prb_strGetNullTerminated(arena, globalRemoteCache.host), prb_strGetNullTerminated(arena, globalRemoteCache.port), &hints, &addrs) == 0) {
+            for (struct addrinfo* addr = addrs; addr && conn->fd == -1; addr = addr->ai_next) {
+                int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+                if (fd != -1) {
+                    if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+                        conn->fd = fd;
+                    } else {
+                        close(fd);
+                    }
+                }
+            }
+            freeaddrinfo(addrs);
+        }
+        prb_endTempMemory(temp);
+    }
+    bool result = conn->fd != -1;
+    return result;
+}
+
+function bool
+sendAll(int fd, const void* data, i64 len) {
+    bool result = true;
+    for (i64 sent = 0; sent < len && result;) {
+        ssize_t sentNow = send(fd, (const u8*)data + sent, len - sent, MSG_NOSIGNAL);
+        result = sentNow > 0;
+        sent += sentNow;
+    }
+    return result;
+}
+
+// NOTE(khvorov) Streams the request body from bodyPath (if not empty) and the response body into responsePath (if not empty and 200).
+// The response goes into a temporary first so a half-finished download never looks like a cache entry.
+// Returns the status or -1 when the connection broke.
+function i32
+httpRequestOnce(prb_Arena* arena, HttpConn* conn, prb_Str method, prb_Str urlPath, prb_Str bodyPath, prb_Str responsePath) {
+    i32            result = -1;
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    u8             buf[64 * 1024];
+    bool           ok = httpConnect(arena, conn);
+
+    i64 bodyLen = 0;
+    int bodyFd = -1;
+    if (ok && bodyPath.len > 0) {
+        bodyFd = open(prb_strGetNullTerminated(arena, bodyPath), O_RDONLY);
+        struct stat bodyStat = {};
+        ok = bodyFd != -1 && fstat(bodyFd, &bodyStat) == 0;
+        bodyLen = bodyStat.st_size;
+    }
+
+    if (ok) {
+        prb_Str header = prb_fmt(
+            arena,
+            "%.*s %.*s%.*s HTTP/1.1\r\nHost: %.*s\r\nContent-Length: %lld\r\nConnection: keep-alive\r\n\r\n",
+            prb_LIT(method),
+            prb_LIT(globalRemoteCache.prefix),
+            prb_LIT(urlPath),
+            prb_LIT(globalRemoteCache.host),
+            (long long)bodyLen
+        );
+        ok = sendAll(conn->fd, header.ptr, header.len);
+        for (i64 bodySent = 0; ok && bodySent < bodyLen;) {
+            ssize_t readNow = read(bodyFd, buf, sizeof(buf));
+            ok = readNow > 0 && sendAll(conn->fd, buf, readNow);
+            bodySent += readNow;
+        }
+    }
+    if (bodyFd != -1) {
+        close(bodyFd);
+    }
+
+    // NOTE(khvorov) Read until the end of the headers, whatever comes after is the start of the body
+    i32 headerLen = 0;
+    i32 bufLen = 0;
+    while (ok && headerLen == 0) {
+        ssize_t readNow = recv(conn->fd, buf + bufLen, sizeof(buf) - bufLen, 0);
+        ok = readNow > 0;
+        bufLen += readNow;
+        for (i32 bufIndex = 3; ok && bufIndex < bufLen && headerLen == 0; bufIndex++) {
+            if (prb_memeq(buf + bufIndex - 3, "\r\n\r\n", 4)) {
+                headerLen = bufIndex + 1;
+            }
+        }
+        ok = ok && (headerLen > 0 || bufLen < (i32)sizeof(buf));
+    }
+
+    i32  status = -1;
+    i64  contentLength = -1;
+    bool serverCloses = false;
+    if (ok) {
+        prb_StrScanner lineScanner = prb_createStrScanner((prb_Str) {(const char*)buf, headerLen});
+        for (i32 lineIndex = 0; prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak}, prb_StrScannerSide_AfterMatch); lineIndex++) {
+            prb_Str line = lineScanner.betweenLastMatches;
+            if (lineIndex == 0) {
+                if (line.len >= 12 && prb_strStartsWith(line, prb_STR("HTTP/1."))) {
+                    prb_ParseUintResult parsed = prb_parseUint(prb_strSlice(line, 9, 12), 10);
+                    status = parsed.success ? (i32)parsed.number : -1;
+                }
+            } else {
+                prb_Str lowerLine = prb_fmt(arena, "%.*s", prb_LIT(line));
+                for (i32 charIndex = 0; charIndex < lowerLine.len; charIndex++) {
+                    char ch = lowerLine.ptr[charIndex];
+                    ((char*)lowerLine.ptr)[charIndex] = ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+                }
+                prb_Str lengthName = prb_STR("content-length:");
+                if (prb_strStartsWith(lowerLine, lengthName)) {
+                    prb_ParseUintResult parsed = prb_parseUint(prb_strTrim(prb_strSlice(line, lengthName.len, line.len)), 10);
+                    contentLength = parsed.success ? (i64)parsed.number : -1;
+                } else if (prb_streq(lowerLine, prb_STR("connection: close"))) {
+                    serverCloses = true;
+                }
+            }
+        }
+        ok = status != -1;
+    }
+
+    if (ok) {
+        int     responseFd = -1;
+        prb_Str responseTempPath = {};
+        if (status == 200 && responsePath.len > 0) {
+            responseTempPath = prb_fmt(arena, "%.*s.tmp%d", prb_LIT(responsePath), conn->fd);
+            prb_createDirIfNotExists(arena, prb_getParentDir(arena, responsePath));
+            responseFd = open(prb_strGetNullTerminated(arena, responseTempPath), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            ok = responseFd != -1;
+        }
+
+        // NOTE(khvorov) Without a length the body goes on until the server hangs up
+        i64 bodyLeft = contentLength == -1 ? INT64_MAX : contentLength;
+        i64 bodyInBuf = prb_min(bufLen - headerLen, bodyLeft);
+        if (ok && responseFd != -1) {
+            ok = write(responseFd, buf + headerLen, bodyInBuf) == bodyInBuf;
+        }
+        bodyLeft -= bodyInBuf;
+        while (ok && bodyLeft > 0) {
+            ssize_t readNow = recv(conn->fd, buf, prb_min((i64)sizeof(buf), bodyLeft), 0);
+            if (readNow == 0 && contentLength == -1) {
+                bodyLeft = 0;
+            } else {
+                ok = readNow > 0 && (responseFd == -1 || write(responseFd, buf, readNow) == readNow);
+                bodyLeft -= readNow;
+            }
+        }
+
+        if (responseFd != -1) {
+            close(responseFd);
+            const char* responseTempPathNull = prb_strGetNullTerminated(arena, responseTempPath);
+            if (!ok || rename(responseTempPathNull, prb_strGetNullTerminated(arena, responsePath)) != 0) {
+                unlink(responseTempPathNull);
+            }
+        }
+
+        if (ok) {
+            result = status;
+        }
+        if (contentLength == -1 || serverCloses) {
+            httpDisconnect(conn);
+        }
+    }
+
+    if (!ok) {
+        httpDisconnect(conn);
+    }
+
+    prb_endTempMemory(temp);
+    return result;
+}
+
+// NOTE(khvorov) The server may have dropped an idle keep-alive connection, so try once more on a fresh one
+function i32
+httpRequest(prb_Arena* arena, HttpConn* conn, prb_Str method, prb_Str urlPath, prb_Str bodyPath, prb_Str responsePath) {
+    bool reused = conn->fd != -1;
+    i32  result = httpRequestOnce(arena, conn, method, urlPath, bodyPath, responsePath);
+    if (result == -1 && reused) {
+        result = httpRequestOnce(arena, conn, method, urlPath, bodyPath, responsePath);
+    }
+    return result;
+}
+
+typedef enum RemoteTransferKind {
+    RemoteTransferKind_Download,
+    RemoteTransferKind_Upload,
+} RemoteTransferKind;
+
+typedef struct RemoteTransferSpec {
+    RemoteTransferKind kind;
+    prb_Str*           urlPaths;
+    prb_Str*           filePaths;
+    i32                count;
+    i32                hits;
+    i32                failures;
+} RemoteTransferSpec;
+
+function void
+runRemoteTransfer(prb_Arena* arena, HttpConn* conn, RemoteTransferSpec* spec) {
+    for (i32 transferIndex = 0; transferIndex < spec->count; transferIndex++) {
+        prb_Str urlPath = spec->urlPaths[transferIndex];
+        prb_Str filePath = spec->filePaths[transferIndex];
+        i32     status = 0;
+        switch (spec->kind) {
+            case RemoteTransferKind_Download: status = httpRequest(arena, conn, prb_STR("GET"), urlPath, prb_STR(""), filePath); break;
+            case RemoteTransferKind_Upload: status = httpRequest(arena, conn, prb_STR("PUT"), urlPath, filePath, prb_STR("")); break;
+        }
+        spec->hits += status == 200;
+        spec->failures += status != 200 && status != 404;
+    }
+}
+
+// NOTE(khvorov) One keep-alive connection per job
+function void
+remoteTransfer(prb_Arena* arena, void* data) {
+    RemoteTransferSpec* spec = (RemoteTransferSpec*)data;
+    HttpConn            conn = {.fd = -1};
+    runRemoteTransfer(arena, &conn, spec);
+    httpDisconnect(&conn);
+}
+
+#define REMOTE_CACHE_CONNECTIONS 16
+
+// NOTE(khvorov) Spread over a few connections, that's enough to hide the latency
+function void
+downloadFromRemoteCache(prb_Arena* arena, prb_Str* urlPaths, prb_Str* filePaths) {
+    if (arrlen(urlPaths) > 0) {
+        prb_TempMemory     temp = prb_beginTempMemory(arena);
+        RemoteTransferSpec specs[REMOTE_CACHE_CONNECTIONS] = {};
+        prb_Job            jobs[REMOTE_CACHE_CONNECTIONS] = {};
+        i32                jobCount = prb_min(REMOTE_CACHE_CONNECTIONS, arrlen(urlPaths));
+        i32                perJob = (arrlen(urlPaths) + jobCount - 1) / jobCount;
+        for (i32 jobIndex = 0; jobIndex < jobCount; jobIndex++) {
+            i32 first = jobIndex * perJob;
+            specs[jobIndex] = (RemoteTransferSpec) {
+                .kind = RemoteTransferKind_Download,
+                .urlPaths = urlPaths + first,
+                .filePaths = filePaths + first,
+                .count = prb_max(0, prb_min(perJob, arrlen(urlPaths) - first)),
+            };
+            jobs[jobIndex] = prb_createJob(remoteTransfer, specs + jobIndex, arena, prb_MEGABYTE);
+        }
+        prb_assert(prb_launchJobs(jobs, jobCount, prb_Background_Yes));
+        prb_assert(prb_waitForJobs(jobs, jobCount));
+
+        i32 hits = 0;
+        i32 failures = 0;
+        for (i32 jobIndex = 0; jobIndex < jobCount; jobIndex++) {
+            hits += specs[jobIndex].hits;
+            failures += specs[jobIndex].failures;
+        }
+        prb_writeToStdout(prb_fmt(arena, "remote cache: %d/%d found, %d failed\n", hits, (i32)arrlen(urlPaths), failures));
+        prb_endTempMemory(temp);
+    }
+}
+
+// NOTE(khvorov) Objects go up while the rest of the build runs. A fixed set of workers, each with its own keep-alive connection,
+// take specs off the queue in order until it is closed and empty.
+typedef struct UploadQueue {
+    pthread_mutex_t     mutex;
+    pthread_cond_t      cond;
+    RemoteTransferSpec* specs;
+    i32                 pushed;
+    i32                 taken;
+    bool                closed;
+    i32                 failures;
+    prb_Job             workers[REMOTE_CACHE_CONNECTIONS];
+} UploadQueue;
+
+function void
+uploadWorker(prb_Arena* arena, void* data) {
+    UploadQueue* queue = (UploadQueue*)data;
+    HttpConn     conn = {.fd = -1};
+    i32          failures = 0;
+    for (;;) {
+        prb_assert(pthread_mutex_lock(&queue->mutex) == 0);
+        while (queue->taken == queue->pushed && !queue->closed) {
+            prb_assert(pthread_cond_wait(&queue->cond, &queue->mutex) == 0);
+        }
+        RemoteTransferSpec* spec = queue->taken < queue->pushed ? queue->specs + queue->taken++ : 0;
+        prb_assert(pthread_mutex_unlock(&queue->mutex) == 0);
+        if (!spec) {
+            break;
+        }
+        runRemoteTransfer(arena, &conn, spec);
+        failures += spec->failures;
+    }
+    httpDisconnect(&conn);
+
+    prb_assert(pthread_mutex_lock(&queue->mutex) == 0);
+    queue->failures += failures;
+    prb_assert(pthread_mutex_unlock(&queue->mutex) == 0);
+}
+
+// NOTE(khvorov) specs has room for every spec that will be pushed, the workers hold on to them
+function void
+startUploads(prb_Arena* arena, UploadQueue* queue, RemoteTransferSpec* specs) {
+    *queue = (UploadQueue) {.specs = specs};
+    prb_assert(pthread_mutex_init(&queue->mutex, 0) == 0);
+    prb_assert(pthread_cond_init(&queue->cond, 0) == 0);
+    for (i32 workerIndex = 0; workerIndex < REMOTE_CACHE_CONNECTIONS; workerIndex++) {
+        queue->workers[workerIndex] = prb_createJob(uploadWorker, queue, arena, prb_MEGABYTE);
+    }
+    prb_assert(prb_launchJobs(queue->workers, REMOTE_CACHE_CONNECTIONS, prb_Background_Yes));
+}
+
+// NOTE(khvorov) Call with the spec filled in at queue->specs[queue->pushed]
+function void
+pushUpload(UploadQueue* queue) {
+    prb_assert(pthread_mutex_lock(&queue->mutex) == 0);
+    queue->pushed += 1;
+    prb_assert(pthread_cond_signal(&queue->cond) == 0);
+    prb_assert(pthread_mutex_unlock(&queue->mutex) == 0);
+}
+
+// NOTE(khvorov) Returns how many transfers failed
+function i32
+finishUploads(UploadQueue* queue) {
+    prb_assert(pthread_mutex_lock(&queue->mutex) == 0);
+    queue->closed = true;
+    prb_assert(pthread_cond_broadcast(&queue->cond) == 0);
+    prb_assert(pthread_mutex_unlock(&queue->mutex) == 0);
+    prb_assert(prb_waitForJobs(queue->workers, REMOTE_CACHE_CONNECTIONS));
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    i32 result = queue->failures;
+    return result;
+}
+
+function prb_Str
+getRemoteCacheUrlPath(prb_Arena* arena, prb_Str kind, prb_Str localPath) {
+    // NOTE(khvorov) Keys are alphanumeric, <key>.dwo goes up as <key>dwo
+    prb_Str name = prb_getLastEntryInPath(localPath);
+    prb_Str ext = prb_STR(".dwo");
+    if (prb_strEndsWith(name, ext)) {
+        name = prb_fmt(arena, "%.*sdwo", name.len - ext.len, name.ptr);
+    }
+    prb_Str result = prb_fmt(arena, "/%.*s/%.*s", prb_LIT(kind), prb_LIT(name));
+    return result;
+}
+
+typedef struct CachedObj {
+    prb_Str      path;
+    prb_FileStat stat;
+} CachedObj;
+
+function int
+cachedObjOlderFirst(const void* obj1, const void* obj2) {
+    u64 lastMod1 = ((const CachedObj*)obj1)->stat.lastMod;
+    u64 lastMod2 = ((const CachedObj*)obj2)->stat.lastMod;
+    int result = lastMod1 < lastMod2 ? -1 : lastMod1 > lastMod2 ? 1 : 0;
+    return result;
+}
+
+// NOTE(khvorov) Manifests are a few KB each and a stale one just misses, so only objects get evicted
+function void
+pruneObjCache(prb_Arena* arena) {
+    prb_Str objectsDir = prb_pathJoin(arena, globalObjCacheDir, prb_STR("objects"));
+    if (globalObjCacheDir.len > 0 && prb_isDir(arena, objectsDir)) {
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+        prb_Str*       paths = prb_getAllDirEntries(arena, objectsDir, prb_Recursive_No);
+        CachedObj*     objs = prb_arenaAllocArray(arena, CachedObj, arrlen(paths));
+        u64            totalBytes = 0;
+        for (i32 pathIndex = 0; pathIndex < arrlen(paths); pathIndex++) {
+            objs[pathIndex] = (CachedObj) {paths[pathIndex], prb_getFileStat(arena, paths[pathIndex])};
+            totalBytes += objs[pathIndex].stat.size;
+        }
+        qsort(objs, arrlen(paths), sizeof(*objs), cachedObjOlderFirst);
+        for (i32 objIndex = 0; objIndex < arrlen(paths) && totalBytes > globalObjCacheMaxBytes; objIndex++) {
+            prb_assert(prb_removePathIfExists(arena, objs[objIndex].path));
+            totalBytes -= objs[objIndex].stat.size;
+        }
+        arrfree(paths);
+        prb_endTempMemory(temp);
+    }
+}
+
+// NOTE(khvorov) --check-tablegen: after the grouped tablegen runs, run every backend again on its own and make sure it
+// writes the same bytes. The grouped backends share one parse and the CodeGen analyses, this catches one that sees what
+// an earlier one left behind.
+global_variable bool globalCheckTableGen;
+
+// NOTE(khvorov) All the backends that run on one .td file, the file is only parsed once for all of them.
+// outs only has the outputs that are out of date.
+typedef struct RunTableGenSpec {
+    prb_Str  tableGenExe;
+    prb_Str  in;
+    prb_Str  includes;
+    prb_Str  tempDir;
+    prb_Str  backendsFile;
+    prb_Str* outs;
+    prb_Str* args;
+} RunTableGenSpec;
+
+// NOTE(khvorov) Tablegen writes here first, the depfile goes next to it
+function prb_Str
+getTableGenTempOut(prb_Arena* arena, prb_Str tempDir, prb_Str out) {
+    prb_Str result = prb_pathJoin(arena, tempDir, out);
+    return result;
+}
+
+function prb_Str
+getTableGenCmdKey(prb_Arena* arena, RunTableGenSpec* spec, prb_Str args) {
+    prb_Str result = prb_fmt(arena, "%.*s %.*s -I%.*s %.*s", prb_LIT(spec->tableGenExe), prb_LIT(args), prb_LIT(spec->includes), prb_LIT(spec->in));
+    return result;
+}
+
+// NOTE(khvorov) Everything that can change a generated file: the tablegen binary, the .td file and everything it includes
+function prb_FileHash
+getTableGenInputHash(prb_Arena* arena, prb_Str tableGenExe, prb_Str out) {
+    prb_FileHash result = {};
+    prb_FileHash exeHash = getFileHashCached(arena, tableGenExe);
+    prb_FileHash depsHash = getDepsHash(arena, out);
+    if (exeHash.valid && depsHash.valid) {
+        u64 hashes[] = {exeHash.hash, depsHash.hash};
+        result = (prb_FileHash) {true, prb_hashBytes(hashes, sizeof(hashes), 0)};
+    }
+    return result;
+}
+
+// NOTE(khvorov) Only touches outpath when the flattened text is different so that nothing downstream rebuilds for nothing
+function void
+flattenTableGenIncludes(prb_Arena* arena, prb_Str tempOutpath, prb_Str outpath) {
+    prb_TempMemory           temp = prb_beginTempMemory(arena);
+    prb_ReadEntireFileResult outread = prb_readEntireFile(arena, tempOutpath);
+    prb_assert(outread.success);
+    prb_Str outstr = prb_strFromBytes(outread.content);
+
+    prb_Arena      flatoutArena = prb_createArenaFromArena(arena, prb_arenaFreeSize(arena) - 100 * prb_KILOBYTE);
+    prb_GrowingStr flatoutBuilder = prb_beginStr(&flatoutArena);
+    prb_StrScanner scanner = prb_createStrScanner(outstr);
+    while (prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR("#include \"")}, prb_StrScannerSide_AfterMatch)) {
+        prb_addStrSegment(&flatoutBuilder, "%.*s", prb_LIT(scanner.betweenLastMatches));
+        prb_assert(prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR("\"")}, prb_StrScannerSide_AfterMatch));
+        prb_Str includedFile = scanner.betweenLastMatches;
+        prb_Str pathFromRoot = {};
+        if (prb_strStartsWith(includedFile, prb_STR("clang"))) {
+            pathFromRoot = prb_pathJoin(arena, prb_STR("clang/include"), includedFile);
+        } else {
+            prb_assert(prb_strStartsWith(includedFile, prb_STR("llvm")));
+            pathFromRoot = prb_pathJoin(arena, prb_STR("llvm/include"), includedFile);
+        }
+        prb_Str flatpath = replaceSeps(arena, pathFromRoot);
+        prb_addStrSegment(&flatoutBuilder, "#include \"%.*s\"", prb_LIT(flatpath));
+    }
+    prb_addStrSegment(&flatoutBuilder, "%.*s", prb_LIT(scanner.afterMatch));
+
+    prb_Str flatout = prb_endStr(&flatoutBuilder);
+
+    prb_ReadEntireFileResult existing = prb_readEntireFile(&flatoutArena, outpath);
+    if (!existing.success || !prb_streq(prb_strFromBytes(existing.content), flatout)) {
+        prb_assert(prb_writeEntireFile(arena, outpath, flatout.ptr, flatout.len));
+    }
+    prb_assert(prb_removePathIfExists(arena, tempOutpath));
+    prb_endTempMemory(temp);
+}
+
+// NOTE(khvorov) Starts with a space
+function prb_Str
+getTableGenIncludeFlags(prb_Arena* arena, prb_Str includes) {
+    prb_GrowingStr builder = prb_beginStr(arena);
+    prb_StrScanner scanner = prb_createStrScanner(includes);
+    while (prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR(" "), .alwaysMatchEnd = true}, prb_StrScannerSide_AfterMatch)) {
+        prb_addStrSegment(&builder, " -I%.*s/%.*s", prb_LIT(globalLLVMRootDir), prb_LIT(scanner.betweenLastMatches));
+    }
+    prb_Str result = prb_endStr(&builder);
+    return result;
+}
+
+// NOTE(khvorov) Writes the backends file, one line of options per backend, see -backends in llvm_lib_TableGen_Main.cpp
+function prb_Str
+getTableGenCmd(prb_Arena* arena, RunTableGenSpec* spec) {
+    prb_Str includePaths = getTableGenIncludeFlags(arena, spec->includes);
+    prb_Str inpath = prb_pathJoin(arena, globalLLVMRootDir, spec->in);
+
+    prb_Str* tempOutpaths = 0;
+    prb_Str* depfilePaths = 0;
+    for (i32 outIndex = 0; outIndex < arrlen(spec->outs); outIndex++) {
+        prb_Str tempOutpath = getTableGenTempOut(arena, spec->tempDir, spec->outs[outIndex]);
+        arrput(tempOutpaths, tempOutpath);
+        arrput(depfilePaths, getDepfilePath(arena, tempOutpath));
+    }
+    prb_Str backends = {};
+    {
+        prb_GrowingStr backendsBuilder = prb_beginStr(arena);
+        for (i32 outIndex = 0; outIndex < arrlen(spec->outs); outIndex++) {
+            prb_addStrSegment(&backendsBuilder, "%.*s -o %.*s -d %.*s\n", prb_LIT(spec->args[outIndex]), prb_LIT(tempOutpaths[outIndex]), prb_LIT(depfilePaths[outIndex]));
+        }
+        backends = prb_endStr(&backendsBuilder);
+    }
+    prb_assert(prb_writeEntireFile(arena, spec->backendsFile, backends.ptr, backends.len));
+
+    prb_Str cmd = prb_fmt(
+        arena,
+        "%.*s -backends=%.*s %.*s %.*s",
+        prb_LIT(spec->tableGenExe),
+        prb_LIT(spec->backendsFile),
+        prb_LIT(includePaths),
+        prb_LIT(inpath)
+    );
+
+    arrfree(tempOutpaths);
+    arrfree(depfilePaths);
+    return cmd;
+}
+
+// NOTE(khvorov) Flatten includes in the outputs and record what they were generated from.
+// Tablegen doesn't list the .td file itself as a dependency.
+function void
+finishTableGen(prb_Arena* arena, RunTableGenSpec* spec) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    prb_Str        inpath = prb_pathJoin(arena, globalLLVMRootDir, spec->in);
+    for (i32 outIndex = 0; outIndex < arrlen(spec->outs); outIndex++) {
+        prb_Str outpath = prb_pathJoin(arena, globalClangSrcDir, spec->outs[outIndex]);
+        prb_Str tempOutpath = getTableGenTempOut(arena, spec->tempDir, spec->outs[outIndex]);
+        flattenTableGenIncludes(arena, tempOutpath, outpath);
+        forgetFileStat(arena, outpath);
+        ingestDepfile(arena, outpath, getDepfilePath(arena, tempOutpath));
+        addRecordedDep(arena, outpath, inpath);
+        BuildLogEntry entry = {
+            .cmdHash = hashStr(getTableGenCmdKey(arena, spec, spec->args[outIndex])),
+            .inputHash = getTableGenInputHash(arena, spec->tableGenExe, outpath).hash,
+        };
+        shput(globalBuildLog, (char*)prb_strGetNullTerminated(arena, outpath), entry);
+    }
+    prb_endTempMemory(temp);
+}
+
+// NOTE(khvorov) Steps refer to these by index
+global_variable RunTableGenSpec* globalTableGenSpecs;
+
+// NOTE(khvorov) Static libs are GNU thin archives written right here instead of by ar.
+// Members are referenced by their path relative to the archive so only the headers and the symbol index get written.
+// The exported symbols of every member are kept in <lib outdir>/.archive along with the stat they were read at
+// (<lastMod> <size> <inode> <relpath> <symbol>... per line) so only the members that changed are read again.
+typedef struct ArchiveMember {
+    prb_FileStat stat;
+    // NOTE(khvorov) Null-terminated names back to back
+    char*        symbols;
+    i32          symbolCount;
+} ArchiveMember;
+
+typedef struct ArchiveMemberKV {
+    char*         key;
+    ArchiveMember value;
+} ArchiveMemberKV;
+
+typedef struct ReadArchiveSymbolsSpec {
+    prb_Str*       paths;
+    i32*           memberIndices;
+    ArchiveMember* members;
+    bool           failed;
+} ReadArchiveSymbolsSpec;
+
+// NOTE(khvorov) Same set GNU ar puts in the index: everything global, weak or unique that the object defines
+function bool
+readElfSymbols(prb_Bytes content, ArchiveMember* member) {
+    Elf64_Ehdr* header = (Elf64_Ehdr*)content.data;
+    u64         contentLen = (u64)content.len;
+    bool        ok = contentLen >= sizeof(Elf64_Ehdr) && prb_memeq(header->e_ident, ELFMAG, SELFMAG)
+        && header->e_ident[EI_CLASS] == ELFCLASS64 && header->e_ident[EI_DATA] == ELFDATA2LSB && header->e_shentsize == sizeof(Elf64_Shdr)
+        && header->e_shoff <= contentLen && contentLen - header->e_shoff >= sizeof(Elf64_Shdr);
+
+    Elf64_Shdr* sections = ok ? (Elf64_Shdr*)(content.data + header->e_shoff) : 0;
+    u64         sectionCount = ok ? header->e_shnum : 0;
+    if (ok && sectionCount == 0) {
+        // NOTE(khvorov) Too many sections for the header, the real count is in the first one
+        sectionCount = sections[0].sh_size;
+    }
+    ok = ok && sectionCount <= (contentLen - header->e_shoff) / sizeof(Elf64_Shdr);
+
+    for (u64 sectionIndex = 0; sectionIndex < sectionCount && ok; sectionIndex++) {
+        Elf64_Shdr* symtab = sections + sectionIndex;
+        if (symtab->sh_type == SHT_SYMTAB) {
+            Elf64_Shdr* strtab = sections + symtab->sh_link;
+            ok = symtab->sh_link < sectionCount && symtab->sh_offset <= contentLen && symtab->sh_size <= contentLen - symtab->sh_offset
+                && strtab->sh_offset <= contentLen && strtab->sh_size <= contentLen - strtab->sh_offset && strtab->sh_size > 0
+                && content.data[strtab->sh_offset + strtab->sh_size - 1] == '\0';
+            Elf64_Sym*  symbols = ok ? (Elf64_Sym*)(content.data + symtab->sh_offset) : 0;
+            u64         symbolCount = ok ? symtab->sh_size / sizeof(Elf64_Sym) : 0;
+            const char* names = ok ? (const char*)content.data + strtab->sh_offset : 0;
+            // NOTE(khvorov) Locals all come first, sh_info is the first non-local
+            for (u64 symbolIndex = symtab->sh_info; symbolIndex < symbolCount && ok; symbolIndex++) {
+                Elf64_Sym* symbol = symbols + symbolIndex;
+                u8         bind = ELF64_ST_BIND(symbol->st_info);
+                if ((bind == STB_GLOBAL || bind == STB_WEAK || bind == STB_GNU_UNIQUE) && symbol->st_shndx != SHN_UNDEF) {
+                    ok = symbol->st_name < strtab->sh_size;
+                    if (ok && names[symbol->st_name] != '\0') {
+                        prb_Str name = prb_STR(names + symbol->st_name);
+                        prb_memcpy(arraddnptr(member->symbols, name.len + 1), name.ptr, name.len + 1);
+                        member->symbolCount += 1;
+                    }
+                }
+            }
+        }
+    }
+
+    return ok;
+}
+
+function void
+readArchiveSymbols(prb_Arena* arena, void* data) {
+    ReadArchiveSymbolsSpec* spec = (ReadArchiveSymbolsSpec*)data;
+    for (i32 pathIndex = 0; pathIndex < arrlen(spec->paths); pathIndex++) {
+        prb_TempMemory           temp = prb_beginTempMemory(arena);
+        ArchiveMember*           member = spec->members + spec->memberIndices[pathIndex];
+        prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, spec->paths[pathIndex]);
+        if (!readRes.success || !readElfSymbols(readRes.content, member)) {
+            prb_writeToStdout(prb_fmt(arena, "archive: can't read symbols from %.*s\n", prb_LIT(spec->paths[pathIndex])));
+            spec->failed = true;
+        }
+        prb_endTempMemory(temp);
+    }
+}
+
+// NOTE(khvorov) Deterministic like ar D, the name table gets blank fields same as in GNU ar's output
+function void
+addArchiveHeader(u8** bytes, prb_Str name, const char* owner, const char* mode, u64 size) {
+    char header[61];
+    i32  headerLen = snprintf(header, sizeof(header), "%-16.*s%-12s%-6s%-6s%-8s%-10llu`\n", prb_LIT(name), owner, owner, owner, mode, (unsigned long long)size);
+    prb_assert(headerLen == 60);
+    prb_memcpy(arraddnptr(*bytes, 60), header, 60);
+}
+
+function void
+addArchiveU32BigEndian(u8** bytes, u64 value) {
+    prb_assert(value <= UINT32_MAX);
+    u8* dest = arraddnptr(*bytes, 4);
+    dest[0] = (u8)(value >> 24);
+    dest[1] = (u8)(value >> 16);
+    dest[2] = (u8)(value >> 8);
+    dest[3] = (u8)value;
+}
+
+// NOTE(khvorov) objs are space-separated and all under the dir of the archive.
+// Layout is the magic, the symbol index, the name table and then one header per member with nothing after it.
+function bool
+writeThinArchive(prb_Arena* arena, prb_Str outfile, prb_Str objs) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    prb_assert(prb_strEndsWith(outfile, prb_STR(".lib")));
+    prb_Str archiveDirPrefix = prb_fmt(arena, "%.*s/", prb_LIT(prb_getParentDir(arena, outfile)));
+    prb_Str symbolsPath = prb_fmt(arena, "%.*s/.archive", prb_LIT(prb_strSlice(outfile, 0, outfile.len - 4)));
+
+    ArchiveMemberKV* known = 0;
+    sh_new_arena(known);
+    prb_ReadEntireFileResult symbolsRead = prb_readEntireFile(arena, symbolsPath);
+    if (symbolsRead.success) {
+        prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(symbolsRead.content));
+        while (prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak}, prb_StrScannerSide_AfterMatch)) {
+            const char** parts = prb_getArgArrayFromStr(arena, lineScanner.betweenLastMatches);
+            if (arrlen(parts) >= 4) {
+                prb_ParseUintResult lastMod = prb_parseUint(prb_STR(parts[0]), 10);
+                prb_ParseUintResult size = prb_parseUint(prb_STR(parts[1]), 10);
+                prb_ParseUintResult inode = prb_parseUint(prb_STR(parts[2]), 10);
+                if (lastMod.success && size.success && inode.success) {
+                    ArchiveMember member = {.stat = {.valid = true, .lastMod = lastMod.number, .size = size.number, .inode = inode.number}};
+                    for (i32 partIndex = 4; partIndex < arrlen(parts); partIndex++) {
+                        prb_Str name = prb_STR(parts[partIndex]);
+                        prb_memcpy(arraddnptr(member.symbols, name.len + 1), name.ptr, name.len + 1);
+                        member.symbolCount += 1;
+                    }
+                    shput(known, parts[3], member);
+                }
+            }
+            arrfree(parts);
+        }
+    }
+
+    // NOTE(khvorov) Only members that changed are read. This already runs in a slot of its own so no more threads for it.
+    ReadArchiveSymbolsSpec spec = {};
+
+    const char**   memberPaths = prb_getArgArrayFromStr(arena, objs);
+    prb_Str*       memberNames = prb_arenaAllocArray(arena, prb_Str, arrlen(memberPaths));
+    ArchiveMember* members = prb_arenaAllocArray(arena, ArchiveMember, arrlen(memberPaths));
+    bool           ok = true;
+    for (i32 memberIndex = 0; memberIndex < arrlen(memberPaths) && ok; memberIndex++) {
+        prb_Str path = prb_STR(memberPaths[memberIndex]);
+        prb_assert(prb_strStartsWith(path, archiveDirPrefix));
+        memberNames[memberIndex] = prb_strSlice(path, archiveDirPrefix.len, path.len);
+        prb_FileStat stat = prb_getFileStat(arena, path);
+        ok = stat.valid;
+        i32 knownIndex = shgeti(known, prb_strGetNullTerminated(arena, memberNames[memberIndex]));
+        if (knownIndex != -1 && fileStatsEqual(known[knownIndex].value.stat, stat)) {
+            members[memberIndex] = known[knownIndex].value;
+            known[knownIndex].value.symbols = 0;
+        } else if (ok) {
+            members[memberIndex].stat = stat;
+            arrput(spec.paths, path);
+            arrput(spec.memberIndices, memberIndex);
+        }
+    }
+
+    if (ok) {
+        spec.members = members;
+        readArchiveSymbols(arena, &spec);
+        ok = !spec.failed;
+    }
+    arrfree(spec.paths);
+    arrfree(spec.memberIndices);
+
+    if (ok) {
+        u64 symbolCount = 0;
+        u64 symbolNamesLen = 0;
+        u64 memberNamesLen = 0;
+        for (i32 memberIndex = 0; memberIndex < arrlen(memberPaths); memberIndex++) {
+            symbolCount += members[memberIndex].symbolCount;
+            symbolNamesLen += arrlen(members[memberIndex].symbols);
+            memberNamesLen += memberNames[memberIndex].len + 2;
+        }
+        // NOTE(khvorov) Like GNU ar the padding to even length counts towards the member size, \0 after the symbols and \n after the names
+        u64 symbolIndexLen = 4 + 4 * symbolCount + symbolNamesLen;
+        u64 symbolIndexPad = symbolIndexLen & 1;
+        u64 memberNamesPad = memberNamesLen & 1;
+        u64 firstMemberOffset = 8 + 60 + symbolIndexLen + symbolIndexPad + 60 + memberNamesLen + memberNamesPad;
+
+        u8* bytes = 0;
+        prb_memcpy(arraddnptr(bytes, 8), "!<thin>\n", 8);
+
+        addArchiveHeader(&bytes, prb_STR("/"), "0", "0", symbolIndexLen + symbolIndexPad);
+        addArchiveU32BigEndian(&bytes, symbolCount);
+        for (i32 memberIndex = 0; memberIndex < arrlen(memberPaths); memberIndex++) {
+            for (i32 symbolIndex = 0; symbolIndex < members[memberIndex].symbolCount; symbolIndex++) {
+                addArchiveU32BigEndian(&bytes, firstMemberOffset + (u64)memberIndex * 60);
+            }
+        }
+        for (i32 memberIndex = 0; memberIndex < arrlen(memberPaths); memberIndex++) {
+            prb_memcpy(arraddnptr(bytes, arrlen(members[memberIndex].symbols)), members[memberIndex].symbols, arrlen(members[memberIndex].symbols));
+        }
+        if (symbolIndexPad) {
+            arrput(bytes, '\0');
+        }
+
+        addArchiveHeader(&bytes, prb_STR("//"), "", "", memberNamesLen + memberNamesPad);
+        u64* memberNameOffsets = prb_arenaAllocArray(arena, u64, arrlen(memberPaths));
+        u64  memberNamesStart = arrlen(bytes);
+        for (i32 memberIndex = 0; memberIndex < arrlen(memberPaths); memberIndex++) {
+            prb_Str name = memberNames[memberIndex];
+            memberNameOffsets[memberIndex] = arrlen(bytes) - memberNamesStart;
+            prb_memcpy(arraddnptr(bytes, name.len), name.ptr, name.len);
+            prb_memcpy(arraddnptr(bytes, 2), "/\n", 2);
+        }
+        if (memberNamesPad) {
+            arrput(bytes, '\n');
+        }
+
+        prb_assert((u64)arrlen(bytes) == firstMemberOffset);
+        for (i32 memberIndex = 0; memberIndex < arrlen(memberPaths); memberIndex++) {
+            addArchiveHeader(&bytes, prb_fmt(arena, "/%llu", (unsigned long long)memberNameOffsets[memberIndex]), "0", "644", members[memberIndex].stat.size);
+        }
+
+        ok = prb_writeEntireFile(arena, outfile, bytes, arrlen(bytes));
+        arrfree(bytes);
+    }
+
+    if (ok) {
+        prb_Str symbolsStr = {};
+        {
+            prb_GrowingStr symbolsBuilder = prb_beginStr(arena);
+            for (i32 memberIndex = 0; memberIndex < arrlen(memberPaths); memberIndex++) {
+                ArchiveMember* member = members + memberIndex;
+                prb_addStrSegment(&symbolsBuilder, "%llu %llu %llu %.*s", (unsigned long long)member->stat.lastMod, (unsigned long long)member->stat.size, (unsigned long long)member->stat.inode, prb_LIT(memberNames[memberIndex]));
+                for (char* symbol = member->symbols; symbol < member->symbols + arrlen(member->symbols); symbol += prb_strlen(symbol) + 1) {
+                    prb_addStrSegment(&symbolsBuilder, " %s", symbol);
+                }
+                prb_addStrSegment(&symbolsBuilder, "\n");
+            }
+            symbolsStr = prb_endStr(&symbolsBuilder);
+        }
+        ok = prb_writeEntireFile(arena, symbolsPath, symbolsStr.ptr, symbolsStr.len);
+    }
+
+    for (i32 memberIndex = 0; memberIndex < arrlen(memberPaths); memberIndex++) {
+        arrfree(members[memberIndex].symbols);
+    }
+    for (i32 knownIndex = 0; knownIndex < shlen(known); knownIndex++) {
+        arrfree(known[knownIndex].value.symbols);
+    }
+    shfree(known);
+    arrfree(memberPaths);
+    prb_endTempMemory(temp);
+    return ok;
+}
+
+typedef struct WriteThinArchiveSpec {
+    i32     stepIndex;
+    prb_Str out;
+    prb_Str objs;
+    bool    ok;
+    u64     durationMs;
+} WriteThinArchiveSpec;
+
+// NOTE(khvorov) How much it needs depends on the largest member, so it gets a reservation of its own and gives it all back after
+function void
+writeThinArchiveJob(prb_Arena* arena, void* data) {
+    prb_unused(arena);
+    WriteThinArchiveSpec* spec = (WriteThinArchiveSpec*)data;
+    prb_TimeStart         start = prb_timeStart();
+    prb_Arena             archiveArena = prb_createArenaFromVmem(prb_GIGABYTE);
+    spec->ok = writeThinArchive(&archiveArena, spec->out, spec->objs);
+    spec->durationMs = (u64)prb_getMsFrom(start);
+    prb_assert(munmap(archiveArena.base, archiveArena.size) == 0);
+}
+
+typedef enum StepKind {
+    StepKind_Compile,
+    // NOTE(khvorov) Tracked like a compile but never cached, a PCH is only valid next to the exact headers it was built from
+    StepKind_Pch,
+    StepKind_Archive,
+    StepKind_Link,
+    StepKind_TableGen,
+    StepKind_Dwp,
+} StepKind;
+
+typedef struct Step {
+    StepKind    kind;
+    prb_Str     cmd;
+    // NOTE(khvorov) Source file for compile steps, space-separated members for archive steps
+    prb_Str     in;
+    prb_Str     out;
+    // NOTE(khvorov) Multiplies the assumed duration when there is no record of this step
+    u64         costHint;
+    // NOTE(khvorov) Into globalTableGenSpecs for tablegen steps
+    i32         tableGenSpec;
+    // NOTE(khvorov) -1 unless this compiles one member of a unity TU on its own, then it's the unity TU's step.
+    // Such a step stays out of the graph until that one fails (see startUnityFallback).
+    i32         unityFallbackFor;
+    i32*        dependents;
+    i32         depsLeft;
+    bool        done;
+    prb_Process proc;
+} Step;
+
+// NOTE(khvorov) All the work goes into one graph so that a slow TU in one library doesn't hold up the rest of the machine.
+// Steps from earlier phases stay in the graph (done) so later steps can still refer to them.
+global_variable Step* globalSteps;
+
+function i32
+addStep(StepKind kind, prb_Str cmd, prb_Str in, prb_Str out, i32* deps, i32 depsCount) {
+    i32  stepIndex = arrlen(globalSteps);
+    Step step = {.kind = kind, .cmd = cmd, .in = in, .out = out, .costHint = 1, .unityFallbackFor = -1};
+    for (i32 depIndex = 0; depIndex < depsCount; depIndex++) {
+        i32 dep = deps[depIndex];
+        if (dep != -1 && !globalSteps[dep].done) {
+            arrput(globalSteps[dep].dependents, stepIndex);
+            step.depsLeft += 1;
+        }
+    }
+    arrput(globalSteps, step);
+    return stepIndex;
+}
+
+// NOTE(khvorov) Manifests first since object keys depend on what's in them, then every object that isn't here already.
+// Everything for the whole graph is fetched before anything compiles.
+function void
+prefetchFromRemoteCache(prb_Arena* arena) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+
+    prb_Str* manifestUrlPaths = 0;
+    prb_Str* manifestPaths = 0;
+    for (i32 stepIndex = 0; stepIndex < arrlen(globalSteps); stepIndex++) {
+        Step* step = globalSteps + stepIndex;
+        if (!step->done && step->kind == StepKind_Compile && step->unityFallbackFor == -1) {
+            prb_Str manifestPath = getObjCacheManifestPath(arena, step->cmd);
+            if (!prb_isFile(arena, manifestPath)) {
+                arrput(manifestUrlPaths, getRemoteCacheUrlPath(arena, prb_STR("ac"), manifestPath));
+                arrput(manifestPaths, manifestPath);
+            }
+        }
+    }
+    downloadFromRemoteCache(arena, manifestUrlPaths, manifestPaths);
+
+    prb_Str* objUrlPaths = 0;
+    prb_Str* objPaths = 0;
+    for (i32 stepIndex = 0; stepIndex < arrlen(globalSteps); stepIndex++) {
+        Step* step = globalSteps + stepIndex;
+        if (!step->done && step->kind == StepKind_Compile && step->unityFallbackFor == -1) {
+            u32* deps = readObjCacheManifest(arena, step->cmd);
+            if (deps) {
+                prb_Str objPath = getObjCacheObjPath(arena, step->cmd, deps);
+                if (objPath.len > 0 && !prb_isFile(arena, objPath)) {
+                    arrput(objUrlPaths, getRemoteCacheUrlPath(arena, prb_STR("cas"), objPath));
+                    arrput(objPaths, objPath);
+                }
+                prb_Str dwoPath = objPath.len > 0 && globalProfile.splitDwarf ? getDwoPath(arena, objPath) : prb_STR("");
+                if (dwoPath.len > 0 && !prb_isFile(arena, dwoPath)) {
+                    arrput(objUrlPaths, getRemoteCacheUrlPath(arena, prb_STR("cas"), dwoPath));
+                    arrput(objPaths, dwoPath);
+                }
+                arrfree(deps);
+            }
+        }
+    }
+    downloadFromRemoteCache(arena, objUrlPaths, objPaths);
+
+    arrfree(manifestUrlPaths);
+    arrfree(manifestPaths);
+    arrfree(objUrlPaths);
+    arrfree(objPaths);
+    prb_endTempMemory(temp);
+}
+
+function void
+finishStep(i32 stepIndex, i32** ready) {
+    Step* step = globalSteps + stepIndex;
+    step->done = true;
+    for (i32 dependentIndex = 0; dependentIndex < arrlen(step->dependents); dependentIndex++) {
+        i32   dependent = step->dependents[dependentIndex];
+        Step* dependentStep = globalSteps + dependent;
+        dependentStep->depsLeft -= 1;
+        if (dependentStep->depsLeft == 0 && ready) {
+            arrput(*ready, dependent);
+        }
+    }
+}
+
+// NOTE(khvorov) Joined from MAKEFLAGS when we run under make -j, otherwise our own with a token per core.
+// Either way children (make, ninja, another build.exe) find it through MAKEFLAGS and share the same cores.
+global_variable prb_Jobserver globalJobserver;
+
+// NOTE(khvorov) The first running process goes on the token we were started with, each one after that needs its own
+function bool
+haveJobSlot(i32 runningCount) {
+    bool result = !globalJobserver.valid || runningCount < 1 + arrlen(globalJobserver.tokens) || prb_acquireJobserverToken(&globalJobserver);
+    return result;
+}
+
+function void
+releaseSpareJobTokens(i32 runningCount) {
+    while (globalJobserver.valid && arrlen(globalJobserver.tokens) > prb_max(0, runningCount - 1)) {
+        prb_releaseJobserverToken(&globalJobserver);
+    }
+}
+
+// NOTE(khvorov) Steps don't write to the terminal themselves. Each one writes into its own file (on tmpfs when there is one)
+// and whatever it said is printed in one go once it exits: failures right away, anything else once the graph is done.
+// A terminal gets one progress line redrawn in place, anything else gets a line per finished step.
+typedef struct StepOutput {
+    prb_Str  dir;
+    bool     tty;
+    i32      total;
+    i32      done;
+    // NOTE(khvorov) Expected duration of every step that hasn't started yet, for the ETA
+    u64      pendingMs;
+    prb_Str* deferred;
+} StepOutput;
+
+function prb_Str
+getStepOutputPath(prb_Arena* arena, StepOutput* output, i32 stepIndex) {
+    prb_Str result = prb_fmt(arena, "%.*s/%d", prb_LIT(output->dir), stepIndex);
+    return result;
+}
+
+function void
+writeProgress(prb_Arena* arena, StepOutput* output, u64* durations, i32* running, prb_Process* runningProcs, i32 slots) {
+    if (output->tty) {
+        u64 remainingMs = output->pendingMs;
+        i32 oldestRunning = -1;
+        for (i32 runningIndex = 0; runningIndex < arrlen(running); runningIndex++) {
+            u64 elapsedMs = (u64)prb_getMsFrom(runningProcs[runningIndex].launchTime);
+            remainingMs += durations[running[runningIndex]] > elapsedMs ? durations[running[runningIndex]] - elapsedMs : 0;
+            if (oldestRunning == -1 || elapsedMs > (u64)prb_getMsFrom(runningProcs[oldestRunning].launchTime)) {
+                oldestRunning = runningIndex;
+            }
+        }
+        u64     etaSec = remainingMs / (u64)slots / 1000;
+        prb_Str oldestName = oldestRunning == -1 ? prb_STR("") : prb_getLastEntryInPath(globalSteps[running[oldestRunning]].out);
+        prb_writeToStdout(prb_fmt(
+            arena,
+            "\r\x1b[K[%d/%d] %d running, eta %llum%02llus %.*s",
+            output->done,
+            output->total,
+            (i32)arrlen(running),
+            (unsigned long long)(etaSec / 60),
+            (unsigned long long)(etaSec % 60),
+            prb_LIT(oldestName)
+        ));
+    }
+}
+
+// NOTE(khvorov) Empty when the step said nothing
+function prb_Str
+takeStepOutput(prb_Arena* arena, StepOutput* output, i32 stepIndex) {
+    prb_Str                  path = getStepOutputPath(arena, output, stepIndex);
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, path);
+    prb_Str                  result = readRes.success ? prb_strFromBytes(readRes.content) : prb_STR("");
+    prb_assert(prb_removePathIfExists(arena, path));
+    return result;
+}
+
+function void
+reportStepDone(prb_Arena* arena, StepOutput* output, i32 stepIndex, bool success) {
+    Step*   step = globalSteps + stepIndex;
+    prb_Str said = takeStepOutput(arena, output, stepIndex);
+    prb_Str clearLine = output->tty ? prb_STR("\r\x1b[K") : prb_STR("");
+    output->done += 1;
+    if (!success) {
+        prb_writeToStdout(prb_fmt(arena, "%.*sFAILED: %.*s\n%.*s", prb_LIT(clearLine), prb_LIT(step->cmd), prb_LIT(said)));
+    } else {
+        if (said.len > 0) {
+            arrput(output->deferred, prb_fmt(arena, "%.*s\n%.*s", prb_LIT(step->cmd), prb_LIT(said)));
+        }
+        if (!output->tty) {
+            prb_writeToStdout(prb_fmt(arena, "[%d/%d] %.*s\n", output->done, output->total, prb_LIT(prb_getLastEntryInPath(step->out))));
+        }
+    }
+}
+
+// NOTE(khvorov) Every space-separated word in str that is exactly word
+function prb_Str
+replaceWord(prb_Arena* arena, prb_Str str, prb_Str word, prb_Str with) {
+    prb_GrowingStr builder = prb_beginStr(arena);
+    for (i32 wordStart = 0; wordStart <= str.len;) {
+        i32 wordEnd = wordStart;
+        for (; wordEnd < str.len && str.ptr[wordEnd] != ' '; wordEnd++) {}
+        prb_Str part = prb_strSlice(str, wordStart, wordEnd);
+        if (prb_streq(part, word)) {
+            part = with;
+        }
+        prb_addStrSegment(&builder, "%s%.*s", wordStart == 0 ? "" : " ", prb_LIT(part));
+        wordStart = wordEnd + 1;
+    }
+    prb_Str result = prb_endStr(&builder);
+    return result;
+}
+
+// NOTE(khvorov) A unity TU that failed hands its dependents over to its members' own compiles (see compileObjs),
+// which then have to go in their place everywhere the unity object (and .dwo) was listed.
+// The marker next to the unity object splits the group for good the next time the groups are read (see getUnitySources).
+// False when the step wasn't a unity TU.
+function bool
+startUnityFallback(prb_Arena* arena, i32 unityStepIndex, i32** ready, StepOutput* output, u64* durations) {
+    Step*    unityStep = globalSteps + unityStepIndex;
+    i32*     members = 0;
+    prb_Str* memberObjs = 0;
+    prb_Str* memberDwos = 0;
+    for (i32 stepIndex = 0; stepIndex < arrlen(globalSteps); stepIndex++) {
+        if (globalSteps[stepIndex].unityFallbackFor == unityStepIndex) {
+            arrput(members, stepIndex);
+            arrput(memberObjs, globalSteps[stepIndex].out);
+            arrput(memberDwos, getDwoPath(arena, globalSteps[stepIndex].out));
+        }
+    }
+
+    bool result = arrlen(members) > 0;
+    if (result) {
+        prb_Str objs = prb_stringsJoin(arena, memberObjs, arrlen(memberObjs), prb_STR(" "));
+        prb_Str dwos = prb_stringsJoin(arena, memberDwos, arrlen(memberDwos), prb_STR(" "));
+        prb_Str unityDwo = getDwoPath(arena, unityStep->out);
+        for (i32 dependentIndex = 0; dependentIndex < arrlen(unityStep->dependents); dependentIndex++) {
+            Step* dependent = globalSteps + unityStep->dependents[dependentIndex];
+            dependent->cmd = replaceWord(arena, replaceWord(arena, dependent->cmd, unityStep->out, objs), unityDwo, dwos);
+            dependent->in = replaceWord(arena, replaceWord(arena, dependent->in, unityStep->out, objs), unityDwo, dwos);
+            dependent->depsLeft += arrlen(members) - 1;
+        }
+        for (i32 memberIndex = 0; memberIndex < arrlen(members); memberIndex++) {
+            i32   stepIndex = members[memberIndex];
+            Step* member = globalSteps + stepIndex;
+            member->unityFallbackFor = -1;
+            for (i32 dependentIndex = 0; dependentIndex < arrlen(unityStep->dependents); dependentIndex++) {
+                arrput(member->dependents, unityStep->dependents[dependentIndex]);
+            }
+            output->total += 1;
+            output->pendingMs += durations[stepIndex];
+            arrput(*ready, stepIndex);
+        }
+        arrfree(unityStep->dependents);
+
+        prb_assert(prb_writeEntireFile(arena, prb_replaceExt(arena, unityStep->out, prb_STR("failed")), "", 0));
+        prb_writeToStdout(prb_fmt(
+            arena,
+            "unity: %.*s failed, its %d members compile on their own from now on\n",
+            prb_LIT(prb_getLastEntryInPath(unityStep->in)),
+            (i32)arrlen(members)
+        ));
+    }
+
+    arrfree(members);
+    arrfree(memberObjs);
+    arrfree(memberDwos);
+    return result;
+}
+
+// NOTE(khvorov) False when a step failed, whatever was already running is waited for first
+function bool
+runSteps(prb_Arena* arena) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+
+    prb_CoreCountResult slots = prb_getCoreCount(arena);
+    prb_assert(slots.success);
+
+    // NOTE(khvorov) Start whatever has the longest chain of recorded work hanging off it first.
+    // Deps always come before their dependents in the step array so one backwards pass is enough.
+    // Steps we have no record of are assumed to be as long as the longest one we do have (times their cost hint).
+    u64 defaultDurationMs = 1;
+    for (i32 entryIndex = 0; entryIndex < shlen(globalBuildLog); entryIndex++) {
+        defaultDurationMs = prb_max(defaultDurationMs, globalBuildLog[entryIndex].value.durationMs);
+    }
+    u64* priorities = prb_arenaAllocArray(arena, u64, arrlen(globalSteps));
+    u64* durations = prb_arenaAllocArray(arena, u64, arrlen(globalSteps));
+    for (i32 stepIndex = arrlen(globalSteps) - 1; stepIndex >= 0; stepIndex--) {
+        Step* step = globalSteps + stepIndex;
+        if (!step->done) {
+            u64 durationMs = defaultDurationMs * step->costHint;
+            i32 entryIndex = shgeti(globalBuildLog, (char*)prb_strGetNullTerminated(arena, step->out));
+            if (entryIndex != -1) {
+                durationMs = globalBuildLog[entryIndex].value.durationMs;
+            }
+            durations[stepIndex] = durationMs;
+            u64 longestDependent = 0;
+            for (i32 dependentIndex = 0; dependentIndex < arrlen(step->dependents); dependentIndex++) {
+                longestDependent = prb_max(longestDependent, priorities[step->dependents[dependentIndex]]);
+            }
+            priorities[stepIndex] = durationMs + longestDependent;
+        }
+    }
+
+    // NOTE(khvorov) Whatever is cached doesn't have to be compiled
+    if (globalObjCacheDir.len > 0) {
+        if (globalRemoteCache.host.len > 0) {
+            prefetchFromRemoteCache(arena);
+        }
+        for (i32 stepIndex = 0; stepIndex < arrlen(globalSteps); stepIndex++) {
+            Step* step = globalSteps + stepIndex;
+            if (!step->done && step->kind == StepKind_Compile && step->unityFallbackFor == -1 && restoreFromObjCache(arena, step->cmd, step->out)) {
+                prb_writeToStdout(prb_fmt(arena, "cached %.*s\n", prb_LIT(prb_getLastEntryInPath(step->out))));
+                BuildLogEntry entry = {.cmdHash = hashStr(step->cmd), .inputHash = getDepsHash(arena, step->out).hash};
+                char*         key = (char*)prb_strGetNullTerminated(arena, step->out);
+                i32           entryIndex = shgeti(globalBuildLog, key);
+                if (entryIndex != -1) {
+                    entry.durationMs = globalBuildLog[entryIndex].value.durationMs;
+                    entry.maxRssBytes = globalBuildLog[entryIndex].value.maxRssBytes;
+                }
+                shput(globalBuildLog, key, entry);
+                finishStep(stepIndex, 0);
+            }
+        }
+    }
+
+    // NOTE(khvorov) Uploads go on in the background while the rest of the graph compiles, at most one per step
+    bool        uploading = globalRemoteCache.host.len > 0;
+    UploadQueue uploads = {};
+    if (uploading) {
+        startUploads(arena, &uploads, prb_arenaAllocArray(arena, RemoteTransferSpec, arrlen(globalSteps)));
+    }
+
+    // NOTE(khvorov) Archives are jobs that take a slot like a process would and get reaped along with them.
+    // Their entry in runningProcs is never launched, it's there for the progress line and to keep the two arrays in sync.
+    prb_Job*              archiveJobs = prb_arenaAllocArray(arena, prb_Job, arrlen(globalSteps));
+    WriteThinArchiveSpec* archiveSpecs = prb_arenaAllocArray(arena, WriteThinArchiveSpec, arrlen(globalSteps));
+    i32                   archiveCount = 0;
+
+    StepOutput output = {.tty = isatty(STDOUT_FILENO)};
+    output.dir = prb_isDir(arena, prb_STR("/dev/shm")) ? prb_fmt(arena, "/dev/shm/clang_direct_call-%d", getpid()) : prb_pathJoin(arena, globalBuildDir, prb_STR(".output"));
+    prb_assert(prb_clearDir(arena, output.dir));
+
+    i32* ready = 0;
+    for (i32 stepIndex = 0; stepIndex < arrlen(globalSteps); stepIndex++) {
+        Step* step = globalSteps + stepIndex;
+        if (!step->done && step->unityFallbackFor == -1) {
+            output.total += 1;
+            output.pendingMs += durations[stepIndex];
+            if (step->depsLeft == 0) {
+                arrput(ready, stepIndex);
+            }
+        }
+    }
+
+    // NOTE(khvorov) Refill a slot the moment any process exits, dependents become ready as soon as their own inputs are done.
+    // running and runningProcs are kept in sync.
+    i32*         running = 0;
+    prb_Process* runningProcs = 0;
+    bool         anyFailed = false;
+    while ((!anyFailed && arrlen(ready) > 0) || arrlen(running) > 0) {
+        while (!anyFailed && arrlen(ready) > 0 && arrlen(running) < slots.cores && haveJobSlot(arrlen(running))) {
+            i32 readyIndexToRun = 0;
+            for (i32 readyIndex = 1; readyIndex < arrlen(ready); readyIndex++) {
+                if (priorities[ready[readyIndex]] > priorities[ready[readyIndexToRun]]) {
+                    readyIndexToRun = readyIndex;
+                }
+            }
+            i32 stepIndex = ready[readyIndexToRun];
+            arrdelswap(ready, readyIndexToRun);
+            Step* step = globalSteps + stepIndex;
+            output.pendingMs -= durations[stepIndex];
+            if (step->kind == StepKind_Archive && !globalProfile.thinLto) {
+                WriteThinArchiveSpec* spec = archiveSpecs + archiveCount;
+                *spec = (WriteThinArchiveSpec) {.stepIndex = stepIndex, .out = step->out, .objs = step->in};
+                archiveJobs[archiveCount] = prb_createJob(writeThinArchiveJob, spec, arena, 0);
+                if (prb_launchJobs(archiveJobs + archiveCount, 1, prb_Background_Yes)) {
+                    archiveCount += 1;
+                    arrput(running, stepIndex);
+                    arrput(runningProcs, ((prb_Process) {.launchTime = prb_timeStart()}));
+                } else {
+                    reportStepDone(arena, &output, stepIndex, false);
+                    anyFailed = true;
+                }
+                continue;
+            }
+            prb_Str     outputPath = getStepOutputPath(arena, &output, stepIndex);
+            prb_Process proc = prb_createProcess(step->cmd, (prb_ProcessSpec) {.redirectStdout = true, .stdoutFilepath = outputPath, .redirectStderr = true, .stderrFilepath = outputPath});
+            if (prb_launchProcesses(arena, &proc, 1, prb_Background_Yes)) {
+                arrput(running, stepIndex);
+                arrput(runningProcs, proc);
+            } else {
+                reportStepDone(arena, &output, stepIndex, false);
+                anyFailed = true;
+            }
+        }
+        releaseSpareJobTokens(arrlen(running));
+        writeProgress(arena, &output, durations, running, runningProcs, slots.cores);
+
+        if (arrlen(running) > 0) {
+            // NOTE(khvorov) Something else might give a token back before any of ours finish
+            bool                        wantToken = !anyFailed && arrlen(ready) > 0 && arrlen(running) < slots.cores;
+            prb_WaitForAnyProcessResult waitRes = prb_waitForAnyProcessOrJob(wantToken ? &globalJobserver : 0, runningProcs, arrlen(runningProcs), archiveJobs, archiveCount);
+            prb_assert(waitRes.success);
+            if (waitRes.jobIndex != -1) {
+                WriteThinArchiveSpec* spec = archiveSpecs + waitRes.jobIndex;
+                i32                   runningIndex = 0;
+                for (; running[runningIndex] != spec->stepIndex; runningIndex++) {}
+                arrdelswap(running, runningIndex);
+                arrdelswap(runningProcs, runningIndex);
+                releaseSpareJobTokens(arrlen(running));
+                reportStepDone(arena, &output, spec->stepIndex, spec->ok);
+                if (spec->ok) {
+                    BuildLogEntry entry = {.cmdHash = hashStr(globalSteps[spec->stepIndex].cmd), .durationMs = spec->durationMs};
+                    shput(globalBuildLog, (char*)prb_strGetNullTerminated(arena, spec->out), entry);
+                    finishStep(spec->stepIndex, &ready);
+                } else {
+                    anyFailed = true;
+                }
+                continue;
+            }
+            if (waitRes.index == -1) {
+                continue;
+            }
+            i32   stepIndex = running[waitRes.index];
+            Step* step = globalSteps + stepIndex;
+            step->proc = runningProcs[waitRes.index];
+            arrdelswap(running, waitRes.index);
+            arrdelswap(runningProcs, waitRes.index);
+            releaseSpareJobTokens(arrlen(running));
+            reportStepDone(arena, &output, stepIndex, step->proc.status == prb_ProcessStatus_CompletedSuccess);
+            if (step->proc.status == prb_ProcessStatus_CompletedSuccess) {
+                BuildLogEntry entry = {
+                    .cmdHash = hashStr(step->cmd),
+                    .durationMs = (u64)step->proc.stats.wallMs,
+                    .maxRssBytes = step->proc.stats.maxRssBytes,
+                };
+                if (step->kind == StepKind_Pch) {
+                    ingestDepfile(arena, step->out, getDepfilePath(arena, step->out));
+                    entry.inputHash = getDepsHash(arena, step->out).hash;
+                } else if (step->kind == StepKind_Compile) {
+                    // NOTE(khvorov) With -include-pch the depfile has pch.h and the headers the PCH was built from but not the .pch,
+                    // whose bytes change with mtimes and the checkout's location, so the cache never sees them
+                    ingestDepfile(arena, step->out, getDepfilePath(arena, step->out));
+                    if (globalPgoProfdataPath.len > 0) {
+                        addRecordedDep(arena, step->out, globalPgoProfdataPath);
+                    }
+                    entry.inputHash = getDepsHash(arena, step->out).hash;
+                    ObjCacheEntry cacheEntry = storeInObjCache(arena, step->cmd, step->out);
+                    if (uploading && cacheEntry.objPath.len > 0) {
+                        // NOTE(khvorov) Object (and its .dwo) before manifest so that a manifest on the server never points at nothing
+                        RemoteTransferSpec* spec = uploads.specs + uploads.pushed;
+                        spec->kind = RemoteTransferKind_Upload;
+                        spec->urlPaths = prb_arenaAllocArray(arena, prb_Str, 3);
+                        spec->filePaths = prb_arenaAllocArray(arena, prb_Str, 3);
+                        if (globalProfile.splitDwarf) {
+                            prb_Str dwoPath = getDwoPath(arena, cacheEntry.objPath);
+                            spec->urlPaths[spec->count] = getRemoteCacheUrlPath(arena, prb_STR("cas"), dwoPath);
+                            spec->filePaths[spec->count] = dwoPath;
+                            spec->count += 1;
+                        }
+                        spec->urlPaths[spec->count] = getRemoteCacheUrlPath(arena, prb_STR("cas"), cacheEntry.objPath);
+                        spec->filePaths[spec->count] = cacheEntry.objPath;
+                        spec->count += 1;
+                        spec->urlPaths[spec->count] = getRemoteCacheUrlPath(arena, prb_STR("ac"), cacheEntry.manifestPath);
+                        spec->filePaths[spec->count] = cacheEntry.manifestPath;
+                        spec->count += 1;
+                        pushUpload(&uploads);
+                    }
+                } else if (step->kind == StepKind_TableGen) {
+                    finishTableGen(arena, globalTableGenSpecs + step->tableGenSpec);
+                }
+                shput(globalBuildLog, (char*)prb_strGetNullTerminated(arena, step->out), entry);
+                finishStep(stepIndex, &ready);
+            } else if (step->kind != StepKind_Compile || !startUnityFallback(arena, stepIndex, &ready, &output, durations)) {
+                anyFailed = true;
+            }
+        }
+    }
+
+    if (output.tty && output.done > 0) {
+        prb_writeToStdout(prb_STR("\n"));
+    }
+    for (i32 deferredIndex = 0; deferredIndex < arrlen(output.deferred); deferredIndex++) {
+        prb_writeToStdout(output.deferred[deferredIndex]);
+    }
+    arrfree(output.deferred);
+    prb_assert(prb_removePathIfExists(arena, output.dir));
+
+    if (uploading) {
+        i32 uploadFailures = finishUploads(&uploads);
+        if (uploadFailures > 0) {
+            prb_writeToStdout(prb_fmt(arena, "remote cache: %d uploads failed\n", uploadFailures));
+        }
+    }
+
+    saveBuildLog(arena);
+    saveDepsLog(arena);
+    saveHashCache(arena);
+
+    arrfree(ready);
+    arrfree(running);
+    arrfree(runningProcs);
+    prb_endTempMemory(temp);
+    return !anyFailed;
+}
+
+typedef struct CompileObjsResult {
+    prb_Str objs;
+    i32*    steps;
+} CompileObjsResult;
+
+function prb_Str
+getCompileFlags(prb_Arena* arena, prb_Str srcpath) {
+    prb_Str defines = prb_STR(
+        "-DLLVM_ON_UNIX -DPACKAGE_NAME=\"LLVM\" -DPACKAGE_VERSION=\"420.69\" "
+        "-DHAVE_FCNTL_H=1 -DHAVE_UNISTD_H=1 -DLLVM_ENABLE_THREADS=1 -DHAVE_SYSEXITS_H=1 "
+        "-DHAVE_SYS_STAT_H=1 -DLLVM_WINDOWS_PREFER_FORWARD_SLASH=1 -DHAVE_SYS_MMAN_H=1 "
+        "-DHAVE_FUTIMENS=1 -DLLVM_ENABLE_CRASH_DUMPS=1 -DHAVE_GETRUSAGE=1 -DHAVE_SYS_RESOURCE_H=1 "
+        "-DHAVE_GETPAGESIZE=1 -DHAVE_MALLINFO2=1 -DHAVE_PTHREAD_H -DHAVE_ERRNO_H -DHAVE_STRERROR_R "
+        "-DBUG_REPORT_URL=\"hawtdawgadverntures.xyz\" -DCLANG_SPAWN_CC1=0 "
+        "-DCLANG_INSTALL_LIBDIR_BASENAME=\"\" -DENABLE_X86_RELAX_RELOCATIONS=1 -DDEFAULT_SYSROOT=\"\" "
+        "-DCLANG_RESOURCE_DIR=\"\" -DPPC_LINUX_DEFAULT_IEEELONGDOUBLE=0 -DCLANG_DEFAULT_OPENMP_RUNTIME=\"libomp\" "
+        "-DCLANG_DEFAULT_LINKER=\"\" -DLLVM_HOST_TRIPLE=\"x86_64-unknown-linux-gnu\" -DCLANG_DEFAULT_RTLIB=\"\" "
+        "-DCLANG_DEFAULT_UNWINDLIB=\"\" -DCLANG_DEFAULT_CXX_STDLIB=\"\" -DLLVM_DEFAULT_TARGET_TRIPLE=\"x86_64-unknown-linux-gnu\" "
+        "-DC_INCLUDE_DIRS=\"\" -DCLANG_DEFAULT_PIE_ON_LINUX=1 -DCLANG_DEFAULT_OBJCOPY=\"objcopy\" -DGCC_INSTALL_PREFIX=\"\" "
+        "-DLLVM_VERSION_STRING=\"420.69\" -DCLANG_OPENMP_NVPTX_DEFAULT_ARCH=\"sm_35\" "
+        "-DCLANG_SYSTEMZ_DEFAULT_ARCH=\"z10\" -DLLVM_VERSION_MAJOR=69 "
+        "-DLLVM_VERSION_MINOR=420 -DLLVM_VERSION_PATCH=1337 "
+        "-DBLAKE3_NO_AVX512=1 -DBLAKE3_NO_AVX2 -DBLAKE3_NO_SSE41 -DBLAKE3_NO_SSE2"
+    );
+    prb_Str flags = prb_STR("-std=c++17");
+    if (prb_strEndsWith(srcpath, prb_STR(".c"))) {
+        flags = prb_STR("");
+    }
+    // NOTE(khvorov) Debug info says . for the root so a cached object from another checkout points at this one's sources
+    prb_Str prefixMap = prb_fmt(arena, "-fdebug-prefix-map=%.*s=.", prb_LIT(globalRootDir));
+    prb_Str result = prb_fmt(arena, "%s %.*s %.*s %.*s", globalProfile.compileFlags, prb_LIT(prefixMap), prb_LIT(defines), prb_LIT(flags));
+    return result;
+}
+
+typedef struct LibPch {
+    // NOTE(khvorov) Empty when the library doesn't get one
+    prb_Str path;
+    // NOTE(khvorov) -1 when the PCH is up to date
+    i32     step;
+    // NOTE(khvorov) One per source file
+    bool*   users;
+} LibPch;
+
+typedef struct InternalNames {
+    // NOTE(khvorov) Of the names the file declares at namespace scope that would clash with the same name from another file
+    // in the same TU (see addUnityStatementName)
+    u64*     hashes;
+    // NOTE(khvorov) Other than DEBUG_TYPE, which the unity TU undefines after every member anyway
+    prb_Str* leakedMacros;
+    // NOTE(khvorov) Of the file's using-directives, they stay in effect for the members after it
+    u64      usingDirectives;
+} InternalNames;
+
+typedef struct UnityFile {
+    prb_Str path;
+    // NOTE(khvorov) -1 means compiled on its own for good
+    i32  group;
+    // NOTE(khvorov) Compiled on its own for now because it's being edited (see getUnitySources)
+    bool alone;
+    // NOTE(khvorov) Content hash as of the previous build
+    u64  hash;
+    bool candidate;
+    // NOTE(khvorov) Only while the groups are being formed
+    u64*          includes;
+    InternalNames internalNames;
+} UnityFile;
+
+function int
+u64Ascending(const void* val1, const void* val2) {
+    u64 num1 = *(const u64*)val1;
+    u64 num2 = *(const u64*)val2;
+    int result = num1 < num2 ? -1 : num1 > num2 ? 1 : 0;
+    return result;
+}
+
+function bool
+isIdentChar(char ch) {
+    bool result = (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+    return result;
+}
+
+// NOTE(khvorov) Like STATISTIC or INITIALIZE_PASS
+function bool
+isMacroName(prb_Str str) {
+    bool result = str.len > 1 && !(str.ptr[0] >= '0' && str.ptr[0] <= '9');
+    for (i32 index = 0; index < str.len && result; index++) {
+        char ch = str.ptr[index];
+        result = (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+    }
+    return result;
+}
+
+typedef enum UnityScope {
+    UnityScope_Namespace,
+    // NOTE(khvorov) Everything declared directly in one has internal linkage
+    UnityScope_AnonNamespace,
+    // NOTE(khvorov) Unscoped enum at namespace scope, its enumerators are namespace-scope names as well
+    UnityScope_Enum,
+    // NOTE(khvorov) Class, function and initializer bodies, nothing declared in them can clash with another file
+    UnityScope_Other,
+} UnityScope;
+
+typedef struct UnityToken {
+    prb_Str text;
+    i32     parenDepth;
+} UnityToken;
+
+function bool
+unityTokenIs(UnityToken* tokens, i32 index, const char* text) {
+    bool result = index >= 0 && index < arrlen(tokens) && prb_streq(tokens[index].text, prb_STR(text));
+    return result;
+}
+
+function bool
+unityTokenIsName(UnityToken* tokens, i32 index) {
+    // NOTE(khvorov) Words that can stand where a declared name would
+    const char* notNames[] = {
+        "void", "bool", "char", "int", "long", "short", "unsigned", "signed", "float", "double", "auto", "const", "constexpr", "inline",
+        "static", "extern", "operator", "static_assert", "decltype", "sizeof", "alignas", "final", "override", "noexcept", "class",
+        "struct", "union", "enum", "typename", "template", "namespace",
+    };
+    bool result = index >= 0 && index < arrlen(tokens) && isIdentChar(tokens[index].text.ptr[0]) && !(tokens[index].text.ptr[0] >= '0' && tokens[index].text.ptr[0] <= '9');
+    for (i32 notNameIndex = 0; notNameIndex < prb_arrayCount(notNames) && result; notNameIndex++) {
+        result = !prb_streq(tokens[index].text, prb_STR(notNames[notNameIndex]));
+    }
+    return result;
+}
+
+// NOTE(khvorov) Adds the name a namespace-scope statement declares if two files that both declare it can't share a TU:
+// anything static, anything in an anonymous namespace, types, aliases and STATISTIC-like counters.
+// Functions and variables with external linkage would already clash when linking.
+function void
+addUnityStatementName(UnityToken* statement, bool inAnonNamespace, u64** names) {
+    i32 count = arrlen(statement);
+    i32 first = 0;
+    for (bool skipped = true; skipped;) {
+        skipped = false;
+        if (unityTokenIs(statement, first, "template") && unityTokenIs(statement, first + 1, "<")) {
+            i32 angleDepth = 0;
+            for (first += 1; first < count && (angleDepth += unityTokenIs(statement, first, "<") - unityTokenIs(statement, first, ">")) > 0; first++) {}
+            first += 1;
+            skipped = true;
+        } else if (unityTokenIs(statement, first, "[") && unityTokenIs(statement, first + 1, "[")) {
+            for (first += 2; first < count && !(unityTokenIs(statement, first, "]") && unityTokenIs(statement, first + 1, "]")); first++) {}
+            first += 2;
+            skipped = true;
+        }
+    }
+
+    prb_Str name = {};
+    bool    matters = inAnonNamespace;
+    bool    statistic = unityTokenIs(statement, first, "STATISTIC") || unityTokenIs(statement, first, "ALWAYS_ENABLED_STATISTIC") || unityTokenIs(statement, first, "DEBUG_COUNTER");
+    if (first >= count) {
+    } else if (statistic && unityTokenIs(statement, first + 1, "(") && unityTokenIsName(statement, first + 2)) {
+        name = statement[first + 2].text;
+        matters = true;
+    } else if (isMacroName(statement[first].text) && unityTokenIs(statement, first + 1, "(")) {
+        // NOTE(khvorov) Some other macro like INITIALIZE_PASS, whatever it declares is up to the macro
+    } else if (unityTokenIs(statement, first, "using")) {
+        if (unityTokenIsName(statement, first + 1) && unityTokenIs(statement, first + 2, "=")) {
+            name = statement[first + 1].text;
+            matters = true;
+        }
+    } else if (unityTokenIs(statement, first, "typedef")) {
+        // NOTE(khvorov) The last name, or the one in (*name) for function pointers
+        matters = true;
+        bool functionPointer = false;
+        for (i32 index = first + 1; index < count && !functionPointer; index++) {
+            functionPointer = unityTokenIs(statement, index, "(") && unityTokenIs(statement, index + 1, "*") && unityTokenIsName(statement, index + 2);
+            if (functionPointer) {
+                name = statement[index + 2].text;
+            } else if (statement[index].parenDepth == 0 && unityTokenIsName(statement, index)) {
+                name = statement[index].text;
+            }
+        }
+    } else {
+        i32 stop = first;
+        for (; stop < count && !(statement[stop].parenDepth == 0 && (unityTokenIs(statement, stop, "(") || unityTokenIs(statement, stop, "=") || unityTokenIs(statement, stop, "["))); stop++) {}
+        i32 typeKeyword = -1;
+        for (i32 index = first; index < stop && typeKeyword == -1; index++) {
+            if (unityTokenIs(statement, index, "class") || unityTokenIs(statement, index, "struct") || unityTokenIs(statement, index, "union") || unityTokenIs(statement, index, "enum")) {
+                typeKeyword = index;
+            }
+        }
+        if (typeKeyword != -1) {
+            // NOTE(khvorov) Types clash wherever they are, the last name before the base list or body is the type's
+            // (enum class Name, class LLVM_LIBRARY_VISIBILITY Name final). Qualified names and specializations
+            // (struct llvm::Name, struct DenseMapInfo<Key>) define something that was declared elsewhere.
+            matters = true;
+            bool qualified = false;
+            i32  index = typeKeyword + 1;
+            for (; index < stop; index++) {
+                bool scope = unityTokenIs(statement, index, ":") && unityTokenIs(statement, index + 1, ":");
+                if (scope) {
+                    qualified = true;
+                    index += 1;
+                } else if (unityTokenIsName(statement, index)) {
+                    name = statement[index].text;
+                } else if (!unityTokenIs(statement, index, "class") && !unityTokenIs(statement, index, "struct")) {
+                    break;
+                }
+            }
+            if (qualified || unityTokenIs(statement, index, "<")) {
+                name = (prb_Str) {};
+            }
+        } else {
+            // NOTE(khvorov) Functions and variables, the name is right before the parameters or the initializer.
+            // Qualified names (Class::member) and operators don't introduce anything.
+            for (i32 index = first; index < stop && !matters; index++) {
+                matters = unityTokenIs(statement, index, "static");
+            }
+            i32 nameIndex = stop - 1;
+            if (nameIndex >= first && unityTokenIsName(statement, nameIndex) && !unityTokenIs(statement, nameIndex - 1, ":") && !unityTokenIs(statement, nameIndex - 1, "~") && !unityTokenIs(statement, nameIndex - 1, "operator")) {
+                name = statement[nameIndex].text;
+            }
+        }
+    }
+
+    if (matters && name.len > 0) {
+        arrput(*names, hashStr(name));
+    }
+}
+
+function void
+clearUnityStatement(UnityToken* statement) {
+    if (statement) {
+        arrdeln(statement, 0, arrlen(statement));
+    }
+}
+
+// NOTE(khvorov) Only tracks comments, literals, directives, braces, parens and statements, that's enough to tell declarations apart.
+// Whatever it misses is caught when the unity TU fails to compile (see startUnityFallback).
+// The macro names point into the file's contents, which are left in the arena.
+function InternalNames
+getInternalNames(prb_Arena* arena, prb_Str path) {
+    InternalNames            result = {};
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, path);
+    prb_assert(readRes.success);
+    prb_Str     str = prb_strFromBytes(readRes.content);
+    UnityScope* scopes = 0;
+    UnityToken* statement = 0;
+    prb_Str*    defines = 0;
+    prb_Str*    undefs = 0;
+    i32         parenDepth = 0;
+    bool        expectEnumerator = false;
+    bool        lineStart = true;
+    for (i32 index = 0; index < str.len;) {
+        char    ch = str.ptr[index];
+        char    next = index + 1 < str.len ? str.ptr[index + 1] : 0;
+        prb_Str token = {};
+        if (ch == '\n') {
+            lineStart = true;
+            index += 1;
+        } else if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\f' || ch == '\v') {
+            index += 1;
+        } else if (ch == '/' && next == '/') {
+            for (; index < str.len && str.ptr[index] != '\n'; index++) {}
+        } else if (ch == '/' && next == '*') {
+            prb_StrFindResult end = prb_strFind(prb_strSlice(str, index + 2, str.len), (prb_StrFindSpec) {.pattern = prb_STR("*/")});
+            index = end.found ? (i32)(end.afterMatch.ptr - str.ptr) : str.len;
+        } else if (ch == '#' && lineStart) {
+            // NOTE(khvorov) A directive runs to the end of the line, continuations included
+            prb_Str words[2] = {};
+            index += 1;
+            for (i32 wordIndex = 0; wordIndex < prb_arrayCount(words); wordIndex++) {
+                for (; index < str.len && (str.ptr[index] == ' ' || str.ptr[index] == '\t'); index++) {}
+                i32 wordStart = index;
+                for (; index < str.len && isIdentChar(str.ptr[index]); index++) {}
+                words[wordIndex] = prb_strSlice(str, wordStart, index);
+            }
+            if (prb_streq(words[0], prb_STR("define")) && words[1].len > 0) {
+                arrput(defines, words[1]);
+            } else if (prb_streq(words[0], prb_STR("undef")) && words[1].len > 0) {
+                arrput(undefs, words[1]);
+            } else if (prb_streq(words[0], prb_STR("include")) && index < str.len && str.ptr[index] == '"') {
+                // NOTE(khvorov) X-macros are undefined by the .def or .inc they are defined for
+                i32 includeStart = index + 1;
+                for (index = includeStart; index < str.len && str.ptr[index] != '"' && str.ptr[index] != '\n'; index++) {}
+                prb_Str include = prb_strSlice(str, includeStart, index);
+                if (prb_strEndsWith(include, prb_STR(".def")) || prb_strEndsWith(include, prb_STR(".inc"))) {
+                    prb_ReadEntireFileResult includeRead = prb_readEntireFile(arena, prb_pathJoin(arena, globalClangSrcDir, include));
+                    if (includeRead.success) {
+                        prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(includeRead.content));
+                        while (prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak, .alwaysMatchEnd = true}, prb_StrScannerSide_AfterMatch)) {
+                            prb_Str line = prb_strTrim(lineScanner.betweenLastMatches);
+                            if (prb_strStartsWith(line, prb_STR("#undef "))) {
+                                arrput(undefs, prb_strTrim(prb_strSlice(line, prb_STR("#undef ").len, line.len)));
+                            }
+                        }
+                    }
+                }
+            }
+            for (; index < str.len && !(str.ptr[index] == '\n' && str.ptr[index - 1] != '\\'); index++) {}
+        } else if (ch == '"' || ch == '\'') {
+            for (index += 1; index < str.len && str.ptr[index] != ch && str.ptr[index] != '\n'; index++) {
+                index += str.ptr[index] == '\\' ? 1 : 0;
+            }
+            index += 1;
+            token = prb_STR("\"");
+        } else if (isIdentChar(ch)) {
+            // NOTE(khvorov) Numbers too, with their dots and digit separators
+            bool number = ch >= '0' && ch <= '9';
+            i32  wordStart = index;
+            for (; index < str.len && (isIdentChar(str.ptr[index]) || (number && (str.ptr[index] == '.' || str.ptr[index] == '\''))); index++) {}
+            token = prb_strSlice(str, wordStart, index);
+            bool rawString = index < str.len && str.ptr[index] == '"' && prb_strEndsWith(token, prb_STR("R"))
+                && (token.len == 1 || prb_streq(token, prb_STR("LR")) || prb_streq(token, prb_STR("uR")) || prb_streq(token, prb_STR("UR")) || prb_streq(token, prb_STR("u8R")));
+            if (rawString) {
+                i32 delimStart = index + 1;
+                i32 delimEnd = delimStart;
+                for (; delimEnd < str.len && str.ptr[delimEnd] != '('; delimEnd++) {}
+                prb_Str           closing = prb_fmt(arena, ")%.*s\"", prb_LIT(prb_strSlice(str, delimStart, delimEnd)));
+                prb_StrFindResult end = prb_strFind(prb_strSlice(str, delimEnd, str.len), (prb_StrFindSpec) {.pattern = closing});
+                index = end.found ? (i32)(end.afterMatch.ptr - str.ptr) : str.len;
+                token = prb_STR("\"");
+            }
+        } else {
+            token = prb_strSlice(str, index, index + 1);
+            index += 1;
+        }
+
+        if (token.len > 0) {
+            lineStart = false;
+            UnityScope scope = arrlen(scopes) > 0 ? scopes[arrlen(scopes) - 1] : UnityScope_Namespace;
+            bool       inAnonNamespace = false;
+            for (i32 scopeIndex = 0; scopeIndex < arrlen(scopes); scopeIndex++) {
+                inAnonNamespace = inAnonNamespace || scopes[scopeIndex] == UnityScope_AnonNamespace;
+            }
+            if (scope == UnityScope_Other) {
+                if (prb_streq(token, prb_STR("{"))) {
+                    arrput(scopes, UnityScope_Other);
+                } else if (prb_streq(token, prb_STR("}"))) {
+                    (void)arrpop(scopes);
+                }
+            } else if (scope == UnityScope_Enum) {
+                if (prb_streq(token, prb_STR("{"))) {
+                    arrput(scopes, UnityScope_Other);
+                } else if (prb_streq(token, prb_STR("}"))) {
+                    (void)arrpop(scopes);
+                    parenDepth = 0;
+                } else {
+                    UnityToken enumToken[] = {{token, parenDepth}};
+                    if (expectEnumerator && isIdentChar(token.ptr[0]) && !(token.ptr[0] >= '0' && token.ptr[0] <= '9')) {
+                        arrput(result.hashes, hashStr(token));
+                    }
+                    parenDepth += unityTokenIs(enumToken, 0, "(") - unityTokenIs(enumToken, 0, ")");
+                    expectEnumerator = prb_streq(token, prb_STR(",")) && parenDepth == 0;
+                }
+            } else if (prb_streq(token, prb_STR("{")) && parenDepth == 0) {
+                UnityScope newScope = UnityScope_Other;
+                i32        namespaceIndex = unityTokenIs(statement, 0, "inline") ? 1 : 0;
+                if (unityTokenIs(statement, namespaceIndex, "namespace")) {
+                    newScope = arrlen(statement) > namespaceIndex + 1 ? UnityScope_Namespace : UnityScope_AnonNamespace;
+                } else if (unityTokenIs(statement, 0, "extern") && unityTokenIs(statement, 1, "\"")) {
+                    newScope = UnityScope_Namespace;
+                } else {
+                    addUnityStatementName(statement, inAnonNamespace, &result.hashes);
+                    // NOTE(khvorov) Not a function that takes or returns one
+                    bool enumDefinition = false;
+                    bool parens = false;
+                    for (i32 tokenIndex = 0; tokenIndex < arrlen(statement); tokenIndex++) {
+                        enumDefinition = enumDefinition || (unityTokenIs(statement, tokenIndex, "enum") && !unityTokenIs(statement, tokenIndex + 1, "class") && !unityTokenIs(statement, tokenIndex + 1, "struct"));
+                        parens = parens || unityTokenIs(statement, tokenIndex, "(");
+                    }
+                    if (enumDefinition && !parens) {
+                        newScope = UnityScope_Enum;
+                        expectEnumerator = true;
+                    }
+                }
+                clearUnityStatement(statement);
+                arrput(scopes, newScope);
+            } else if (prb_streq(token, prb_STR("{"))) {
+                // NOTE(khvorov) A lambda or a braced initializer in the middle of the statement
+                arrput(scopes, UnityScope_Other);
+            } else if (prb_streq(token, prb_STR("}"))) {
+                if (arrlen(scopes) > 0) {
+                    (void)arrpop(scopes);
+                }
+                clearUnityStatement(statement);
+                parenDepth = 0;
+            } else if (prb_streq(token, prb_STR(";")) && parenDepth == 0) {
+                if (unityTokenIs(statement, 0, "using") && unityTokenIs(statement, 1, "namespace")) {
+                    u64 directive = 0;
+                    for (i32 tokenIndex = 2; tokenIndex < arrlen(statement); tokenIndex++) {
+                        directive = directive * 31 + hashStr(statement[tokenIndex].text);
+                    }
+                    result.usingDirectives += directive;
+                }
+                addUnityStatementName(statement, inAnonNamespace, &result.hashes);
+                clearUnityStatement(statement);
+            } else {
+                parenDepth -= prb_streq(token, prb_STR(")")) && parenDepth > 0 ? 1 : 0;
+                arrput(statement, ((UnityToken) {token, parenDepth}));
+                parenDepth += prb_streq(token, prb_STR("(")) ? 1 : 0;
+                // NOTE(khvorov) STATISTIC(...), INITIALIZE_PASS(...) and the like often don't have a ; after them
+                if (prb_streq(token, prb_STR(")")) && parenDepth == 0 && isMacroName(statement[0].text) && unityTokenIs(statement, 1, "(")) {
+                    addUnityStatementName(statement, inAnonNamespace, &result.hashes);
+                    clearUnityStatement(statement);
+                }
+            }
+        }
+    }
+
+    for (i32 defineIndex = 0; defineIndex < arrlen(defines); defineIndex++) {
+        bool undefined = prb_streq(defines[defineIndex], prb_STR("DEBUG_TYPE"));
+        for (i32 undefIndex = 0; undefIndex < arrlen(undefs) && !undefined; undefIndex++) {
+            undefined = prb_streq(defines[defineIndex], undefs[undefIndex]);
+        }
+        if (!undefined) {
+            arrput(result.leakedMacros, defines[defineIndex]);
+        }
+    }
+
+    arrfree(scopes);
+    arrfree(statement);
+    arrfree(defines);
+    arrfree(undefs);
+    return result;
+}
+
+// NOTE(khvorov) Files with different using-directives don't share a TU either,
+// `using namespace llvm` in one makes clang::Type ambiguous in the next
+function bool
+internalNamesClash(InternalNames* names1, InternalNames* names2) {
+    bool result = names1->usingDirectives != names2->usingDirectives;
+    for (i32 index1 = 0; index1 < arrlen(names1->hashes) && !result; index1++) {
+        for (i32 index2 = 0; index2 < arrlen(names2->hashes) && !result; index2++) {
+            result = names1->hashes[index1] == names2->hashes[index2];
+        }
+    }
+    return result;
+}
+
+// NOTE(khvorov) Header -> what it includes
+typedef struct IncludesKV {
+    char*    key;
+    prb_Str* value;
+} IncludesKV;
+
+typedef struct IncludeSeenKV {
+    u64  key;
+    bool value;
+} IncludeSeenKV;
+
+// NOTE(khvorov) The quoted includes anywhere in a file, conditional ones too
+function prb_Str*
+getQuotedIncludes(prb_Arena* arena, prb_Str path) {
+    prb_Str*                 result = 0;
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, path);
+    prb_assert(readRes.success);
+    prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(readRes.content));
+    while (prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak, .alwaysMatchEnd = true}, prb_StrScannerSide_AfterMatch)) {
+        prb_Str line = prb_strTrim(lineScanner.betweenLastMatches);
+        if (prb_strStartsWith(line, prb_STR("#include \""))) {
+            prb_Str           rest = prb_strSlice(line, prb_STR("#include \"").len, line.len);
+            prb_StrFindResult quote = prb_strFind(rest, (prb_StrFindSpec) {.pattern = prb_STR("\"")});
+            if (quote.found) {
+                arrput(result, quote.beforeMatch);
+            }
+        }
+    }
+    return result;
+}
+
+// NOTE(khvorov) Sorted hashes of everything a file includes from clang_src, directly or through other headers there.
+// What each header includes is kept in includeCache for the next file.
+function u64*
+getIncludeClosure(prb_Arena* arena, prb_Str path, IncludesKV** includeCache) {
+    u64*           result = 0;
+    prb_Str*       stack = 0;
+    IncludeSeenKV* seen = 0;
+    arrput(stack, path);
+    while (arrlen(stack) > 0) {
+        prb_Str  current = arrpop(stack);
+        char*    key = (char*)prb_strGetNullTerminated(arena, current);
+        i32      cacheIndex = shgeti(*includeCache, key);
+        prb_Str* includes = 0;
+        if (cacheIndex == -1) {
+            includes = getQuotedIncludes(arena, current);
+            shput(*includeCache, key, includes);
+        } else {
+            includes = (*includeCache)[cacheIndex].value;
+        }
+        for (i32 includeIndex = 0; includeIndex < arrlen(includes); includeIndex++) {
+            u64 includeHash = hashStr(includes[includeIndex]);
+            if (hmgeti(seen, includeHash) == -1) {
+                hmput(seen, includeHash, true);
+                prb_Str includePath = prb_pathJoin(arena, globalClangSrcDir, includes[includeIndex]);
+                if (getFileStatCached(arena, includePath).valid) {
+                    arrput(result, includeHash);
+                    arrput(stack, includePath);
+                }
+            }
+        }
+    }
+    if (result) {
+        qsort(result, arrlen(result), sizeof(*result), u64Ascending);
+    }
+    hmfree(seen);
+    arrfree(stack);
+    return result;
+}
+
+function i32
+countSharedIncludes(u64* includes1, u64* includes2) {
+    i32 result = 0;
+    for (i32 index1 = 0, index2 = 0; index1 < arrlen(includes1) && index2 < arrlen(includes2);) {
+        if (includes1[index1] == includes2[index2]) {
+            result += 1;
+            index1 += 1;
+            index2 += 1;
+        } else if (includes1[index1] < includes2[index2]) {
+            index1 += 1;
+        } else {
+            index2 += 1;
+        }
+    }
+    return result;
+}
+
+function prb_Str
+getUnityGroupPath(prb_Arena* arena, prb_Str outdir, i32 group, const char* ext) {
+    prb_Str result = prb_pathJoin(arena, outdir, prb_fmt(arena, "unity_%d.%s", group, ext));
+    return result;
+}
+
+// NOTE(khvorov) The files a unity TU includes (see getUnitySources), in order
+function prb_Str*
+getUnityMembers(prb_Arena* arena, prb_Str unityPath) {
+    prb_Str*                 result = 0;
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, unityPath);
+    prb_assert(readRes.success);
+    prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(readRes.content));
+    while (prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak}, prb_StrScannerSide_AfterMatch)) {
+        prb_Str line = lineScanner.betweenLastMatches;
+        if (prb_strStartsWith(line, prb_STR("#include \"")) && prb_strEndsWith(line, prb_STR("\""))) {
+            arrput(result, prb_strSlice(line, prb_STR("#include \"").len, line.len - 1));
+        }
+    }
+    return result;
+}
+
+// NOTE(khvorov) Replaces a library's sources with unity TUs that #include them (outdir/unity_<group>.cpp).
+// Groups are formed once, recorded in outdir/.unity and stay the same afterwards so that the unity objects stay incremental.
+// Files that include most of the same headers go together as long as nothing they declare clashes (see getInternalNameHashes).
+// A member that is edited compiles on its own while it's being worked on, so that each edit doesn't rebuild its whole group,
+// and goes back in once the group is rebuilt for some other reason: another member was edited or something they include changed.
+// Edits are told by content, a touched file stays where it is. A group whose unity TU failed to compile is split for good.
+// Delete outdir/.unity to regroup.
+function prb_Str*
+getUnitySources(prb_Arena* arena, prb_Str outdir, prb_Str* srcFiles, i32 srcFileCount) {
+    prb_assert(prb_createDirIfNotExists(arena, outdir));
+    prb_Str groupsPath = prb_pathJoin(arena, outdir, prb_STR(".unity"));
+
+    UnityFile* files = 0;
+    for (i32 srcIndex = 0; srcIndex < srcFileCount; srcIndex++) {
+        prb_Str   srcpath = srcFiles[srcIndex];
+        prb_Str   name = prb_getLastEntryInPath(srcpath);
+        UnityFile file = {.path = srcpath, .group = -1, .candidate = prb_strEndsWith(srcpath, prb_STR(".cpp"))};
+        for (i32 blacklistIndex = 0; blacklistIndex < prb_arrayCount(globalUnityBlacklist) && file.candidate; blacklistIndex++) {
+            file.candidate = !prb_streq(name, prb_STR(globalUnityBlacklist[blacklistIndex]));
+        }
+        arrput(files, file);
+    }
+
+    i32                      groupCount = 0;
+    prb_ReadEntireFileResult groupsRead = prb_readEntireFile(arena, groupsPath);
+    if (groupsRead.success) {
+        // NOTE(khvorov) <group> <alone> <content hash> <path> per line, files that weren't around when the groups were formed
+        // compile on their own. Only grouped files need the hash, it's 0 for the rest
+        prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(groupsRead.content));
+        while (prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak}, prb_StrScannerSide_AfterMatch)) {
+            prb_Str        line = lineScanner.betweenLastMatches;
+            prb_StrScanner partScanner = prb_createStrScanner(line);
+            prb_Str        parts[3] = {};
+            for (i32 partIndex = 0; partIndex < prb_arrayCount(parts); partIndex++) {
+                prb_assert(prb_strScannerMove(&partScanner, (prb_StrFindSpec) {.pattern = prb_STR(" ")}, prb_StrScannerSide_AfterMatch));
+                parts[partIndex] = partScanner.betweenLastMatches;
+            }
+            bool                noGroup = prb_streq(parts[0], prb_STR("-1"));
+            prb_ParseUintResult group = prb_parseUint(parts[0], 10);
+            prb_ParseUintResult hash = prb_parseUint(parts[2], 10);
+            prb_assert((noGroup || group.success) && hash.success);
+            for (i32 fileIndex = 0; fileIndex < arrlen(files) && !noGroup; fileIndex++) {
+                UnityFile* file = files + fileIndex;
+                if (file->candidate && prb_streq(file->path, partScanner.afterMatch)) {
+                    file->group = (i32)group.number;
+                    file->alone = prb_streq(parts[1], prb_STR("1"));
+                    file->hash = hash.number;
+                    groupCount = prb_max(groupCount, file->group + 1);
+                }
+            }
+        }
+
+        bool* edited = prb_arenaAllocArray(arena, bool, arrlen(files));
+        bool* groupRebuilt = prb_arenaAllocArray(arena, bool, groupCount);
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            UnityFile* file = files + fileIndex;
+            if (file->group != -1) {
+                prb_FileHash hash = getFileHashCached(arena, file->path);
+                prb_assert(hash.valid);
+                edited[fileIndex] = hash.hash != file->hash;
+                file->hash = hash.hash;
+                if (edited[fileIndex] && !file->alone) {
+                    prb_writeToStdout(prb_fmt(arena, "unity: %.*s compiles on its own while it's being edited\n", prb_LIT(prb_getLastEntryInPath(file->path))));
+                    file->alone = true;
+                    groupRebuilt[file->group] = true;
+                }
+            }
+        }
+
+        // NOTE(khvorov) The marker is left by startUnityFallback
+        for (i32 group = 0; group < groupCount; group++) {
+            prb_Str failedMarker = getUnityGroupPath(arena, outdir, group, "failed");
+            if (prb_isFile(arena, failedMarker)) {
+                prb_writeToStdout(prb_fmt(arena, "unity: unity_%d.cpp failed to compile before, splitting it\n", group));
+                for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+                    if (files[fileIndex].group == group) {
+                        files[fileIndex].group = -1;
+                        files[fileIndex].alone = false;
+                    }
+                }
+                prb_assert(prb_removePathIfExists(arena, failedMarker));
+            } else if (depsChanged(arena, getUnityGroupPath(arena, outdir, group, "obj"))) {
+                groupRebuilt[group] = true;
+            }
+        }
+
+        // NOTE(khvorov) What a member declares could have changed while it was out, it only goes back in if it still fits
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+        bool*          rejoining = prb_arenaAllocArray(arena, bool, arrlen(files));
+        bool*          groupChecked = prb_arenaAllocArray(arena, bool, groupCount);
+        InternalNames* names = prb_arenaAllocArray(arena, InternalNames, arrlen(files));
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            UnityFile* file = files + fileIndex;
+            rejoining[fileIndex] = file->group != -1 && file->alone && !edited[fileIndex] && groupRebuilt[file->group];
+            if (rejoining[fileIndex]) {
+                groupChecked[file->group] = true;
+            }
+        }
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            UnityFile* file = files + fileIndex;
+            if (file->group != -1 && groupChecked[file->group] && (!file->alone || rejoining[fileIndex])) {
+                names[fileIndex] = getInternalNames(arena, file->path);
+            }
+        }
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            UnityFile* file = files + fileIndex;
+            if (rejoining[fileIndex]) {
+                bool clash = false;
+                for (i32 memberIndex = 0; memberIndex < arrlen(files) && !clash; memberIndex++) {
+                    UnityFile* member = files + memberIndex;
+                    bool       otherMember = memberIndex != fileIndex && member->group == file->group && (!member->alone || rejoining[memberIndex]);
+                    clash = otherMember && internalNamesClash(names + memberIndex, names + fileIndex);
+                }
+                if (clash) {
+                    prb_writeToStdout(prb_fmt(arena, "unity: %.*s no longer fits in unity_%d.cpp, it compiles on its own from now on\n", prb_LIT(prb_getLastEntryInPath(file->path)), file->group));
+                    file->group = -1;
+                } else {
+                    prb_writeToStdout(prb_fmt(arena, "unity: %.*s is back in unity_%d.cpp\n", prb_LIT(prb_getLastEntryInPath(file->path)), file->group));
+                }
+                file->alone = false;
+            }
+        }
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            arrfree(names[fileIndex].hashes);
+            arrfree(names[fileIndex].leakedMacros);
+        }
+        prb_endTempMemory(temp);
+    } else {
+        // NOTE(khvorov) Every header the library includes is read once, none of that outlives the grouping
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+        IncludesKV*    includeCache = 0;
+        sh_new_arena(includeCache);
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            UnityFile* file = files + fileIndex;
+            if (file->candidate) {
+                file->includes = getIncludeClosure(arena, file->path, &includeCache);
+                file->internalNames = getInternalNames(arena, file->path);
+            }
+        }
+
+        // NOTE(khvorov) Each group grows around its first file
+        for (i32 seedIndex = 0; seedIndex < arrlen(files); seedIndex++) {
+            UnityFile* seed = files + seedIndex;
+            if (seed->candidate && seed->group == -1) {
+                i32  group = groupCount++;
+                i32* members = 0;
+                seed->group = group;
+                arrput(members, seedIndex);
+                while (arrlen(members) < globalUnitySize) {
+                    i32 bestIndex = -1;
+                    i32 bestShared = -1;
+                    for (i32 fileIndex = seedIndex + 1; fileIndex < arrlen(files); fileIndex++) {
+                        UnityFile* file = files + fileIndex;
+                        if (file->candidate && file->group == -1) {
+                            bool clash = false;
+                            for (i32 memberIndex = 0; memberIndex < arrlen(members) && !clash; memberIndex++) {
+                                clash = internalNamesClash(&files[members[memberIndex]].internalNames, &file->internalNames);
+                            }
+                            i32 shared = countSharedIncludes(seed->includes, file->includes);
+                            if (!clash && shared > bestShared) {
+                                bestIndex = fileIndex;
+                                bestShared = shared;
+                            }
+                        }
+                    }
+                    if (bestIndex == -1) {
+                        break;
+                    }
+                    files[bestIndex].group = group;
+                    arrput(members, bestIndex);
+                }
+                arrfree(members);
+                // NOTE(khvorov) Left over from a group of the same number that was regrouped away
+                prb_assert(prb_removePathIfExists(arena, getUnityGroupPath(arena, outdir, group, "failed")));
+            }
+        }
+
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            arrfree(files[fileIndex].includes);
+            arrfree(files[fileIndex].internalNames.hashes);
+            arrfree(files[fileIndex].internalNames.leakedMacros);
+        }
+        for (i32 cacheIndex = 0; cacheIndex < shlen(includeCache); cacheIndex++) {
+            arrfree(includeCache[cacheIndex].value);
+        }
+        shfree(includeCache);
+        prb_endTempMemory(temp);
+
+        // NOTE(khvorov) A group of one is just that file
+        i32* groupSizes = prb_arenaAllocArray(arena, i32, groupCount);
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            if (files[fileIndex].group != -1) {
+                groupSizes[files[fileIndex].group] += 1;
+            }
+        }
+        for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+            UnityFile* file = files + fileIndex;
+            if (file->group != -1 && groupSizes[file->group] < 2) {
+                file->group = -1;
+            }
+            if (file->group != -1) {
+                prb_FileHash hash = getFileHashCached(arena, file->path);
+                prb_assert(hash.valid);
+                file->hash = hash.hash;
+            }
+        }
+    }
+
+    {
+        prb_Str groups = {};
+        {
+            prb_GrowingStr groupsBuilder = prb_beginStr(arena);
+            for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+                UnityFile* file = files + fileIndex;
+                prb_addStrSegment(&groupsBuilder, "%d %d %llu %.*s\n", file->group, file->alone, (unsigned long long)(file->group == -1 ? 0 : file->hash), prb_LIT(file->path));
+            }
+            groups = prb_endStr(&groupsBuilder);
+        }
+        prb_assert(prb_writeEntireFile(arena, groupsPath, groups.ptr, groups.len));
+    }
+
+    // NOTE(khvorov) A group that's down to one member for now is just that file
+    i32* inGroupCounts = prb_arenaAllocArray(arena, i32, groupCount);
+    for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+        if (files[fileIndex].group != -1 && !files[fileIndex].alone) {
+            inGroupCounts[files[fileIndex].group] += 1;
+        }
+    }
+
+    // NOTE(khvorov) Unity TUs are only rewritten when their members change so that they don't all recompile every time.
+    // Every LLVM file defines its own DEBUG_TYPE, and whatever other macros a member leaves defined mustn't reach the ones after it.
+    prb_Str* result = 0;
+    bool*    groupEmitted = prb_arenaAllocArray(arena, bool, groupCount);
+    for (i32 fileIndex = 0; fileIndex < arrlen(files); fileIndex++) {
+        UnityFile* file = files + fileIndex;
+        if (file->group == -1 || file->alone || inGroupCounts[file->group] < 2) {
+            arrput(result, file->path);
+        } else if (!groupEmitted[file->group]) {
+            groupEmitted[file->group] = true;
+            prb_Str        unityPath = getUnityGroupPath(arena, outdir, file->group, "cpp");
+            prb_TempMemory temp = prb_beginTempMemory(arena);
+            prb_Str*       members = 0;
+            for (i32 memberIndex = fileIndex; memberIndex < arrlen(files); memberIndex++) {
+                if (files[memberIndex].group == file->group && !files[memberIndex].alone) {
+                    arrput(members, files[memberIndex].path);
+                }
+            }
+            prb_Str* existingMembers = prb_isFile(arena, unityPath) ? getUnityMembers(arena, unityPath) : 0;
+            bool     same = arrlen(existingMembers) == arrlen(members);
+            for (i32 memberIndex = 0; memberIndex < arrlen(members) && same; memberIndex++) {
+                same = prb_streq(members[memberIndex], existingMembers[memberIndex]);
+            }
+            if (!same) {
+                prb_Str** leakedMacros = prb_arenaAllocArray(arena, prb_Str*, arrlen(members));
+                for (i32 memberIndex = 0; memberIndex < arrlen(members); memberIndex++) {
+                    InternalNames names = getInternalNames(arena, members[memberIndex]);
+                    leakedMacros[memberIndex] = names.leakedMacros;
+                    arrfree(names.hashes);
+                }
+                prb_GrowingStr unityBuilder = prb_beginStr(arena);
+                for (i32 memberIndex = 0; memberIndex < arrlen(members); memberIndex++) {
+                    prb_addStrSegment(&unityBuilder, "#include \"%.*s\"\n#undef DEBUG_TYPE\n", prb_LIT(members[memberIndex]));
+                    for (i32 macroIndex = 0; macroIndex < arrlen(leakedMacros[memberIndex]); macroIndex++) {
+                        prb_addStrSegment(&unityBuilder, "#undef %.*s\n", prb_LIT(leakedMacros[memberIndex][macroIndex]));
+                    }
+                }
+                prb_Str unitySrc = prb_endStr(&unityBuilder);
+                prb_assert(prb_writeEntireFile(arena, unityPath, unitySrc.ptr, unitySrc.len));
+                for (i32 memberIndex = 0; memberIndex < arrlen(members); memberIndex++) {
+                    arrfree(leakedMacros[memberIndex]);
+                }
+            }
+            arrfree(members);
+            arrfree(existingMembers);
+            prb_endTempMemory(temp);
+            arrput(result, unityPath);
+        }
+    }
+
+    arrfree(files);
+    return result;
+}
+
+// NOTE(khvorov) The quoted includes at the top of a file, up to the first line that is anything else
+function prb_Str*
+getLeadingIncludes(prb_Arena* arena, prb_Str path) {
+    prb_Str*                 result = 0;
+    prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, path);
+    prb_assert(readRes.success);
+    prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(readRes.content));
+    bool           inComment = false;
+    bool           done = false;
+    while (!done && prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak, .alwaysMatchEnd = true}, prb_StrScannerSide_AfterMatch)) {
+        prb_Str line = prb_strTrim(lineScanner.betweenLastMatches);
+        if (inComment) {
+            inComment = !prb_strEndsWith(line, prb_STR("*/"));
+        } else if (prb_strStartsWith(line, prb_STR("/*"))) {
+            inComment = !prb_strEndsWith(line, prb_STR("*/"));
+        } else if (prb_strStartsWith(line, prb_STR("#include \"")) && prb_strEndsWith(line, prb_STR("\""))) {
+            arrput(result, prb_strSlice(line, prb_STR("#include \"").len, line.len - 1));
+        } else {
+            done = line.len > 0 && !prb_strStartsWith(line, prb_STR("//"));
+        }
+    }
+    return result;
+}
+
+// NOTE(khvorov) A unity TU is nothing but its members (see getUnitySources), its leading includes are the ones
+// every member starts with, in the order the first member has them
+function prb_Str*
+getUnityLeadingIncludes(prb_Arena* arena, prb_Str unityPath) {
+    prb_Str* result = 0;
+    prb_Str* members = getUnityMembers(arena, unityPath);
+    for (i32 memberIndex = 0; memberIndex < arrlen(members); memberIndex++) {
+        prb_Str* memberIncludes = getLeadingIncludes(arena, members[memberIndex]);
+        if (memberIndex == 0) {
+            result = memberIncludes;
+            memberIncludes = 0;
+        } else {
+            for (i32 includeIndex = arrlen(result) - 1; includeIndex >= 0; includeIndex--) {
+                bool shared = false;
+                for (i32 memberIncludeIndex = 0; memberIncludeIndex < arrlen(memberIncludes) && !shared; memberIncludeIndex++) {
+                    shared = prb_streq(result[includeIndex], memberIncludes[memberIncludeIndex]);
+                }
+                if (!shared) {
+                    arrdel(result, includeIndex);
+                }
+            }
+        }
+        arrfree(memberIncludes);
+    }
+    arrfree(members);
+    return result;
+}
+
+// NOTE(khvorov) Header -> how many files have it among their leading includes
+typedef struct IncludeCountKV {
+    char* key;
+    i32   value;
+} IncludeCountKV;
+
+function int
+includeCountDescending(const void* kv1, const void* kv2) {
+    i32 count1 = ((const IncludeCountKV*)kv1)->value;
+    i32 count2 = ((const IncludeCountKV*)kv2)->value;
+    int result = count1 > count2 ? -1 : count1 < count2 ? 1 : 0;
+    return result;
+}
+
+// NOTE(khvorov) TUs start with their own header so they rarely share an exact prefix, the PCH is a set instead.
+// Takes the k most common leading includes for the k that saves the most header parsing (users times k),
+// as long as at least a quarter of the library's TUs have all of them. Only those TUs get -include-pch so the PCH
+// never makes anything visible that the TU didn't include anyway, the TU's own #includes then do nothing
+// because of the include guards. With --unity the TUs are the unity ones and their members' includes are used.
+function LibPch
+getLibPch(prb_Arena* arena, prb_Str outdir, prb_Str* srcFiles, i32 srcFileCount) {
+    LibPch result = {.step = -1, .users = prb_arenaAllocArray(arena, bool, srcFileCount)};
+
+    // NOTE(khvorov) Every source is read to find its includes, none of that outlives the choice of headers
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    prb_Str**      includes = prb_arenaAllocArray(arena, prb_Str*, srcFileCount);
+    prb_Str        unityPrefix = prb_pathJoin(arena, outdir, prb_STR("unity_"));
+    for (i32 srcIndex = 0; srcIndex < srcFileCount; srcIndex++) {
+        prb_Str srcpath = srcFiles[srcIndex];
+        if (prb_strStartsWith(srcpath, unityPrefix)) {
+            includes[srcIndex] = getUnityLeadingIncludes(arena, srcpath);
+        } else if (prb_strEndsWith(srcpath, prb_STR(".cpp"))) {
+            includes[srcIndex] = getLeadingIncludes(arena, srcpath);
+        }
+    }
+
+    IncludeCountKV* counts = 0;
+    sh_new_arena(counts);
+    for (i32 srcIndex = 0; srcIndex < srcFileCount; srcIndex++) {
+        for (i32 includeIndex = 0; includeIndex < arrlen(includes[srcIndex]); includeIndex++) {
+            char* key = (char*)prb_strGetNullTerminated(arena, includes[srcIndex][includeIndex]);
+            i32   count = shget(counts, key) + 1;
+            shput(counts, key, count);
+        }
+    }
+    IncludeCountKV* sorted = prb_arenaAllocArray(arena, IncludeCountKV, shlen(counts));
+    prb_memcpy(sorted, counts, shlen(counts) * sizeof(*counts));
+    qsort(sorted, shlen(counts), sizeof(*sorted), includeCountDescending);
+
+    i32   minUsers = prb_max(3, srcFileCount / 4);
+    i32   bestCount = 0;
+    i32   bestScore = 0;
+    bool* users = prb_arenaAllocArray(arena, bool, srcFileCount);
+    for (i32 srcIndex = 0; srcIndex < srcFileCount; srcIndex++) {
+        users[srcIndex] = includes[srcIndex] != 0;
+    }
+    for (i32 headerCount = 1; headerCount <= shlen(counts); headerCount++) {
+        prb_Str header = prb_STR(sorted[headerCount - 1].key);
+        i32     userCount = 0;
+        for (i32 srcIndex = 0; srcIndex < srcFileCount; srcIndex++) {
+            bool hasHeader = false;
+            for (i32 includeIndex = 0; includeIndex < arrlen(includes[srcIndex]) && users[srcIndex] && !hasHeader; includeIndex++) {
+                hasHeader = prb_streq(includes[srcIndex][includeIndex], header);
+            }
+            users[srcIndex] = users[srcIndex] && hasHeader;
+            userCount += users[srcIndex];
+        }
+        if (userCount < minUsers) {
+            break;
+        }
+        if (userCount * headerCount > bestScore) {
+            bestCount = headerCount;
+            bestScore = userCount * headerCount;
+            prb_memcpy(result.users, users, srcFileCount * sizeof(*users));
+        }
+    }
+
+    if (bestCount > 0) {
+        // NOTE(khvorov) Same order as in the first TU that uses it
+        prb_Str* pchIncludes = 0;
+        for (i32 srcIndex = 0; srcIndex < srcFileCount && !pchIncludes; srcIndex++) {
+            if (result.users[srcIndex]) {
+                for (i32 includeIndex = 0; includeIndex < arrlen(includes[srcIndex]); includeIndex++) {
+                    prb_Str include = includes[srcIndex][includeIndex];
+                    for (i32 headerIndex = 0; headerIndex < bestCount; headerIndex++) {
+                        if (prb_streq(include, prb_STR(sorted[headerIndex].key))) {
+                            arrput(pchIncludes, include);
+                        }
+                    }
+                }
+            }
+        }
+
+        // NOTE(khvorov) Includes are relative to pch.h so that it reads the same in every checkout, it is a dep of every object
+        // that uses the PCH (see runSteps)
+        prb_Str header = {};
+        {
+            prb_assert(prb_strStartsWith(outdir, globalRootDir));
+            prb_Str outdirFromRoot = prb_strSlice(outdir, globalRootDir.len, outdir.len);
+            prb_Str srcdirFromRoot = prb_strSlice(globalClangSrcDir, globalRootDir.len, globalClangSrcDir.len);
+            prb_GrowingStr headerBuilder = prb_beginStr(arena);
+            for (i32 includeIndex = 0; includeIndex < arrlen(pchIncludes); includeIndex++) {
+                prb_addStrSegment(&headerBuilder, "#include \"");
+                for (i32 charIndex = 0; charIndex < outdirFromRoot.len; charIndex++) {
+                    if (outdirFromRoot.ptr[charIndex] == '/') {
+                        prb_addStrSegment(&headerBuilder, "%s..", charIndex == 0 ? "" : "/");
+                    }
+                }
+                prb_addStrSegment(&headerBuilder, "%.*s/%.*s\"\n", prb_LIT(srcdirFromRoot), prb_LIT(pchIncludes[includeIndex]));
+            }
+            header = prb_endStr(&headerBuilder);
+        }
+        prb_assert(prb_createDirIfNotExists(arena, outdir));
+        prb_Str                  headerPath = prb_pathJoin(arena, outdir, prb_STR("pch.h"));
+        prb_ReadEntireFileResult existing = prb_readEntireFile(arena, headerPath);
+        if (!existing.success || !prb_streq(prb_strFromBytes(existing.content), header)) {
+            prb_assert(prb_writeEntireFile(arena, headerPath, header.ptr, header.len));
+        }
+        arrfree(pchIncludes);
+    }
+
+    shfree(counts);
+    for (i32 srcIndex = 0; srcIndex < srcFileCount; srcIndex++) {
+        arrfree(includes[srcIndex]);
+    }
+    prb_endTempMemory(temp);
+
+    if (bestCount > 0) {
+        prb_Str headerPath = prb_pathJoin(arena, outdir, prb_STR("pch.h"));
+        result.path = prb_pathJoin(arena, outdir, prb_STR("pch.h.pch"));
+        prb_Str depfile = getDepfilePath(arena, result.path);
+        prb_Str cmd = prb_fmt(
+            arena,
+            "clang %.*s%.*s -Werror -Wfatal-errors -MD -MF %.*s -x c++-header -Xclang -emit-pch -c %.*s -o %.*s",
+            prb_LIT(globalPgoFlags),
+            prb_LIT(getCompileFlags(arena, headerPath)),
+            prb_LIT(depfile),
+            prb_LIT(headerPath),
+            prb_LIT(result.path)
+        );
+        if (commandChanged(arena, result.path, cmd) || depsChanged(arena, result.path)) {
+            result.step = addStep(StepKind_Pch, cmd, headerPath, result.path, 0, 0);
+        }
+    }
+    return result;
+}
+
+function prb_Str
+getObjPath(prb_Arena* arena, prb_Str outdir, prb_Str srcpath) {
+    prb_Str outname = prb_replaceExt(arena, prb_getLastEntryInPath(srcpath), prb_STR("obj"));
+    prb_Str result = prb_pathJoin(arena, outdir, outname);
+    return result;
+}
+
+function prb_Str
+getCompileCmd(prb_Arena* arena, prb_Str srcpath, prb_Str out, prb_Str pchFlag) {
+    // NOTE(khvorov) The prefix map doesn't reach the .dwo name in the skeleton, that one is from the root from the start
+    prb_Str dwoFlag = globalProfile.splitDwarf ? prb_fmt(arena, " -Xclang -split-dwarf-file -Xclang %.*s", prb_LIT(getRootRelative(arena, getDwoPath(arena, out)))) : prb_STR("");
+    prb_Str depfile = getDepfilePath(arena, out);
+    prb_Str result = prb_fmt(arena, "clang %.*s%.*s%.*s%.*s -Werror -Wfatal-errors -MD -MF %.*s -c %.*s -o %.*s", prb_LIT(globalPgoFlags), prb_LIT(getCompileFlags(arena, srcpath)), prb_LIT(pchFlag), prb_LIT(dwoFlag), prb_LIT(depfile), prb_LIT(srcpath), prb_LIT(out));
+    return result;
+}
+
+function CompileObjsResult
+compileObjs(prb_Arena* arena, prb_Str outdir, prb_Str* srcFiles, i32 srcFileCount, LibPch pch) {
+    prb_Str* objs = 0;
+    i32*     steps = 0;
+    prb_Str  unityPrefix = prb_pathJoin(arena, outdir, prb_STR("unity_"));
+    for (i32 srcIndex = 0; srcIndex < srcFileCount; srcIndex++) {
+        prb_Str srcpath = srcFiles[srcIndex];
+        prb_assert(isSrcFile(srcpath));
+        prb_Str out = getObjPath(arena, outdir, srcpath);
+        arrput(objs, out);
+
+        bool    usesPch = pch.path.len > 0 && pch.users[srcIndex];
+        prb_Str pchFlag = usesPch ? prb_fmt(arena, " -include-pch %.*s", prb_LIT(pch.path)) : prb_STR("");
+        prb_Str cmd = getCompileCmd(arena, srcpath, out, pchFlag);
+
+        // NOTE(khvorov) Recompile if src or any of its includes are newer than out (or if out does not exist)
+        // or if out was built with a different command
+        if (commandChanged(arena, out, cmd) || depsChanged(arena, out)) {
+            i32 step = addStep(StepKind_Compile, cmd, srcpath, out, &pch.step, usesPch ? 1 : 0);
+            arrput(steps, step);
+
+            // NOTE(khvorov) The members stand by in case the unity TU breaks where they wouldn't on their own.
+            // The PCH is made of includes every member starts with, and the unity step can only fail after it's built.
+            if (prb_strStartsWith(srcpath, unityPrefix)) {
+                prb_Str* members = getUnityMembers(arena, srcpath);
+                for (i32 memberIndex = 0; memberIndex < arrlen(members); memberIndex++) {
+                    prb_Str member = members[memberIndex];
+                    prb_Str memberOut = getObjPath(arena, outdir, member);
+                    i32     memberStep = addStep(StepKind_Compile, getCompileCmd(arena, member, memberOut, pchFlag), member, memberOut, 0, 0);
+                    globalSteps[memberStep].unityFallbackFor = step;
+                }
+                arrfree(members);
+            }
+        }
     }
-    prb_assert(procsDoneCount == totalObjCount);
 
-    bool              anyRecompiled = totalObjCount > 0;
-    CompileObjsResult result = {objList, anyRecompiled};
+    prb_Str objList = prb_stringsJoin(arena, objs, arrlen(objs), prb_STR(" "));
+    arrfree(objs);
 
-    prb_endTempMemory(temp);
-    prb_arenaChangeUsed(arena, objList.len + 1);
+    CompileObjsResult result = {objList, steps};
     return result;
 }
 
-function void
-execCmd(prb_Arena* arena, prb_Str cmd) {
-    prb_writelnToStdout(arena, cmd);
-    prb_Process proc = prb_createProcess(cmd, (prb_ProcessSpec) {});
-    prb_assert(prb_launchProcesses(arena, &proc, 1, prb_Background_No));
-}
-
 function CompileObjsResult
 compileObjsThatStartWith(prb_Arena* arena, prb_Str startsWith) {
     prb_Str outdir = prb_pathJoin(arena, globalBuildDir, startsWith);
@@ -229,141 +3388,324 @@ compileObjsThatStartWith(prb_Arena* arena, prb_Str startsWith) {
 
     prb_assert(arrlen(files) > 0);
 
-    CompileObjsResult objResult = compileObjs(arena, outdir, files, arrlen(files));
+    if (globalUnitySize > 1) {
+        prb_Str* unitySources = getUnitySources(arena, outdir, files, arrlen(files));
+        arrfree(files);
+        files = unitySources;
+    }
+
+    LibPch pch = {.step = -1};
+    if (globalPchMode) {
+        pch = getLibPch(arena, outdir, files, arrlen(files));
+    }
+
+    CompileObjsResult objResult = compileObjs(arena, outdir, files, arrlen(files), pch);
+    arrfree(files);
     return objResult;
 }
 
 typedef struct CompileStaticLibResult {
     prb_Str outfile;
-    bool    recompiled;
+    // NOTE(khvorov) -1 when the lib is up to date
+    i32 step;
+    // NOTE(khvorov) Empty without --dwp, dwpStep is -1 when it's up to date
+    prb_Str dwp;
+    i32     dwpStep;
 } CompileStaticLibResult;
 
+function prb_Str
+getDwoList(prb_Arena* arena, prb_Str objs) {
+    const char** objPaths = prb_getArgArrayFromStr(arena, objs);
+    prb_Str*     dwoPaths = 0;
+    for (i32 objIndex = 0; objIndex < arrlen(objPaths); objIndex++) {
+        arrput(dwoPaths, getDwoPath(arena, prb_STR(objPaths[objIndex])));
+    }
+    prb_Str result = prb_stringsJoin(arena, dwoPaths, arrlen(dwoPaths), prb_STR(" "));
+    arrfree(dwoPaths);
+    arrfree(objPaths);
+    return result;
+}
+
+// NOTE(khvorov) -1 when outfile is up to date. Doesn't need the link so it goes alongside it.
+function i32
+addDwpStep(prb_Arena* arena, prb_Str outfile, prb_Str inputs, i32* deps, i32 depsCount) {
+    prb_Str cmd = prb_fmt(arena, "llvm-dwp -o %.*s %.*s", prb_LIT(outfile), prb_LIT(inputs));
+    i32     step = -1;
+    if (depsCount > 0 || !prb_isFile(arena, outfile) || commandChanged(arena, outfile, cmd)) {
+        step = addStep(StepKind_Dwp, cmd, prb_STR(""), outfile, deps, depsCount);
+    } else {
+        prb_writeToStdout(prb_fmt(arena, "skip %.*s\n", prb_LIT(prb_getLastEntryInPath(outfile))));
+    }
+    return step;
+}
+
 function CompileStaticLibResult
 compileStaticLib(prb_Arena* arena, prb_Str startsWith) {
-    prb_Str        outname = prb_fmt(arena, "%.*s.lib", prb_LIT(startsWith));
-    prb_Str        outfile = prb_pathJoin(arena, globalBuildDir, outname);
-    prb_TempMemory temp = prb_beginTempMemory(arena);
+    prb_Str outname = prb_fmt(arena, "%.*s.lib", prb_LIT(startsWith));
+    prb_Str outfile = prb_pathJoin(arena, globalBuildDir, outname);
 
     CompileObjsResult objResult = compileObjsThatStartWith(arena, startsWith);
-    bool              recompile = objResult.anyRecompiled || !prb_isFile(arena, outfile);
-    if (recompile) {
-        prb_assert(prb_removePathIfExists(arena, outfile));
-        prb_Str libCmd = prb_fmt(arena, "ar rcs %.*s %.*s", prb_LIT(outfile), prb_LIT(objResult.objs));
-        execCmd(arena, libCmd);
+    // NOTE(khvorov) Bitcode symbols need LLVM to read so thinlto objects still go through llvm-ar (thin as well).
+    // Everything else is archived in-process by runSteps, the command is only there for the build log.
+    prb_Str           libCmd = globalProfile.thinLto
+                  ? prb_fmt(arena, "llvm-ar rcsT %.*s %.*s", prb_LIT(outfile), prb_LIT(objResult.objs))
+                  : prb_fmt(arena, "archive %.*s %.*s", prb_LIT(outfile), prb_LIT(objResult.objs));
+    i32               step = -1;
+    if (arrlen(objResult.steps) > 0 || !prb_isFile(arena, outfile) || commandChanged(arena, outfile, libCmd)) {
+        if (globalProfile.thinLto) {
+            // NOTE(khvorov) llvm-ar appends to an existing archive so it has to go now, before the graph runs
+            prb_assert(prb_removePathIfExists(arena, outfile));
+        }
+        step = addStep(StepKind_Archive, libCmd, objResult.objs, outfile, objResult.steps, arrlen(objResult.steps));
     } else {
         prb_writeToStdout(prb_fmt(arena, "skip %.*s\n", prb_LIT(outname)));
     }
 
-    prb_endTempMemory(temp);
-    CompileStaticLibResult result = {outfile, recompile};
+    CompileStaticLibResult result = {.outfile = outfile, .step = step, .dwpStep = -1};
+    if (globalDwpMode) {
+        result.dwp = prb_replaceExt(arena, outfile, prb_STR("dwp"));
+        result.dwpStep = addDwpStep(arena, result.dwp, getDwoList(arena, objResult.objs), objResult.steps, arrlen(objResult.steps));
+    }
+    arrfree(objResult.steps);
     return result;
 }
 
 function prb_Str
 compileExe(prb_Arena* arena, prb_Str startsWith, CompileStaticLibResult* deps, i32 depsCount, prb_Str outname) {
-    prb_Str        outnameWithExt = prb_fmt(arena, "%.*s.exe", prb_LIT(outname));
-    prb_Str        outfile = prb_pathJoin(arena, globalBuildDir, outnameWithExt);
-    prb_TempMemory temp = prb_beginTempMemory(arena);
+    prb_Str outnameWithExt = prb_fmt(arena, "%.*s.exe", prb_LIT(outname));
+    prb_Str outfile = prb_pathJoin(arena, globalBuildDir, outnameWithExt);
 
-    prb_GrowingStr depsBuilder = prb_beginStr(arena);
-    bool           anyDepRecompiled = false;
+    CompileObjsResult objResult = compileObjsThatStartWith(arena, startsWith);
+    i32*              linkDeps = objResult.steps;
+    prb_Str*          depFiles = 0;
     for (i32 depIndex = 0; depIndex < depsCount; depIndex++) {
         CompileStaticLibResult dep = deps[depIndex];
-        if (dep.recompiled) {
-            anyDepRecompiled = true;
+        if (dep.step != -1) {
+            arrput(linkDeps, dep.step);
         }
-        prb_addStrSegment(&depsBuilder, " %.*s", prb_LIT(dep.outfile));
+        arrput(depFiles, dep.outfile);
     }
-    prb_Str depsStr = prb_endStr(&depsBuilder);
+    prb_Str depsStr = prb_stringsJoin(arena, depFiles, arrlen(depFiles), prb_STR(" "));
 
-    CompileObjsResult objResult = compileObjsThatStartWith(arena, startsWith);
-    if (anyDepRecompiled || objResult.anyRecompiled || !prb_isFile(arena, outfile)) {
+    if (globalDwpMode) {
+        i32*     dwpDeps = 0;
+        prb_Str* dwpInputs = 0;
+        for (i32 stepIndex = 0; stepIndex < arrlen(objResult.steps); stepIndex++) {
+            arrput(dwpDeps, objResult.steps[stepIndex]);
+        }
+        arrput(dwpInputs, getDwoList(arena, objResult.objs));
+        for (i32 depIndex = 0; depIndex < depsCount; depIndex++) {
+            if (deps[depIndex].dwpStep != -1) {
+                arrput(dwpDeps, deps[depIndex].dwpStep);
+            }
+            arrput(dwpInputs, deps[depIndex].dwp);
+        }
+        prb_Str dwpOutfile = prb_fmt(arena, "%.*s.dwp", prb_LIT(outfile));
+        addDwpStep(arena, dwpOutfile, prb_stringsJoin(arena, dwpInputs, arrlen(dwpInputs), prb_STR(" ")), dwpDeps, arrlen(dwpDeps));
+        arrfree(dwpDeps);
+        arrfree(dwpInputs);
+    }
+
+    // NOTE(khvorov) With ThinLTO a relink only redoes the backend for modules whose imports changed,
+    // everything else comes out of the cache
+    prb_Str linker = prb_STR("-fuse-ld=mold");
+    if (globalProfile.thinLto) {
+        prb_Str cacheDir = prb_pathJoin(arena, globalBuildDir, prb_STR("thinlto-cache"));
+        linker = prb_fmt(arena, "-fuse-ld=lld -Wl,--thinlto-cache-dir=%.*s -Wl,--thinlto-cache-policy=cache_size_bytes=20g", prb_LIT(cacheDir));
+    }
+    prb_Str linkCmd = prb_fmt(arena, "clang %.*s %.*s%s -o %.*s %.*s %.*s -lstdc++ -lm", prb_LIT(linker), prb_LIT(globalPgoFlags), globalProfile.linkFlags, prb_LIT(outfile), prb_LIT(objResult.objs), prb_LIT(depsStr));
+    if (arrlen(linkDeps) > 0 || !prb_isFile(arena, outfile) || commandChanged(arena, outfile, linkCmd)) {
         prb_assert(prb_removePathIfExists(arena, outfile));
-        prb_Str libCmd = prb_fmt(arena, "clang -fuse-ld=mold -o %.*s %.*s %.*s -lstdc++ -lm", prb_LIT(outfile), prb_LIT(objResult.objs), prb_LIT(depsStr));
-        execCmd(arena, libCmd);
+        addStep(StepKind_Link, linkCmd, prb_STR(""), outfile, linkDeps, arrlen(linkDeps));
     } else {
         prb_writeToStdout(prb_fmt(arena, "skip %.*s\n", prb_LIT(outnameWithExt)));
     }
 
-    prb_endTempMemory(temp);
+    arrfree(linkDeps);
+    arrfree(depFiles);
     return outfile;
 }
 
-typedef struct RunTableGenSpec {
-    prb_Str tableGenExe;
-    prb_Str in;
-    prb_Str out;
-    prb_Str includes;
-    prb_Str args;
-} RunTableGenSpec;
-
 function void
-runTableGen(prb_Arena* arena, void* data) {
-    RunTableGenSpec* spec = (RunTableGenSpec*)data;
+execCmd(prb_Arena* arena, prb_Str cmd) {
+    prb_writelnToStdout(arena, cmd);
+    prb_Process proc = prb_createProcess(cmd, (prb_ProcessSpec) {});
+    prb_assert(prb_launchProcesses(arena, &proc, 1, prb_Background_No));
+}
 
-    prb_Str tableGenExe = spec->tableGenExe;
-    prb_Str in = spec->in;
-    prb_Str out = spec->out;
-    prb_Str includes = spec->includes;
-    prb_Str args = spec->args;
+// NOTE(khvorov) Our clang.exe only takes cc1 arguments so the system driver works them out for it
+function prb_Process
+createDriverProcess(prb_Arena* arena, prb_Str srcpath, prb_Str driverOutPath) {
+    prb_Str     driverCmd = prb_fmt(arena, "clang -### %.*s -c %.*s -o /dev/null", prb_LIT(getCompileFlags(arena, srcpath)), prb_LIT(srcpath));
+    prb_Process result = prb_createProcess(driverCmd, (prb_ProcessSpec) {.redirectStderr = true, .stderrFilepath = driverOutPath});
+    return result;
+}
 
-    prb_TempMemory temp = prb_beginTempMemory(arena);
+// NOTE(khvorov) Every argument in the -### output is quoted, the first one is the driver itself.
+// Empty when the driver failed and left no cc1 line behind.
+function prb_Str
+getCc1Cmd(prb_Arena* arena, prb_Str clangExe, prb_Str driverOutPath) {
+    prb_Str                  result = {};
+    prb_ReadEntireFileResult driverOut = prb_readEntireFile(arena, driverOutPath);
+    if (driverOut.success) {
+        prb_StrScanner lineScanner = prb_createStrScanner(prb_strFromBytes(driverOut.content));
+        while (result.len == 0 && prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak, .alwaysMatchEnd = true}, prb_StrScannerSide_AfterMatch)) {
+            prb_Str line = prb_strTrim(lineScanner.betweenLastMatches);
+            if (prb_strStartsWith(line, prb_STR("\"")) && prb_strFind(line, (prb_StrFindSpec) {.pattern = prb_STR("\"-cc1\"")}).found) {
+                prb_GrowingStr cmdBuilder = prb_beginStr(arena);
+                prb_addStrSegment(&cmdBuilder, "%.*s", prb_LIT(clangExe));
+                i32  argIndex = 0;
+                bool inQuotes = false;
+                for (i32 charIndex = 0; charIndex < line.len; charIndex++) {
+                    char ch = line.ptr[charIndex];
+                    if (ch == '"') {
+                        inQuotes = !inQuotes;
+                        if (inQuotes && argIndex > 0) {
+                            prb_addStrSegment(&cmdBuilder, " ");
+                        }
+                        argIndex += !inQuotes;
+                    } else if (inQuotes && argIndex > 0) {
+                        if (ch == '\\' && charIndex + 1 < line.len) {
+                            charIndex += 1;
+                            ch = line.ptr[charIndex];
+                        }
+                        prb_addStrSegment(&cmdBuilder, "%c", ch);
+                    }
+                }
+                result = prb_endStr(&cmdBuilder);
+            }
+        }
+    }
+    return result;
+}
 
-    prb_Str includePaths = {};
-    {
-        prb_GrowingStr includePathsBuilder = prb_beginStr(arena);
-        prb_StrScanner scanner = prb_createStrScanner(includes);
-        while (prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR(" "), .alwaysMatchEnd = true}, prb_StrScannerSide_AfterMatch)) {
-            prb_addStrSegment(&includePathsBuilder, " -I%.*s/%.*s", prb_LIT(globalLLVMRootDir), prb_LIT(scanner.betweenLastMatches));
+// NOTE(khvorov) Same slot refill as runSteps but a failed process doesn't stop the rest, returns how many failed
+function i32
+runProcessesInSlots(prb_Arena* arena, prb_Process* procs, i32 procCount) {
+    prb_CoreCountResult cores = prb_getCoreCount(arena);
+    prb_assert(cores.success);
+    i32          failures = 0;
+    i32          nextProcIndex = 0;
+    prb_Process* runningProcs = 0;
+    while (nextProcIndex < procCount || arrlen(runningProcs) > 0) {
+        while (nextProcIndex < procCount && arrlen(runningProcs) < cores.cores && haveJobSlot(arrlen(runningProcs))) {
+            prb_Process proc = procs[nextProcIndex++];
+            prb_writelnToStdout(arena, proc.cmd);
+            if (prb_launchProcesses(arena, &proc, 1, prb_Background_Yes)) {
+                arrput(runningProcs, proc);
+            } else {
+                failures += 1;
+            }
+        }
+        releaseSpareJobTokens(arrlen(runningProcs));
+
+        if (arrlen(runningProcs) > 0) {
+            bool                        wantToken = nextProcIndex < procCount && arrlen(runningProcs) < cores.cores;
+            prb_WaitForAnyProcessResult waitRes = wantToken ? prb_waitForAnyProcessOrJobserverToken(&globalJobserver, runningProcs, arrlen(runningProcs))
+                                                            : prb_waitForAnyProcess(runningProcs, arrlen(runningProcs));
+            prb_assert(waitRes.success);
+            if (waitRes.index != -1) {
+                failures += runningProcs[waitRes.index].status != prb_ProcessStatus_CompletedSuccess;
+                arrdelswap(runningProcs, waitRes.index);
+                releaseSpareJobTokens(arrlen(runningProcs));
+            }
         }
-        includePaths = prb_endStr(&includePathsBuilder);
     }
+    arrfree(runningProcs);
+    return failures;
+}
 
-    prb_Str inpath = prb_pathJoin(arena, globalLLVMRootDir, in);
-    prb_Str outpath = prb_pathJoin(arena, globalClangSrcDir, out);
+// NOTE(khvorov) The workload the profile comes from: the test programs and compiling a slice of our own sources
+function void
+runPgoTraining(prb_Arena* arena, prb_Str rootdir, prb_Str buildDirName, prb_Str clangExe, prb_Str scratchDir) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
 
-    if (!prb_isFile(arena, outpath)) {
-        prb_Str cmd = prb_fmt(
-            arena,
-            "%.*s %.*s %.*s %.*s -o %.*s",
-            prb_LIT(tableGenExe),
-            prb_LIT(args),
-            prb_LIT(includePaths),
-            prb_LIT(inpath),
-            prb_LIT(outpath)
-        );
+    execCmd(arena, prb_fmt(arena, "%.*s/tests.sh --profile=%.*s", prb_LIT(rootdir), prb_LIT(buildDirName)));
 
-        execCmd(arena, cmd);
-
-        // NOTE(khvorov) Flatten includes in the output
-        prb_ReadEntireFileResult outread = prb_readEntireFile(arena, outpath);
-        prb_assert(outread.success);
-        prb_Str outstr = prb_strFromBytes(outread.content);
-
-        prb_Arena      flatoutArena = prb_createArenaFromArena(arena, prb_arenaFreeSize(arena) - 100 * prb_KILOBYTE);
-        prb_GrowingStr flatoutBuilder = prb_beginStr(&flatoutArena);
-        prb_StrScanner scanner = prb_createStrScanner(outstr);
-        while (prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR("#include \"")}, prb_StrScannerSide_AfterMatch)) {
-            prb_addStrSegment(&flatoutBuilder, "%.*s", prb_LIT(scanner.betweenLastMatches));
-            prb_assert(prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR("\"")}, prb_StrScannerSide_AfterMatch));
-            prb_Str includedFile = scanner.betweenLastMatches;
-            prb_Str pathFromRoot = {};
-            if (prb_strStartsWith(includedFile, prb_STR("clang"))) {
-                pathFromRoot = prb_pathJoin(arena, prb_STR("clang/include"), includedFile);
-            } else {
-                prb_assert(prb_strStartsWith(includedFile, prb_STR("llvm")));
-                pathFromRoot = prb_pathJoin(arena, prb_STR("llvm/include"), includedFile);
+    // NOTE(khvorov) The driver runs for the sampled sources take slots like the compiles after them
+    prb_Process* drivers = 0;
+    {
+        i32 srcCount = 0;
+        for (i32 srcIndex = 0; srcIndex < arrlen(globalAllFilesInSrc); srcIndex++) {
+            prb_Str srcpath = globalAllFilesInSrc[srcIndex];
+            if (prb_strEndsWith(srcpath, prb_STR(".cpp")) && (srcCount++ % 16) == 0) {
+                prb_Str driverOutPath = prb_pathJoin(arena, scratchDir, prb_fmt(arena, "driver%d.txt", (i32)arrlen(drivers)));
+                prb_assert(prb_removePathIfExists(arena, driverOutPath));
+                arrput(drivers, createDriverProcess(arena, srcpath, driverOutPath));
             }
-            prb_Str flatpath = replaceSeps(arena, pathFromRoot);
-            prb_addStrSegment(&flatoutBuilder, "#include \"%.*s\"", prb_LIT(flatpath));
         }
-        prb_addStrSegment(&flatoutBuilder, "%.*s", prb_LIT(scanner.afterMatch));
+    }
+    runProcessesInSlots(arena, drivers, arrlen(drivers));
 
-        prb_Str flatout = prb_endStr(&flatoutBuilder);
-        prb_assert(prb_writeEntireFile(arena, outpath, flatout.ptr, flatout.len));
+    prb_Process* compiles = 0;
+    for (i32 driverIndex = 0; driverIndex < arrlen(drivers); driverIndex++) {
+        prb_Str cmd = getCc1Cmd(arena, clangExe, drivers[driverIndex].spec.stderrFilepath);
+        if (cmd.len > 0) {
+            arrput(compiles, prb_createProcess(cmd, (prb_ProcessSpec) {}));
+        }
+    }
+    i32 failures = runProcessesInSlots(arena, compiles, arrlen(compiles));
+
+    // NOTE(khvorov) A TU the instrumented compiler can't handle is a bug but not one that should stop the profile
+    if (failures > 0) {
+        prb_writeToStdout(prb_fmt(arena, "pgo training: %d compiles failed\n", failures));
     }
 
+    arrfree(compiles);
+    arrfree(drivers);
+    prb_endTempMemory(temp);
+}
+
+// NOTE(khvorov) Raw profiles start with a 64-bit magic and then the version, whose top byte holds variant flags.
+// The version comes from the profile runtime of the compiler that built the instrumented clang, not from this tree.
+function u64
+getProfrawVersion(prb_Arena* arena, prb_Str path) {
+    prb_TempMemory           temp = prb_beginTempMemory(arena);
+    u64                      result = 0;
+    prb_ReadEntireFileResult raw = prb_readEntireFile(arena, path);
+    if (raw.success && raw.content.len >= 2 * (i32)sizeof(u64)) {
+        u64 magic = 0;
+        memcpy(&magic, raw.content.data, sizeof(magic));
+        memcpy(&result, raw.content.data + sizeof(magic), sizeof(result));
+        result = magic == PROFRAW_MAGIC_64 ? result & ~(0xffull << 56) : 0;
+    }
     prb_endTempMemory(temp);
+    return result;
+}
+
+// NOTE(khvorov) Profiles are merged by profdata-merge.exe built from this tree (see llvm_tools_llvm-profdata_merge.cpp)
+// when it can read them, otherwise by the llvm-profdata that came with the system clang
+function void
+runPgoBuild(prb_Arena* arena, prb_Str rootdir, prb_Str buildExe, prb_Str forwardArgs, prb_Str pgoGenDir, prb_Str pgoProfdataPath) {
+    execCmd(arena, prb_fmt(arena, "%.*s --profile=%s --pgo-stage=generate%.*s", prb_LIT(buildExe), globalProfile.name, prb_LIT(forwardArgs)));
+
+    // NOTE(khvorov) Tablegen was instrumented too
+    prb_Str rawDir = prb_pathJoin(arena, pgoGenDir, prb_STR("profraw"));
+    prb_assert(prb_clearDir(arena, rawDir));
+    prb_Str instrumentedClangExe = prb_pathJoin(arena, pgoGenDir, prb_STR("clang.exe"));
+    runPgoTraining(arena, rootdir, prb_getLastEntryInPath(pgoGenDir), instrumentedClangExe, pgoGenDir);
+
+    {
+        prb_Str* rawFiles = prb_getAllDirEntries(arena, rawDir, prb_Recursive_No);
+        prb_assert(arrlen(rawFiles) > 0);
+        prb_Str rawFilesStr = prb_stringsJoin(arena, rawFiles, arrlen(rawFiles), prb_STR(" "));
+        u64     rawVersion = getProfrawVersion(arena, rawFiles[0]);
+        prb_Str mergeCmd = {};
+        if (rawVersion == PROFRAW_VERSION_THIS_TREE) {
+            prb_Str mergeExe = prb_pathJoin(arena, pgoGenDir, prb_STR("profdata-merge.exe"));
+            mergeCmd = prb_fmt(arena, "%.*s %.*s %.*s", prb_LIT(mergeExe), prb_LIT(pgoProfdataPath), prb_LIT(rawFilesStr));
+        } else {
+            prb_writeToStdout(prb_fmt(arena, "pgo: raw profile version %llu, this tree reads %llu, merging with the system llvm-profdata\n", (unsigned long long)rawVersion, (unsigned long long)PROFRAW_VERSION_THIS_TREE));
+            mergeCmd = prb_fmt(arena, "llvm-profdata merge -o %.*s %.*s", prb_LIT(pgoProfdataPath), prb_LIT(rawFilesStr));
+        }
+        prb_writelnToStdout(arena, mergeCmd);
+        // NOTE(khvorov) The merger is instrumented like everything else in that build, its own profile is not wanted
+        prb_Process proc = prb_createProcess(mergeCmd, (prb_ProcessSpec) {.addEnv = prb_STR("LLVM_PROFILE_FILE=/dev/null")});
+        prb_assert(prb_launchProcesses(arena, &proc, 1, prb_Background_No));
+        arrfree(rawFiles);
+    }
+
+    execCmd(arena, prb_fmt(arena, "%.*s --profile=%s --pgo-stage=use%.*s", prb_LIT(buildExe), globalProfile.name, prb_LIT(forwardArgs)));
 }
 
 function void
@@ -407,59 +3749,56 @@ typedef struct TableGenArgs {
     char*   args;
 } TableGenArgs;
 
-int
-main() {
-    prb_TimeStart scriptStart = prb_timeStart();
-
-    prb_Arena  arena_ = prb_createArenaFromVmem(4ll * prb_GIGABYTE);
-    prb_Arena* arena = &arena_;
-
-    {
-        prb_Str rootdir = prb_getParentDir(arena, prb_STR(__FILE__));
-        globalLLVMRootDir = prb_pathJoin(arena, rootdir, prb_STR("llvm-project"));
-        globalClangSrcDir = prb_pathJoin(arena, rootdir, prb_STR("clang_src"));
-        globalBuildDir = prb_pathJoin(arena, rootdir, prb_STR("build"));
-    }
-
-    globalAllFilesInSrc = prb_getAllDirEntries(arena, globalClangSrcDir, prb_Recursive_No);
-
-    globalLastModTable = 0;
-    resolveFileLastMod(arena);
-
-    prb_createDirIfNotExists(arena, globalBuildDir);
-    prb_createDirIfNotExists(arena, globalClangSrcDir);
-
-    if (false) {
-        writeTargetDef(
-            arena,
-            prb_STR("llvm/include/llvm/Config/Targets.def.in"),
-            prb_STR("llvm_include_llvm_Config_Targets.def")
-        );
-
-        writeTargetDef(
-            arena,
-            prb_STR("llvm/include/llvm/Config/AsmPrinters.def.in"),
-            prb_STR("llvm_include_llvm_Config_AsmPrinters.def")
-        );
+// NOTE(khvorov) See globalCheckTableGen. One backend at a time, this is for checking and not for every build.
+function bool
+checkTableGenOutputs(prb_Arena* arena, TableGenArgs* tableGenArgs, i32 tableGenArgsCount) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    prb_Str        checkDir = prb_pathJoin(arena, globalBuildDir, prb_STR("tablegen-check"));
+    prb_assert(prb_clearDir(arena, checkDir));
 
-        writeTargetDef(
+    i32 mismatches = 0;
+    for (i32 argsIndex = 0; argsIndex < tableGenArgsCount; argsIndex++) {
+        TableGenArgs args = tableGenArgs[argsIndex];
+        prb_Str      separateOutpath = prb_pathJoin(arena, checkDir, prb_STR(args.out));
+        prb_Str      separateTempOutpath = prb_fmt(arena, "%.*s.raw", prb_LIT(separateOutpath));
+        prb_Str      cmd = prb_fmt(
             arena,
-            prb_STR("llvm/include/llvm/Config/AsmParsers.def.in"),
-            prb_STR("llvm_include_llvm_Config_AsmParsers.def")
+            "%.*s %s%.*s %.*s -o %.*s",
+            prb_LIT(args.exe),
+            args.args,
+            prb_LIT(getTableGenIncludeFlags(arena, prb_STR(args.include))),
+            prb_LIT(prb_pathJoin(arena, globalLLVMRootDir, prb_STR(args.in))),
+            prb_LIT(separateTempOutpath)
         );
+        prb_writelnToStdout(arena, cmd);
+        prb_Process proc = prb_createProcess(cmd, (prb_ProcessSpec) {});
+        bool        same = false;
+        if (prb_launchProcesses(arena, &proc, 1, prb_Background_No)) {
+            flattenTableGenIncludes(arena, separateTempOutpath, separateOutpath);
+            prb_ReadEntireFileResult separate = prb_readEntireFile(arena, separateOutpath);
+            prb_ReadEntireFileResult grouped = prb_readEntireFile(arena, prb_pathJoin(arena, globalClangSrcDir, prb_STR(args.out)));
+            same = separate.success && grouped.success && prb_streq(prb_strFromBytes(separate.content), prb_strFromBytes(grouped.content));
+        }
+        if (!same) {
+            prb_writelnToStdout(arena, prb_fmt(arena, "tablegen check: %s is different when its backend runs on its own (see %.*s)", args.out, prb_LIT(separateOutpath)));
+            mismatches += 1;
+        }
+    }
+    prb_writelnToStdout(arena, prb_fmt(arena, "tablegen check: %d of %d outputs differ", mismatches, tableGenArgsCount));
 
-        writeTargetDef(
-            arena,
-            prb_STR("llvm/include/llvm/Config/Disassemblers.def.in"),
-            prb_STR("llvm_include_llvm_Config_Disassemblers.def")
-        );
+    prb_endTempMemory(temp);
+    return mismatches == 0;
+}
 
-        writeTargetDef(
-            arena,
-            prb_STR("llvm/include/llvm/Config/TargetMCAs.def.in"),
-            prb_STR("llvm_include_llvm_Config_TargetMCAs.def")
-        );
+// NOTE(khvorov) Everything after setup, once per build. In watch mode the steps from the last build are all either done or failed.
+function bool
+buildAll(prb_Arena* arena) {
+    for (i32 stepIndex = 0; stepIndex < arrlen(globalSteps); stepIndex++) {
+        arrfree(globalSteps[stepIndex].dependents);
     }
+    arrfree(globalSteps);
+
+    refreshFileHashes(arena);
 
     // NOTE(khvorov) Static libs we need for tablegen
     CompileStaticLibResult supportLibFile = compileStaticLib(arena, prb_STR("llvm_lib_Support"));
@@ -471,6 +3810,9 @@ main() {
     // NOTE(khvorov) Compile just the table gen
     prb_Str llvmTableGenExe = compileExe(arena, prb_STR("llvm_utils_TableGen"), depsOfTablegen, prb_arrayCount(depsOfTablegen), prb_STR("llvmTableGen"));
     prb_Str clangTableGenExe = compileExe(arena, prb_STR("clang_utils_TableGen"), depsOfTablegen, prb_arrayCount(depsOfTablegen), prb_STR("clangTableGen"));
+    if (!runSteps(arena)) {
+        return false;
+    }
 
     // NOTE(khvorov) Generate the files we need table gen for
     TableGenArgs tableGenArgs[] = {
@@ -578,25 +3920,79 @@ main() {
         {clangTableGenExe, "clang/lib/AST/Interp/Opcodes.td", "clang_lib_AST_Interp_Opcodes.inc", "clang/include", "-gen-clang-opcodes"},
     };
 
+    // NOTE(khvorov) The tablegen executables were just built
+    refreshFileHashes(arena);
     {
-        prb_TempMemory   temp = prb_beginTempMemory(arena);
-        RunTableGenSpec* tableGenSpecs = prb_arenaAllocArray(arena, RunTableGenSpec, prb_arrayCount(tableGenArgs));
-        prb_Job*         jobs = 0;
+        prb_Str tableGenDir = prb_pathJoin(arena, globalBuildDir, prb_STR("tablegen"));
+        prb_assert(prb_createDirIfNotExists(arena, tableGenDir));
+
+        // NOTE(khvorov) Group by what tablegen has to parse
+        for (i32 specIndex = 0; specIndex < arrlen(globalTableGenSpecs); specIndex++) {
+            arrfree(globalTableGenSpecs[specIndex].outs);
+            arrfree(globalTableGenSpecs[specIndex].args);
+        }
+        arrfree(globalTableGenSpecs);
         for (i32 ind = 0; ind < prb_arrayCount(tableGenArgs); ind++) {
             TableGenArgs args = tableGenArgs[ind];
-            tableGenSpecs[ind] = (RunTableGenSpec) {args.exe, prb_STR(args.in), prb_STR(args.out), prb_STR(args.include), prb_STR(args.args)};
-            intptr_t memsize = 20 * prb_MEGABYTE;
-            if (prb_strStartsWith(prb_STR(args.out), prb_STR("X86Gen"))) {
-                memsize *= 4;
+            i32          specIndex = 0;
+            for (; specIndex < arrlen(globalTableGenSpecs); specIndex++) {
+                RunTableGenSpec* spec = globalTableGenSpecs + specIndex;
+                if (prb_streq(spec->tableGenExe, args.exe) && prb_streq(spec->in, prb_STR(args.in)) && prb_streq(spec->includes, prb_STR(args.include))) {
+                    break;
+                }
+            }
+            if (specIndex == arrlen(globalTableGenSpecs)) {
+                prb_Str backendsFile = prb_fmt(arena, "%.*s/%d_%.*s.backends", prb_LIT(tableGenDir), specIndex, prb_LIT(replaceSeps(arena, prb_STR(args.in))));
+                RunTableGenSpec spec = {args.exe, prb_STR(args.in), prb_STR(args.include), tableGenDir, backendsFile, 0, 0};
+                arrput(globalTableGenSpecs, spec);
+            }
+
+            // NOTE(khvorov) Regenerate when the output is missing or the tablegen binary, the backend options,
+            // the .td file or anything it includes changed
+            RunTableGenSpec* spec = globalTableGenSpecs + specIndex;
+            prb_Str          outpath = prb_pathJoin(arena, globalClangSrcDir, prb_STR(args.out));
+            prb_Str          cmdKey = getTableGenCmdKey(arena, spec, prb_STR(args.args));
+            prb_FileHash     inputHash = getTableGenInputHash(arena, spec->tableGenExe, outpath);
+            i32              entryIndex = shgeti(globalBuildLog, (char*)prb_strGetNullTerminated(arena, outpath));
+            bool             upToDate = prb_isFile(arena, outpath) && inputHash.valid && entryIndex != -1
+                && globalBuildLog[entryIndex].value.cmdHash == hashStr(cmdKey) && globalBuildLog[entryIndex].value.inputHash == inputHash.hash;
+            if (!upToDate) {
+                arrput(spec->outs, prb_STR(args.out));
+                arrput(spec->args, prb_STR(args.args));
             }
-            prb_Job job = prb_createJob(runTableGen, tableGenSpecs + ind, arena, memsize);
-            arrput(jobs, job);
         }
-        prb_assert(prb_launchJobs(jobs, arrlen(jobs), prb_Background_Yes));
-        prb_assert(prb_waitForJobs(jobs, arrlen(jobs)));
-        prb_endTempMemory(temp);
+
+        // NOTE(khvorov) Tablegen goes through the same scheduler as everything else. Before there is a record of how long
+        // a group takes, the instruction selector and asm matcher backends are the ones worth starting first
+        // (the X86 ones take several seconds each).
+        for (i32 specIndex = 0; specIndex < arrlen(globalTableGenSpecs); specIndex++) {
+            RunTableGenSpec* spec = globalTableGenSpecs + specIndex;
+            if (arrlen(spec->outs) > 0) {
+                u64 costHint = 1;
+                for (i32 outIndex = 0; outIndex < arrlen(spec->outs); outIndex++) {
+                    prb_Str heavyBackends[] = {prb_STR("-gen-dag-isel"), prb_STR("-gen-global-isel"), prb_STR("-gen-asm-matcher")};
+                    for (i32 heavyIndex = 0; heavyIndex < prb_arrayCount(heavyBackends); heavyIndex++) {
+                        if (prb_strFind(spec->args[outIndex], (prb_StrFindSpec) {.pattern = heavyBackends[heavyIndex]}).found) {
+                            costHint += 10;
+                        }
+                    }
+                }
+                prb_Str cmd = getTableGenCmd(arena, spec);
+                i32     stepIndex = addStep(StepKind_TableGen, cmd, prb_pathJoin(arena, globalLLVMRootDir, spec->in), spec->backendsFile, 0, 0);
+                globalSteps[stepIndex].costHint = costHint;
+                globalSteps[stepIndex].tableGenSpec = specIndex;
+            }
+        }
+        if (!runSteps(arena)) {
+            return false;
+        }
+        if (globalCheckTableGen && !checkTableGenOutputs(arena, tableGenArgs, prb_arrayCount(tableGenArgs))) {
+            return false;
+        }
     }
 
+    refreshFileHashes(arena);
+
     // NOTE(khvorov) Compile the actual compiler
     CompileStaticLibResult deps[] = {
         compileStaticLib(arena, prb_STR("clang_lib_FrontendTool")),
@@ -644,6 +4040,259 @@ main() {
     };
 
     compileExe(arena, prb_STR("clang_tools_driver"), deps, prb_arrayCount(deps), prb_STR("clang"));
+    if (globalPgoStage == PgoStage_Generate) {
+        compileExe(arena, prb_STR("llvm_tools_llvm-profdata"), deps, prb_arrayCount(deps), prb_STR("profdata-merge"));
+    }
+    bool result = runSteps(arena);
+    pruneObjCache(arena);
+    return result;
+}
+
+function bool
+isWatchedSrcName(prb_Str name) {
+    bool result = isSrcFile(name) || prb_strEndsWith(name, prb_STR(".h")) || prb_strEndsWith(name, prb_STR(".inc")) || prb_strEndsWith(name, prb_STR(".def"));
+    return result;
+}
+
+function void
+watchAndRebuild(prb_Arena* arena) {
+    int inotifyFd = inotify_init1(IN_CLOEXEC);
+    prb_assert(inotifyFd != -1);
+    u32 mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+    prb_assert(inotify_add_watch(inotifyFd, prb_strGetNullTerminated(arena, globalClangSrcDir), mask) != -1);
+
+    // NOTE(khvorov) Paths that go into the listing outlive the cycle that found them, everything else is dropped after each cycle.
+    // A rescan replaces the whole listing so it starts this arena over.
+    prb_Arena listingArena = prb_createArenaFromArena(arena, 64 * prb_MEGABYTE);
+
+    for (;;) {
+        prb_TempMemory cycleTemp = prb_beginTempMemory(arena);
+        prb_writeToStdout(prb_fmt(arena, "watching %.*s\n", prb_LIT(globalClangSrcDir)));
+
+        // NOTE(khvorov) Editors save through temp files and renames so the batch only ends once things have been quiet for a bit
+        prb_Str* touched = 0;
+        bool     overflowed = false;
+        for (i32 timeoutMs = -1;;) {
+            struct pollfd pollSpec = {.fd = inotifyFd, .events = POLLIN};
+            if (poll(&pollSpec, 1, timeoutMs) <= 0) {
+                break;
+            }
+            _Alignas(struct inotify_event) char buf[64 * 1024];
+            ssize_t bytesRead = read(inotifyFd, buf, sizeof(buf));
+            prb_assert(bytesRead > 0);
+            for (ssize_t offset = 0; offset < bytesRead;) {
+                struct inotify_event* event = (struct inotify_event*)(buf + offset);
+                overflowed = overflowed || (event->mask & IN_Q_OVERFLOW);
+                if (event->len > 0 && isWatchedSrcName(prb_STR(event->name))) {
+                    arrput(touched, prb_pathJoin(arena, globalClangSrcDir, prb_STR(event->name)));
+                    timeoutMs = 50;
+                }
+                offset += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        if (overflowed) {
+            shfree(globalFileStats);
+            sh_new_strdup(globalFileStats);
+            arrfree(globalAllFilesInSrc);
+            listingArena.used = 0;
+            globalAllFilesInSrc = prb_getAllDirEntries(&listingArena, globalClangSrcDir, prb_Recursive_No);
+        }
+
+        // NOTE(khvorov) Only the files that came or went change the listing, no rescan
+        for (i32 touchedIndex = 0; touchedIndex < arrlen(touched); touchedIndex++) {
+            prb_Str path = touched[touchedIndex];
+            forgetFileStat(arena, path);
+            i32 listingIndex = 0;
+            for (; listingIndex < arrlen(globalAllFilesInSrc) && !prb_streq(globalAllFilesInSrc[listingIndex], path); listingIndex++) {}
+            bool listed = listingIndex < arrlen(globalAllFilesInSrc);
+            bool exists = prb_isFile(arena, path);
+            if (exists && !listed) {
+                arrput(globalAllFilesInSrc, prb_fmt(&listingArena, "%.*s", prb_LIT(path)));
+            } else if (!exists && listed) {
+                arrdel(globalAllFilesInSrc, listingIndex);
+            }
+        }
+
+        if (arrlen(touched) > 0 || overflowed) {
+            prb_TimeStart buildStart = prb_timeStart();
+            bool          buildOk = buildAll(arena);
+            prb_writeToStdout(prb_fmt(arena, "%s: %.2fms\n", buildOk ? "total" : "failed", prb_getMsFrom(buildStart)));
+        }
+        arrfree(touched);
+        prb_endTempMemory(cycleTemp);
+    }
+}
+
+int
+main() {
+    prb_TimeStart scriptStart = prb_timeStart();
+
+    prb_Arena  arena_ = prb_createArenaFromVmem(4ll * prb_GIGABYTE);
+    prb_Arena* arena = &arena_;
+
+    {
+        prb_Str rootdir = prb_getParentDir(arena, prb_STR(__FILE__));
+        globalRootDir = rootdir;
+        prb_assert(prb_pathIsAbsolute(globalRootDir));
+        globalLLVMRootDir = prb_pathJoin(arena, rootdir, prb_STR("llvm-project"));
+        globalClangSrcDir = prb_pathJoin(arena, rootdir, prb_STR("clang_src"));
+        globalBuildDir = prb_pathJoin(arena, rootdir, prb_STR("build"));
+        globalObjCacheDir = prb_pathJoin(arena, rootdir, prb_STR("objcache"));
+    }
+
+    globalProfile = globalProfiles[0];
+    bool    runPgo = false;
+    prb_Str buildExe = {};
+    // NOTE(khvorov) Everything --pgo passes on to the builds it runs
+    prb_Str forwardArgs = {};
+    {
+        prb_Str* args = prb_getCmdArgs(arena);
+        buildExe = args[0];
+        prb_Str* forward = 0;
+        for (i32 argIndex = 1; argIndex < arrlen(args); argIndex++) {
+            prb_Str arg = args[argIndex];
+            if (!prb_streq(arg, prb_STR("--pgo")) && !prb_strStartsWith(arg, prb_STR("--profile="))) {
+                arrput(forward, prb_fmt(arena, " %.*s", prb_LIT(arg)));
+            }
+
+            if (prb_streq(arg, prb_STR("--hash"))) {
+                globalHashMode = true;
+            } else if (prb_streq(arg, prb_STR("--check-tablegen"))) {
+                globalCheckTableGen = true;
+            } else if (prb_streq(arg, prb_STR("--no-cache"))) {
+                globalObjCacheDir = prb_STR("");
+            } else if (prb_streq(arg, prb_STR("--watch"))) {
+                globalWatchMode = true;
+            } else if (prb_streq(arg, prb_STR("--dwp"))) {
+                globalDwpMode = true;
+            } else if (prb_streq(arg, prb_STR("--pch"))) {
+                globalPchMode = true;
+            } else if (prb_streq(arg, prb_STR("--unity"))) {
+                globalUnitySize = 8;
+            } else if (prb_strStartsWith(arg, prb_STR("--unity="))) {
+                prb_ParseUintResult size = prb_parseUint(prb_strSlice(arg, prb_STR("--unity=").len, arg.len), 10);
+                prb_assert(size.success);
+                globalUnitySize = (i32)size.number;
+            } else if (prb_streq(arg, prb_STR("--pgo"))) {
+                runPgo = true;
+            } else if (prb_streq(arg, prb_STR("--pgo-stage=generate"))) {
+                globalPgoStage = PgoStage_Generate;
+            } else if (prb_streq(arg, prb_STR("--pgo-stage=use"))) {
+                globalPgoStage = PgoStage_Use;
+            } else if (prb_strStartsWith(arg, prb_STR("--profile="))) {
+                prb_Str name = prb_strSlice(arg, prb_STR("--profile=").len, arg.len);
+                bool    found = false;
+                for (i32 profileIndex = 0; profileIndex < prb_arrayCount(globalProfiles) && !found; profileIndex++) {
+                    if (prb_streq(name, prb_STR(globalProfiles[profileIndex].name))) {
+                        globalProfile = globalProfiles[profileIndex];
+                        found = true;
+                    }
+                }
+                prb_assert(found);
+            } else if (prb_strStartsWith(arg, prb_STR("--remote-cache="))) {
+                prb_Str url = prb_strSlice(arg, prb_STR("--remote-cache=").len, arg.len);
+                prb_assert(parseRemoteCacheUrl(url, &globalRemoteCache));
+            } else {
+                prb_writelnToStdout(arena, prb_fmt(arena, "unrecognized argument: %.*s", prb_LIT(arg)));
+                prb_assert(!"unrecognized argument");
+            }
+        }
+        forwardArgs = prb_stringsJoin(arena, forward, arrlen(forward), prb_STR(""));
+        arrfree(forward);
+        arrfree(args);
+    }
+    prb_assert(!(runPgo && globalPgoStage != PgoStage_None));
+    // NOTE(khvorov) The generate stage would get --watch too and never hand control back
+    prb_assert(!(runPgo && globalWatchMode));
+    prb_assert(!globalDwpMode || globalProfile.splitDwarf);
+
+    globalJobserver = prb_joinJobserver(arena);
+    if (!globalJobserver.valid) {
+        prb_CoreCountResult cores = prb_getCoreCount(arena);
+        prb_assert(cores.success);
+        globalJobserver = prb_createJobserver(arena, cores.cores);
+    }
+
+    prb_createDirIfNotExists(arena, globalBuildDir);
+    prb_Str pgoGenDir = prb_pathJoin(arena, globalBuildDir, prb_fmt(arena, "%s-pgogen", globalProfile.name));
+    prb_Str pgoProfdataPath = prb_pathJoin(arena, pgoGenDir, prb_STR("clang.profdata"));
+    switch (globalPgoStage) {
+        case PgoStage_None: {
+            globalBuildDir = prb_pathJoin(arena, globalBuildDir, prb_STR(globalProfile.name));
+        } break;
+        case PgoStage_Generate: {
+            globalBuildDir = pgoGenDir;
+            globalPgoFlags = prb_fmt(arena, "-fprofile-generate=%.*s/profraw ", prb_LIT(pgoGenDir));
+        } break;
+        case PgoStage_Use: {
+            globalBuildDir = prb_pathJoin(arena, globalBuildDir, prb_fmt(arena, "%s-pgo", globalProfile.name));
+            prb_assert(prb_isFile(arena, pgoProfdataPath));
+            globalPgoProfdataPath = pgoProfdataPath;
+            globalPgoFlags = prb_fmt(
+                arena,
+                "-fprofile-use=%.*s -Wno-profile-instr-unprofiled -Wno-profile-instr-out-of-date -Wno-backend-plugin ",
+                prb_LIT(pgoProfdataPath)
+            );
+        } break;
+    }
+
+    globalAllFilesInSrc = prb_getAllDirEntries(arena, globalClangSrcDir, prb_Recursive_No);
+
+    if (runPgo) {
+        runPgoBuild(arena, prb_getParentDir(arena, globalClangSrcDir), buildExe, forwardArgs, pgoGenDir, pgoProfdataPath);
+        prb_writeToStdout(prb_fmt(arena, "total: %.2fms\n", prb_getMsFrom(scriptStart)));
+        prb_destroyJobserver(arena, &globalJobserver);
+        return 0;
+    }
+
+    prb_createDirIfNotExists(arena, globalBuildDir);
+    globalBuildLogPath = prb_pathJoin(arena, globalBuildDir, prb_STR(".buildlog"));
+    loadBuildLog(arena);
+    globalDepsLogPath = prb_pathJoin(arena, globalBuildDir, prb_STR(".depslog"));
+    loadDepsLog(arena);
+    globalHashCachePath = prb_pathJoin(arena, globalBuildDir, prb_STR(".hashcache"));
+    loadHashCache(arena);
+    prb_createDirIfNotExists(arena, globalClangSrcDir);
+
+
+    if (false) {
+        writeTargetDef(
+            arena,
+            prb_STR("llvm/include/llvm/Config/Targets.def.in"),
+            prb_STR("llvm_include_llvm_Config_Targets.def")
+        );
+
+        writeTargetDef(
+            arena,
+            prb_STR("llvm/include/llvm/Config/AsmPrinters.def.in"),
+            prb_STR("llvm_include_llvm_Config_AsmPrinters.def")
+        );
+
+        writeTargetDef(
+            arena,
+            prb_STR("llvm/include/llvm/Config/AsmParsers.def.in"),
+            prb_STR("llvm_include_llvm_Config_AsmParsers.def")
+        );
+
+        writeTargetDef(
+            arena,
+            prb_STR("llvm/include/llvm/Config/Disassemblers.def.in"),
+            prb_STR("llvm_include_llvm_Config_Disassemblers.def")
+        );
 
+        writeTargetDef(
+            arena,
+            prb_STR("llvm/include/llvm/Config/TargetMCAs.def.in"),
+            prb_STR("llvm_include_llvm_Config_TargetMCAs.def")
+        );
+    }
+
+    bool buildOk = buildAll(arena);
     prb_writeToStdout(prb_fmt(arena, "total: %.2fms\n", prb_getMsFrom(scriptStart)));
+    if (globalWatchMode) {
+        watchAndRebuild(arena);
+    }
+    prb_destroyJobserver(arena, &globalJobserver);
+    prb_assert(buildOk);
 }
@@ -0,0 +1,224 @@
+#include "cbuild.h"
+
+#include <stdio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define function static
+#define global_variable static
+
+typedef int32_t  i32;
+typedef int64_t  i64;
+typedef uint8_t  u8;
+
+// NOTE(khvorov) Stand-in for a Bazel-style HTTP remote cache so build.c --remote-cache can be tried locally.
+// GET/PUT [/anything]/ac/<key> and [/anything]/cas/<key>, stored as <dataDir>/ac/<key> and <dataDir>/cas/<key>.
+// One thread per connection, connections are kept alive. Keys are not checked against the content.
+// Usage: cacheserver.sh [port] [data dir]
+global_variable prb_Str globalDataDir;
+
+function bool
+sendAll(int fd, const void* data, i64 len) {
+    bool result = true;
+    for (i64 sent = 0; sent < len && result;) {
+        ssize_t sentNow = send(fd, (const u8*)data + sent, len - sent, MSG_NOSIGNAL);
+        result = sentNow > 0;
+        sent += sentNow;
+    }
+    return result;
+}
+
+function bool
+sendStatus(prb_Arena* arena, int fd, prb_Str status) {
+    prb_Str response = prb_fmt(arena, "HTTP/1.1 %.*s\r\nContent-Length: 0\r\n\r\n", prb_LIT(status));
+    bool    result = sendAll(fd, response.ptr, response.len);
+    return result;
+}
+
+// NOTE(khvorov) Only ac/<key> and cas/<key> where key is alphanumeric, nothing else can escape the data dir
+function prb_Str
+getStoragePath(prb_Arena* arena, prb_Str urlPath) {
+    prb_Str result = {};
+    prb_Str kinds[] = {prb_STR("/ac/"), prb_STR("/cas/")};
+    for (i32 kindIndex = 0; kindIndex < prb_arrayCount(kinds) && result.len == 0; kindIndex++) {
+        prb_StrScanner scanner = prb_createStrScanner(urlPath);
+        if (prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = kinds[kindIndex], .direction = prb_StrDirection_FromEnd}, prb_StrScannerSide_AfterMatch)) {
+            prb_Str key = scanner.afterMatch;
+            bool    keyOk = key.len > 0;
+            for (i32 charIndex = 0; charIndex < key.len && keyOk; charIndex++) {
+                char ch = key.ptr[charIndex];
+                keyOk = (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+            }
+            if (keyOk) {
+                prb_Str kind = prb_strSlice(kinds[kindIndex], 1, kinds[kindIndex].len - 1);
+                result = prb_fmt(arena, "%.*s/%.*s/%.*s", prb_LIT(globalDataDir), prb_LIT(kind), prb_LIT(key));
+            }
+        }
+    }
+    return result;
+}
+
+function void*
+serveConnection(void* data) {
+    int       fd = (int)(intptr_t)data;
+    prb_Arena arena_ = prb_createArenaFromVmem(prb_MEGABYTE);
+    prb_Arena* arena = &arena_;
+    u8        buf[64 * 1024];
+    i32       bufLen = 0;
+    bool      ok = true;
+
+    while (ok) {
+        prb_TempMemory temp = prb_beginTempMemory(arena);
+
+        i32 headerLen = 0;
+        while (ok && headerLen == 0) {
+            for (i32 bufIndex = 3; bufIndex < bufLen && headerLen == 0; bufIndex++) {
+                if (prb_memeq(buf + bufIndex - 3, "\r\n\r\n", 4)) {
+                    headerLen = bufIndex + 1;
+                }
+            }
+            if (headerLen == 0) {
+                ssize_t readNow = bufLen < (i32)sizeof(buf) ? recv(fd, buf + bufLen, sizeof(buf) - bufLen, 0) : -1;
+                ok = readNow > 0;
+                bufLen += readNow;
+            }
+        }
+
+        prb_Str method = {};
+        prb_Str urlPath = {};
+        i64     contentLength = 0;
+        if (ok) {
+            prb_StrScanner lineScanner = prb_createStrScanner((prb_Str) {(const char*)buf, headerLen});
+            for (i32 lineIndex = 0; prb_strScannerMove(&lineScanner, (prb_StrFindSpec) {.mode = prb_StrFindMode_LineBreak}, prb_StrScannerSide_AfterMatch); lineIndex++) {
+                prb_Str line = prb_fmt(arena, "%.*s", prb_LIT(lineScanner.betweenLastMatches));
+                if (lineIndex == 0) {
+                    prb_StrScanner partScanner = prb_createStrScanner(line);
+                    if (prb_strScannerMove(&partScanner, (prb_StrFindSpec) {.pattern = prb_STR(" ")}, prb_StrScannerSide_AfterMatch)) {
+                        method = partScanner.betweenLastMatches;
+                        if (prb_strScannerMove(&partScanner, (prb_StrFindSpec) {.pattern = prb_STR(" ")}, prb_StrScannerSide_AfterMatch)) {
+                            urlPath = partScanner.betweenLastMatches;
+                        }
+                    }
+                } else {
+                    for (i32 charIndex = 0; charIndex < line.len; charIndex++) {
+                        char ch = line.ptr[charIndex];
+                        ((char*)line.ptr)[charIndex] = ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+                    }
+                    prb_Str lengthName = prb_STR("content-length:");
+                    if (prb_strStartsWith(line, lengthName)) {
+                        prb_ParseUintResult parsed = prb_parseUint(prb_strTrim(prb_strSlice(line, lengthName.len, line.len)), 10);
+                        ok = parsed.success;
+                        contentLength = (i64)parsed.number;
+                    }
+                }
+            }
+            ok = ok && method.len > 0 && urlPath.len > 0;
+        }
+
+        if (ok) {
+            prb_Str storagePath = getStoragePath(arena, urlPath);
+            i64     bodyInBuf = prb_min(bufLen - headerLen, contentLength);
+            i64     bodyLeft = contentLength - bodyInBuf;
+
+            if (prb_streq(method, prb_STR("PUT")) && storagePath.len > 0) {
+                // NOTE(khvorov) Readers only ever see complete files
+                prb_Str tempPath = prb_fmt(arena, "%.*s.tmp%d", prb_LIT(storagePath), fd);
+                int     fileFd = open(prb_strGetNullTerminated(arena, tempPath), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                ok = fileFd != -1 && write(fileFd, buf + headerLen, bodyInBuf) == bodyInBuf;
+                while (ok && bodyLeft > 0) {
+                    ssize_t readNow = recv(fd, buf, prb_min((i64)sizeof(buf), bodyLeft), 0);
+                    ok = readNow > 0 && write(fileFd, buf, readNow) == readNow;
+                    bodyLeft -= readNow;
+                }
+                if (fileFd != -1) {
+                    close(fileFd);
+                }
+                if (ok && rename(prb_strGetNullTerminated(arena, tempPath), prb_strGetNullTerminated(arena, storagePath)) == 0) {
+                    ok = sendStatus(arena, fd, prb_STR("200 OK"));
+                } else {
+                    unlink(prb_strGetNullTerminated(arena, tempPath));
+                    ok = ok && sendStatus(arena, fd, prb_STR("500 Internal Server Error"));
+                }
+            } else {
+                // NOTE(khvorov) Skip whatever body came with anything else
+                while (ok && bodyLeft > 0) {
+                    ssize_t readNow = recv(fd, buf, prb_min((i64)sizeof(buf), bodyLeft), 0);
+                    ok = readNow > 0;
+                    bodyLeft -= readNow;
+                }
+
+                if (ok && (prb_streq(method, prb_STR("GET")) || prb_streq(method, prb_STR("HEAD"))) && storagePath.len > 0) {
+                    int         fileFd = open(prb_strGetNullTerminated(arena, storagePath), O_RDONLY);
+                    struct stat fileStat = {};
+                    if (fileFd != -1 && fstat(fileFd, &fileStat) == 0) {
+                        prb_Str header = prb_fmt(arena, "HTTP/1.1 200 OK\r\nContent-Length: %lld\r\n\r\n", (long long)fileStat.st_size);
+                        ok = sendAll(fd, header.ptr, header.len);
+                        if (prb_streq(method, prb_STR("GET"))) {
+                            u8 fileBuf[64 * 1024];
+                            for (i64 fileSent = 0; ok && fileSent < fileStat.st_size;) {
+                                ssize_t readNow = read(fileFd, fileBuf, sizeof(fileBuf));
+                                ok = readNow > 0 && sendAll(fd, fileBuf, readNow);
+                                fileSent += readNow;
+                            }
+                        }
+                    } else {
+                        ok = sendStatus(arena, fd, prb_STR("404 Not Found"));
+                    }
+                    if (fileFd != -1) {
+                        close(fileFd);
+                    }
+                } else if (ok) {
+                    ok = sendStatus(arena, fd, prb_STR("400 Bad Request"));
+                }
+            }
+
+            // NOTE(khvorov) Next request may have come in with this one
+            i32 consumed = headerLen + (i32)bodyInBuf;
+            prb_memmove(buf, buf + consumed, bufLen - consumed);
+            bufLen -= consumed;
+        }
+
+        prb_endTempMemory(temp);
+    }
+
+    close(fd);
+    munmap(arena->base, arena->size);
+    return 0;
+}
+
+int
+main() {
+    prb_Arena  arena_ = prb_createArenaFromVmem(prb_MEGABYTE);
+    prb_Arena* arena = &arena_;
+
+    prb_Str* args = prb_getCmdArgs(arena);
+    prb_Str  port = arrlen(args) > 1 ? args[1] : prb_STR("8080");
+    globalDataDir = arrlen(args) > 2 ? args[2] : prb_pathJoin(arena, prb_getParentDir(arena, prb_STR(__FILE__)), prb_STR("cacheserver_data"));
+    prb_assert(prb_createDirIfNotExists(arena, globalDataDir));
+    prb_assert(prb_createDirIfNotExists(arena, prb_pathJoin(arena, globalDataDir, prb_STR("ac"))));
+    prb_assert(prb_createDirIfNotExists(arena, prb_pathJoin(arena, globalDataDir, prb_STR("cas"))));
+
+    prb_ParseUintResult portNumber = prb_parseUint(port, 10);
+    prb_assert(portNumber.success && portNumber.number > 0 && portNumber.number < 65536);
+
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    prb_assert(listenFd != -1);
+    int reuse = 1;
+    prb_assert(setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons((uint16_t)portNumber.number), .sin_addr = {.s_addr = htonl(INADDR_ANY)}};
+    prb_assert(bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    prb_assert(listen(listenFd, 128) == 0);
+    prb_writeToStdout(prb_fmt(arena, "serving %.*s on port %.*s\n", prb_LIT(globalDataDir), prb_LIT(port)));
+
+    for (;;) {
+        int connFd = accept(listenFd, 0, 0);
+        if (connFd != -1) {
+            pthread_t thread;
+            if (pthread_create(&thread, 0, serveConnection, (void*)(intptr_t)connFd) == 0) {
+                pthread_detach(thread);
+            } else {
+                close(connFd);
+            }
+        }
+    }
+}
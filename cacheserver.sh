@@ -0,0 +1,3 @@
+SCRIPT_DIR=$(dirname "$0")
+RUN_BIN=$SCRIPT_DIR/cacheserver.exe
+clang -g -Wall -Wextra -Wfatal-errors $SCRIPT_DIR/cacheserver.c -o $RUN_BIN -lpthread && $RUN_BIN $@
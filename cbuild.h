@@ -108,6 +108,7 @@ for (prb_Iter iter = prb_createIter(); prb_iterNext(&iter) == prb_Success;) {
 #if prb_PLATFORM_WINDOWS
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
 
 #elif prb_PLATFORM_LINUX
 
@@ -123,6 +124,9 @@ for (prb_Iter iter = prb_createIter(); prb_iterNext(&iter) == prb_Success;) {
 #include <time.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
 
 #endif
 
@@ -333,18 +337,38 @@ typedef enum prb_ProcessStatus {
     prb_ProcessStatus_CompletedFailed,
 } prb_ProcessStatus;
 
+// Filled in once the process has been waited on
+typedef struct prb_ProcessStats {
+    int32_t exitCode;
+    float   wallMs;
+    float   userMs;
+    float   sysMs;
+    int64_t maxRssBytes;
+} prb_ProcessStats;
+
 typedef struct prb_Process {
     prb_Str           cmd;
     prb_ProcessSpec   spec;
     prb_ProcessStatus status;
+    prb_TimeStart     launchTime;
+    prb_ProcessStats  stats;
 
 #if prb_PLATFORM_WINDOWS
     PROCESS_INFORMATION processInfo;
 #elif prb_PLATFORM_LINUX
     pid_t     pid;
+    // NOTE(khvorov) -1 when the kernel doesn't support pidfd_open
+    int       pidfd;
 #endif
 } prb_Process;
 
+typedef struct prb_WaitForAnyProcessResult {
+    bool    success;
+    int32_t index;
+    // NOTE(khvorov) Only set by prb_waitForAnyProcessOrJob, -1 unless it was a job that finished
+    int32_t jobIndex;
+} prb_WaitForAnyProcessResult;
+
 typedef enum prb_StrFindMode {
     prb_StrFindMode_Exact,
     prb_StrFindMode_AnyChar,
@@ -422,6 +446,14 @@ typedef struct prb_Multitime {
     uint64_t timeEarliest;
 } prb_Multitime;
 
+// Enough to tell whether a file changed without reading it
+typedef struct prb_FileStat {
+    bool     valid;
+    uint64_t lastMod;
+    uint64_t size;
+    uint64_t inode;
+} prb_FileStat;
+
 typedef struct prb_FileHash {
     bool     valid;
     uint64_t hash;
@@ -446,6 +478,8 @@ typedef struct prb_Job {
     DWORD  threadid;
 #elif prb_PLATFORM_LINUX
     pthread_t threadid;
+    // NOTE(khvorov) Readable once a background job is done, so it can be polled together with pidfds. -1 otherwise
+    int       donefd;
 #else
 #error unimplemented
 #endif
@@ -498,6 +532,18 @@ typedef struct prb_CoreCountResult {
     int32_t cores;
 } prb_CoreCountResult;
 
+// NOTE(khvorov) GNU make jobserver. Every process gets one job for free, every job past that needs a token from the jobserver.
+// Tokens are bytes in a pipe or a fifo and have to be written back exactly as they were read.
+typedef struct prb_Jobserver {
+    bool    valid;
+    // NOTE(khvorov) Our own non-blocking open of the pipe/fifo so that nobody else's reads turn non-blocking
+    int32_t fd;
+    // NOTE(khvorov) stb_ds array of the tokens we hold
+    char*   tokens;
+    // NOTE(khvorov) Set when we made the fifo ourselves
+    prb_Str ownedFifoPath;
+} prb_Jobserver;
+
 // SECTION Memory
 prb_PUBLICDEC bool           prb_memeq(const void* ptr1, const void* ptr2, int32_t bytes);
 prb_PUBLICDEC int32_t        prb_getOffsetForAlignment(void* ptr, int32_t align);
@@ -538,6 +584,8 @@ prb_PUBLICDEC prb_Multitime            prb_createMultitime(void);
 prb_PUBLICDEC void                     prb_multitimeAdd(prb_Multitime* multitime, prb_FileTimestamp newTimestamp);
 prb_PUBLICDEC prb_ReadEntireFileResult prb_readEntireFile(prb_Arena* arena, prb_Str path);
 prb_PUBLICDEC prb_Status               prb_writeEntireFile(prb_Arena* arena, prb_Str path, const void* content, int32_t contentLen);
+prb_PUBLICDEC prb_FileStat             prb_getFileStat(prb_Arena* arena, prb_Str path);
+prb_PUBLICDEC uint64_t                 prb_hashBytes(const void* data, intptr_t len, uint64_t seed);
 prb_PUBLICDEC prb_FileHash             prb_getFileHash(prb_Arena* arena, prb_Str filepath);
 
 // SECTION Strings
@@ -578,7 +626,14 @@ prb_PUBLICDEC prb_Status          prb_allowExecutionOnCores(prb_Arena* arena, in
 prb_PUBLICDEC prb_Process         prb_createProcess(prb_Str cmd, prb_ProcessSpec spec);
 prb_PUBLICDEC prb_Status          prb_launchProcesses(prb_Arena* arena, prb_Process* procs, int32_t procCount, prb_Background mode);
 prb_PUBLICDEC prb_Status          prb_waitForProcesses(prb_Process* handles, int32_t handleCount);
+prb_PUBLICDEC prb_WaitForAnyProcessResult prb_waitForAnyProcess(prb_Process* handles, int32_t handleCount);
 prb_PUBLICDEC prb_Status          prb_killProcesses(prb_Process* handles, int32_t handleCount);
+prb_PUBLICDEC prb_Jobserver       prb_joinJobserver(prb_Arena* arena);
+prb_PUBLICDEC prb_Jobserver       prb_createJobserver(prb_Arena* arena, int32_t jobs);
+prb_PUBLICDEC void                prb_destroyJobserver(prb_Arena* arena, prb_Jobserver* jobserver);
+prb_PUBLICDEC bool                prb_acquireJobserverToken(prb_Jobserver* jobserver);
+prb_PUBLICDEC void                prb_releaseJobserverToken(prb_Jobserver* jobserver);
+prb_PUBLICDEC prb_WaitForAnyProcessResult prb_waitForAnyProcessOrJobserverToken(prb_Jobserver* jobserver, prb_Process* handles, int32_t handleCount);
 prb_PUBLICDEC void                prb_sleep(float ms);
 prb_PUBLICDEC bool                prb_debuggerPresent(prb_Arena* arena);
 prb_PUBLICDEC prb_Status          prb_setenv(prb_Arena* arena, prb_Str name, prb_Str value);
@@ -593,6 +648,7 @@ prb_PUBLICDEC float         prb_getMsFrom(prb_TimeStart timeStart);
 prb_PUBLICDEC prb_Job    prb_createJob(prb_JobProc proc, void* data, prb_Arena* arena, int32_t arenaBytes);
 prb_PUBLICDEC prb_Status prb_launchJobs(prb_Job* jobs, int32_t jobsCount, prb_Background mode);
 prb_PUBLICDEC prb_Status prb_waitForJobs(prb_Job* jobs, int32_t jobsCount);
+prb_PUBLICDEC prb_WaitForAnyProcessResult prb_waitForAnyProcessOrJob(prb_Jobserver* jobserver, prb_Process* handles, int32_t handleCount, prb_Job* jobs, int32_t jobsCount);
 
 // SECTION Random numbers
 prb_PUBLICDEC prb_Rng  prb_createRng(uint32_t seed);
@@ -1937,6 +1993,134 @@ prb_writeEntireFile(prb_Arena* arena, prb_Str path, const void* content, int32_t
     return result;
 }
 
+prb_PUBLICDEF prb_FileStat
+prb_getFileStat(prb_Arena* arena, prb_Str path) {
+    prb_FileStat result = {.valid = false, .lastMod = 0, .size = 0, .inode = 0};
+
+#if prb_PLATFORM_WINDOWS
+
+    prb_TempMemory         temp = prb_beginTempMemory(arena);
+    prb_windows_OpenResult handle = prb_windows_open(arena, path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, OPEN_EXISTING, 0);
+    if (handle.success) {
+        BY_HANDLE_FILE_INFORMATION info;
+        prb_memset(&info, 0, sizeof(info));
+        if (GetFileInformationByHandle(handle.handle, &info)) {
+            result.valid = true;
+            result.lastMod = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+            result.size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+            result.inode = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+        }
+        CloseHandle(handle.handle);
+    }
+    prb_endTempMemory(temp);
+
+#elif prb_PLATFORM_LINUX
+
+    prb_linux_GetFileStatResult statResult = prb_linux_getFileStat(arena, path);
+    if (statResult.success) {
+        result.valid = true;
+        result.lastMod = (uint64_t)statResult.stat.st_mtim.tv_sec * 1000 * 1000 * 1000 + (uint64_t)statResult.stat.st_mtim.tv_nsec;
+        result.size = (uint64_t)statResult.stat.st_size;
+        result.inode = (uint64_t)statResult.stat.st_ino;
+    }
+
+#else
+#error unimplemented
+#endif
+
+    return result;
+}
+
+static uint64_t
+prb_rotl64(uint64_t x, int32_t r) {
+    uint64_t result = (x << r) | (x >> (64 - r));
+    return result;
+}
+
+static uint64_t
+prb_xxh64Round(uint64_t acc, uint64_t input) {
+    acc += input * 0xC2B2AE3D27D4EB4FULL;
+    acc = prb_rotl64(acc, 31);
+    acc *= 0x9E3779B185EBCA87ULL;
+    return acc;
+}
+
+static uint64_t
+prb_xxh64MergeRound(uint64_t acc, uint64_t val) {
+    acc ^= prb_xxh64Round(0, val);
+    acc = acc * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+    return acc;
+}
+
+// NOTE(khvorov) XXH64. Much faster than stb ds hash_bytes on large buffers (whole source files).
+prb_PUBLICDEF uint64_t
+prb_hashBytes(const void* data, intptr_t len, uint64_t seed) {
+    const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t P3 = 0x165667B19E3779F9ULL;
+    const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+    const uint8_t* ptr = (const uint8_t*)data;
+    const uint8_t* end = ptr + len;
+    uint64_t       hash = 0;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+        while (end - ptr >= 32) {
+            uint64_t lanes[4];
+            prb_memcpy(lanes, ptr, sizeof(lanes));
+            v1 = prb_xxh64Round(v1, lanes[0]);
+            v2 = prb_xxh64Round(v2, lanes[1]);
+            v3 = prb_xxh64Round(v3, lanes[2]);
+            v4 = prb_xxh64Round(v4, lanes[3]);
+            ptr += 32;
+        }
+        hash = prb_rotl64(v1, 1) + prb_rotl64(v2, 7) + prb_rotl64(v3, 12) + prb_rotl64(v4, 18);
+        hash = prb_xxh64MergeRound(hash, v1);
+        hash = prb_xxh64MergeRound(hash, v2);
+        hash = prb_xxh64MergeRound(hash, v3);
+        hash = prb_xxh64MergeRound(hash, v4);
+    } else {
+        hash = seed + P5;
+    }
+
+    hash += (uint64_t)len;
+
+    while (end - ptr >= 8) {
+        uint64_t lane = 0;
+        prb_memcpy(&lane, ptr, sizeof(lane));
+        hash ^= prb_xxh64Round(0, lane);
+        hash = prb_rotl64(hash, 27) * P1 + P4;
+        ptr += 8;
+    }
+
+    if (end - ptr >= 4) {
+        uint32_t lane = 0;
+        prb_memcpy(&lane, ptr, sizeof(lane));
+        hash ^= (uint64_t)lane * P1;
+        hash = prb_rotl64(hash, 23) * P2 + P3;
+        ptr += 4;
+    }
+
+    while (ptr < end) {
+        hash ^= (uint64_t)(*ptr) * P5;
+        hash = prb_rotl64(hash, 11) * P1;
+        ptr += 1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= P2;
+    hash ^= hash >> 29;
+    hash *= P3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
 prb_PUBLICDEF prb_FileHash
 prb_getFileHash(prb_Arena* arena, prb_Str filepath) {
     prb_FileHash             result = {.valid = false, .hash = 0};
@@ -1944,7 +2128,7 @@ prb_getFileHash(prb_Arena* arena, prb_Str filepath) {
     prb_ReadEntireFileResult readRes = prb_readEntireFile(arena, filepath);
     if (readRes.success) {
         result.valid = true;
-        result.hash = prb_stbds_hash_bytes(readRes.content.data, (size_t)readRes.content.len, (size_t)1);
+        result.hash = prb_hashBytes(readRes.content.data, readRes.content.len, 0);
     }
     prb_endTempMemory(temp);
     return result;
@@ -2641,20 +2825,48 @@ prb_binaryToCArray(prb_Arena* arena, prb_Str arrayName, void* data, int32_t data
 
 #if prb_PLATFORM_WINDOWS
 
+static float
+prb_windows_filetimeToMs(FILETIME filetime) {
+    uint64_t ticks = ((uint64_t)filetime.dwHighDateTime << 32) | filetime.dwLowDateTime;
+    float    result = (float)ticks / 10000.0f;
+    return result;
+}
+
+// NOTE(khvorov) Call on a process that has already exited
 static void
-prb_windows_waitForProcess(prb_Process* handle) {
-    WaitForSingleObject(handle->processInfo.hProcess, INFINITE);
+prb_windows_finishProcess(prb_Process* handle) {
     handle->status = prb_ProcessStatus_CompletedFailed;
+    handle->stats.wallMs = prb_getMsFrom(handle->launchTime);
     DWORD exitCode = 0;
     if (GetExitCodeProcess(handle->processInfo.hProcess, &exitCode)) {
+        handle->stats.exitCode = (int32_t)exitCode;
         if (exitCode == 0) {
             handle->status = prb_ProcessStatus_CompletedSuccess;
         }
     }
+
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetProcessTimes(handle->processInfo.hProcess, &creationTime, &exitTime, &kernelTime, &userTime)) {
+        handle->stats.userMs = prb_windows_filetimeToMs(userTime);
+        handle->stats.sysMs = prb_windows_filetimeToMs(kernelTime);
+    }
+
+    PROCESS_MEMORY_COUNTERS memCounters;
+    prb_memset(&memCounters, 0, sizeof(memCounters));
+    if (K32GetProcessMemoryInfo(handle->processInfo.hProcess, &memCounters, sizeof(memCounters))) {
+        handle->stats.maxRssBytes = (int64_t)memCounters.PeakWorkingSetSize;
+    }
+
     CloseHandle(handle->processInfo.hProcess);
     CloseHandle(handle->processInfo.hThread);
 }
 
+static void
+prb_windows_waitForProcess(prb_Process* handle) {
+    WaitForSingleObject(handle->processInfo.hProcess, INFINITE);
+    prb_windows_finishProcess(handle);
+}
+
 typedef struct prb_windows_GetAffinityResult {
     bool      success;
     DWORD_PTR affinity;
@@ -2693,14 +2905,46 @@ prb_linux_readFromProc(prb_Arena* arena, prb_Str filename) {
     return result;
 }
 
+static float
+prb_linux_timevalToMs(struct timeval tv) {
+    float result = (float)tv.tv_sec * 1000.0f + (float)tv.tv_usec / 1000.0f;
+    return result;
+}
+
+// NOTE(khvorov) Returns false only when options has WNOHANG and the process is still running
+static bool
+prb_linux_reapProcess(prb_Process* handle, int options) {
+    int32_t       status = 0;
+    struct rusage usage = {};
+    pid_t         waitResult = wait4(handle->pid, &status, options, &usage);
+    bool          result = waitResult != 0;
+    if (result) {
+        handle->status = prb_ProcessStatus_CompletedFailed;
+        handle->stats.wallMs = prb_getMsFrom(handle->launchTime);
+        if (waitResult == handle->pid) {
+            if (WIFEXITED(status)) {
+                handle->stats.exitCode = WEXITSTATUS(status);
+            } else if (WIFSIGNALED(status)) {
+                handle->stats.exitCode = 128 + WTERMSIG(status);
+            }
+            handle->stats.userMs = prb_linux_timevalToMs(usage.ru_utime);
+            handle->stats.sysMs = prb_linux_timevalToMs(usage.ru_stime);
+            handle->stats.maxRssBytes = (int64_t)usage.ru_maxrss * 1024;
+            if (status == 0) {
+                handle->status = prb_ProcessStatus_CompletedSuccess;
+            }
+        }
+        if (handle->pidfd != -1) {
+            close(handle->pidfd);
+            handle->pidfd = -1;
+        }
+    }
+    return result;
+}
+
 static void
 prb_linux_waitForProcess(prb_Process* handle) {
-    int32_t status = 0;
-    pid_t waitResult = waitpid(handle->pid, &status, 0);
-    handle->status = prb_ProcessStatus_CompletedFailed;
-    if (waitResult == handle->pid && status == 0) {
-        handle->status = prb_ProcessStatus_CompletedSuccess;
-    }
+    prb_linux_reapProcess(handle, 0);
 }
 
 typedef struct prb_linux_GetAffinityResult {
@@ -2997,6 +3241,9 @@ prb_createProcess(prb_Str cmd, prb_ProcessSpec spec) {
     prb_memset(&proc, 0, sizeof(proc));
     proc.cmd = cmd;
     proc.spec = spec;
+#if prb_PLATFORM_LINUX
+    proc.pidfd = -1;
+#endif
     return proc;
 }
 
@@ -3099,6 +3346,7 @@ prb_launchProcesses(prb_Arena* arena, prb_Process* procs, int32_t procCount, prb
                 }
 
                 prb_windows_WideStr wcmd = prb_windows_getWideStr(arena, proc->cmd);
+                proc->launchTime = prb_timeStart();
                 if (CreateProcessW(0, wcmd.ptr, 0, 0, inheritHandles, CREATE_UNICODE_ENVIRONMENT, env, 0, &startupInfo, &proc->processInfo)) {
                     proc->status = prb_ProcessStatus_Launched;
                     if (mode == prb_Background_No) {
@@ -3230,9 +3478,15 @@ prb_launchProcesses(prb_Arena* arena, prb_Process* procs, int32_t procCount, prb
 
                 if (envSucceeded) {
                     const char** args = prb_getArgArrayFromStr(arena, proc->cmd);
+                    proc->launchTime = prb_timeStart();
                     int spawnResult = posix_spawnp(&proc->pid, args[0], fileActionsPtr, 0, (char**)args, env);
                     if (spawnResult == 0) {
                         proc->status = prb_ProcessStatus_Launched;
+#ifdef SYS_pidfd_open
+                        proc->pidfd = (int)syscall(SYS_pidfd_open, proc->pid, 0);
+#else
+                        proc->pidfd = -1;
+#endif
                         if (mode == prb_Background_No) {
                             prb_linux_waitForProcess(proc);
                         }
@@ -3292,6 +3546,153 @@ prb_waitForProcesses(prb_Process* handles, int32_t handleCount) {
     return result;
 }
 
+prb_PUBLICDEF prb_WaitForAnyProcessResult
+prb_waitForAnyProcess(prb_Process* handles, int32_t handleCount) {
+    prb_WaitForAnyProcessResult result = prb_waitForAnyProcessOrJobserverToken(0, handles, handleCount);
+    return result;
+}
+
+// NOTE(khvorov) Index is -1 when what came first was a jobserver token, which is now held.
+// A null or invalid jobserver is never waited on.
+prb_PUBLICDEF prb_WaitForAnyProcessResult
+prb_waitForAnyProcessOrJobserverToken(prb_Jobserver* jobserver, prb_Process* handles, int32_t handleCount) {
+    prb_WaitForAnyProcessResult result = prb_waitForAnyProcessOrJob(jobserver, handles, handleCount, 0, 0);
+    return result;
+}
+
+// NOTE(khvorov) Jobs launched in the background count as well, the one that finished is joined and its index is in jobIndex.
+// Both indices are -1 when what came first was a jobserver token.
+prb_PUBLICDEF prb_WaitForAnyProcessResult
+prb_waitForAnyProcessOrJob(prb_Jobserver* jobserver, prb_Process* handles, int32_t handleCount, prb_Job* jobs, int32_t jobsCount) {
+    prb_WaitForAnyProcessResult result = {.success = false, .index = -1, .jobIndex = -1};
+    bool                        waitForToken = jobserver && jobserver->valid;
+
+    bool anyLaunched = false;
+    for (int32_t handleIndex = 0; handleIndex < handleCount && !anyLaunched; handleIndex++) {
+        anyLaunched = handles[handleIndex].status == prb_ProcessStatus_Launched;
+    }
+    for (int32_t jobIndex = 0; jobIndex < jobsCount && !anyLaunched; jobIndex++) {
+        anyLaunched = jobs[jobIndex].status == prb_JobStatus_Launched;
+    }
+
+    if (anyLaunched) {
+#if prb_PLATFORM_WINDOWS
+
+        // NOTE(khvorov) There are no jobservers here
+        prb_unused(waitForToken);
+
+        // NOTE(khvorov) WaitForMultipleObjects can only take so many handles, so poll in chunks if there are more.
+        // Processes and then jobs (their threads) make up one list of waitables.
+        int32_t waitableCount = handleCount + jobsCount;
+        HANDLE  waitHandles[MAXIMUM_WAIT_OBJECTS];
+        int32_t waitIndices[MAXIMUM_WAIT_OBJECTS];
+        int32_t waitableIndexDone = -1;
+        bool    fitsInOneWait = waitableCount <= MAXIMUM_WAIT_OBJECTS;
+        bool    waitFailed = false;
+        while (!result.success && !waitFailed) {
+            for (int32_t chunkStart = 0; chunkStart < waitableCount && !result.success && !waitFailed; chunkStart += MAXIMUM_WAIT_OBJECTS) {
+                DWORD waitCount = 0;
+                for (int32_t waitableIndex = chunkStart; waitableIndex < prb_min(waitableCount, chunkStart + MAXIMUM_WAIT_OBJECTS); waitableIndex++) {
+                    if (waitableIndex < handleCount) {
+                        prb_Process* handle = handles + waitableIndex;
+                        if (handle->status == prb_ProcessStatus_Launched) {
+                            waitHandles[waitCount] = handle->processInfo.hProcess;
+                            waitIndices[waitCount] = waitableIndex;
+                            waitCount += 1;
+                        }
+                    } else {
+                        prb_Job* job = jobs + (waitableIndex - handleCount);
+                        if (job->status == prb_JobStatus_Launched) {
+                            waitHandles[waitCount] = job->threadhandle;
+                            waitIndices[waitCount] = waitableIndex;
+                            waitCount += 1;
+                        }
+                    }
+                }
+                if (waitCount > 0) {
+                    DWORD waitResult = WaitForMultipleObjects(waitCount, waitHandles, FALSE, fitsInOneWait ? INFINITE : 1);
+                    if (waitResult < WAIT_OBJECT_0 + waitCount) {
+                        result.success = true;
+                        waitableIndexDone = waitIndices[waitResult - WAIT_OBJECT_0];
+                    } else if (waitResult == WAIT_FAILED) {
+                        waitFailed = true;
+                    }
+                }
+            }
+        }
+
+        // NOTE(khvorov) WAIT_FAILED leaves success false with nothing finished
+        if (result.success) {
+            if (waitableIndexDone < handleCount) {
+                result.index = waitableIndexDone;
+                prb_windows_finishProcess(handles + result.index);
+            } else {
+                result.jobIndex = waitableIndexDone - handleCount;
+                jobs[result.jobIndex].status = prb_JobStatus_Completed;
+            }
+        }
+
+#elif prb_PLATFORM_LINUX
+
+        struct pollfd* pollfds = (struct pollfd*)prb_malloc(sizeof(struct pollfd) * (size_t)(handleCount + jobsCount + 1));
+        while (!result.success) {
+            int32_t pollfdCount = 0;
+            bool    allHavePidfd = true;
+            for (int32_t handleIndex = 0; handleIndex < handleCount && !result.success; handleIndex++) {
+                prb_Process* handle = handles + handleIndex;
+                if (handle->status == prb_ProcessStatus_Launched) {
+                    if (prb_linux_reapProcess(handle, WNOHANG)) {
+                        result.success = true;
+                        result.index = handleIndex;
+                    } else if (handle->pidfd != -1) {
+                        pollfds[pollfdCount++] = (struct pollfd) {.fd = handle->pidfd, .events = POLLIN};
+                    } else {
+                        allHavePidfd = false;
+                    }
+                }
+            }
+
+            for (int32_t jobIndex = 0; jobIndex < jobsCount && !result.success; jobIndex++) {
+                prb_Job* job = jobs + jobIndex;
+                if (job->status == prb_JobStatus_Launched) {
+                    struct pollfd donePoll = {.fd = job->donefd, .events = POLLIN};
+                    if (poll(&donePoll, 1, 0) > 0) {
+                        prb_assert(pthread_join(job->threadid, 0) == 0);
+                        close(job->donefd);
+                        job->donefd = -1;
+                        job->status = prb_JobStatus_Completed;
+                        result.success = true;
+                        result.jobIndex = jobIndex;
+                    } else {
+                        pollfds[pollfdCount++] = donePoll;
+                    }
+                }
+            }
+
+            // NOTE(khvorov) Readable doesn't mean the token is ours, someone else might get to it first
+            if (!result.success && waitForToken) {
+                if (prb_acquireJobserverToken(jobserver)) {
+                    result.success = true;
+                } else {
+                    pollfds[pollfdCount++] = (struct pollfd) {.fd = jobserver->fd, .events = POLLIN};
+                }
+            }
+
+            // NOTE(khvorov) pidfds become readable when the process exits. Without them (old kernels) fall back to polling.
+            if (!result.success) {
+                poll(pollfds, (nfds_t)pollfdCount, allHavePidfd ? -1 : 1);
+            }
+        }
+        prb_free(pollfds);
+
+#else
+#error unimplemented
+#endif
+    }
+
+    return result;
+}
+
 prb_PUBLICDEF prb_Status
 prb_killProcesses(prb_Process* handles, int32_t handleCount) {
     prb_Status result = prb_Success;
@@ -3309,6 +3710,10 @@ prb_killProcesses(prb_Process* handles, int32_t handleCount) {
 #elif prb_PLATFORM_LINUX
             if (kill(handle->pid, SIGKILL) == 0) {
                 handle->status = prb_ProcessStatus_CompletedFailed;
+                if (handle->pidfd != -1) {
+                    close(handle->pidfd);
+                    handle->pidfd = -1;
+                }
             }
 #else
 #error unimplemented
@@ -3323,6 +3728,175 @@ prb_killProcesses(prb_Process* handles, int32_t handleCount) {
     return result;
 }
 
+// NOTE(khvorov) From MAKEFLAGS, the last --jobserver-auth= (or pre-4.2 --jobserver-fds=) wins.
+// Either fifo:<path> (make 4.4+) or <read fd>,<write fd> inherited from make.
+// Invalid when there is none or when make didn't pass the fds down (the recipe isn't marked with +).
+prb_PUBLICDEF prb_Jobserver
+prb_joinJobserver(prb_Arena* arena) {
+    prb_Jobserver result;
+    prb_memset(&result, 0, sizeof(result));
+    result.fd = -1;
+
+#if prb_PLATFORM_WINDOWS
+
+    prb_unused(arena);
+
+#elif prb_PLATFORM_LINUX
+
+    prb_TempMemory   temp = prb_beginTempMemory(arena);
+    prb_GetenvResult makeflags = prb_getenv(arena, prb_STR("MAKEFLAGS"));
+    if (makeflags.found) {
+        prb_Str auth = {.ptr = 0, .len = 0};
+        {
+            const char*    prefixes[] = {"--jobserver-auth=", "--jobserver-fds="};
+            prb_StrScanner scanner = prb_createStrScanner(makeflags.str);
+            prb_StrFindSpec space = {.mode = prb_StrFindMode_AnyChar, .pattern = prb_STR(" "), .alwaysMatchEnd = true};
+            while (prb_strScannerMove(&scanner, space, prb_StrScannerSide_AfterMatch)) {
+                for (int32_t prefixIndex = 0; prefixIndex < prb_arrayCount(prefixes); prefixIndex++) {
+                    prb_Str prefix = prb_STR(prefixes[prefixIndex]);
+                    if (prb_strStartsWith(scanner.betweenLastMatches, prefix)) {
+                        auth = prb_strSlice(scanner.betweenLastMatches, prefix.len, scanner.betweenLastMatches.len);
+                    }
+                }
+            }
+        }
+
+        prb_Str fifoPrefix = prb_STR("fifo:");
+        if (prb_strStartsWith(auth, fifoPrefix)) {
+            prb_Str path = prb_strSlice(auth, fifoPrefix.len, auth.len);
+            result.fd = open(prb_strGetNullTerminated(arena, path), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        } else if (auth.len > 0) {
+            // NOTE(khvorov) Reopening the pipe through /proc gives us our own file description to make non-blocking
+            prb_StrScanner      scanner = prb_createStrScanner(auth);
+            prb_ParseUintResult readFd = {.success = false, .number = 0};
+            if (prb_strScannerMove(&scanner, (prb_StrFindSpec) {.pattern = prb_STR(",")}, prb_StrScannerSide_AfterMatch)) {
+                readFd = prb_parseUint(scanner.betweenLastMatches, 10);
+            }
+            if (readFd.success && fcntl((int)readFd.number, F_GETFD) != -1) {
+                prb_Str procPath = prb_fmt(arena, "/proc/self/fd/%d", (int)readFd.number);
+                result.fd = open(prb_strGetNullTerminated(arena, procPath), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            }
+        }
+        result.valid = result.fd != -1;
+    }
+    prb_endTempMemory(temp);
+
+#else
+#error unimplemented
+#endif
+
+    return result;
+}
+
+// NOTE(khvorov) A fifo with jobs - 1 tokens (we hold the free one) that every process we launch from now on
+// finds through MAKEFLAGS
+prb_PUBLICDEF prb_Jobserver
+prb_createJobserver(prb_Arena* arena, int32_t jobs) {
+    prb_Jobserver result;
+    prb_memset(&result, 0, sizeof(result));
+    result.fd = -1;
+
+#if prb_PLATFORM_WINDOWS
+
+    prb_unused(arena);
+    prb_unused(jobs);
+
+#elif prb_PLATFORM_LINUX
+
+    prb_Str        path = prb_fmt(arena, "/tmp/prb-jobserver-%d", (int)getpid());
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+    const char*    pathNull = prb_strGetNullTerminated(arena, path);
+    unlink(pathNull);
+    if (mkfifo(pathNull, S_IRUSR | S_IWUSR) == 0) {
+        result.fd = open(pathNull, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        bool tokensWritten = result.fd != -1;
+        for (int32_t tokenIndex = 0; tokenIndex < jobs - 1 && tokensWritten; tokenIndex++) {
+            tokensWritten = write(result.fd, "+", 1) == 1;
+        }
+        prb_Str makeflags = prb_fmt(arena, " -j%d --jobserver-auth=fifo:%.*s", jobs, prb_LIT(path));
+        if (tokensWritten && prb_setenv(arena, prb_STR("MAKEFLAGS"), makeflags)) {
+            result.valid = true;
+            result.ownedFifoPath = path;
+        } else {
+            if (result.fd != -1) {
+                close(result.fd);
+                result.fd = -1;
+            }
+            unlink(pathNull);
+        }
+    }
+    prb_endTempMemory(temp);
+
+#else
+#error unimplemented
+#endif
+
+    return result;
+}
+
+// NOTE(khvorov) Gives back every token we still hold
+prb_PUBLICDEF void
+prb_destroyJobserver(prb_Arena* arena, prb_Jobserver* jobserver) {
+    if (jobserver->valid) {
+        while (prb_stbds_arrlen(jobserver->tokens) > 0) {
+            prb_releaseJobserverToken(jobserver);
+        }
+        prb_stbds_arrfree(jobserver->tokens);
+
+#if prb_PLATFORM_WINDOWS
+
+        prb_unused(arena);
+
+#elif prb_PLATFORM_LINUX
+
+        close(jobserver->fd);
+        if (jobserver->ownedFifoPath.len > 0) {
+            prb_TempMemory temp = prb_beginTempMemory(arena);
+            unlink(prb_strGetNullTerminated(arena, jobserver->ownedFifoPath));
+            prb_unsetenv(arena, prb_STR("MAKEFLAGS"));
+            prb_endTempMemory(temp);
+        }
+
+#else
+#error unimplemented
+#endif
+    }
+    prb_memset(jobserver, 0, sizeof(*jobserver));
+    jobserver->fd = -1;
+}
+
+// NOTE(khvorov) Never blocks
+prb_PUBLICDEF bool
+prb_acquireJobserverToken(prb_Jobserver* jobserver) {
+    bool result = false;
+    if (jobserver->valid) {
+#if prb_PLATFORM_WINDOWS
+#elif prb_PLATFORM_LINUX
+        char token = 0;
+        if (read(jobserver->fd, &token, 1) == 1) {
+            prb_stbds_arrput(jobserver->tokens, token);
+            result = true;
+        }
+#else
+#error unimplemented
+#endif
+    }
+    return result;
+}
+
+prb_PUBLICDEF void
+prb_releaseJobserverToken(prb_Jobserver* jobserver) {
+    prb_assert(jobserver->valid && prb_stbds_arrlen(jobserver->tokens) > 0);
+#if prb_PLATFORM_WINDOWS
+#elif prb_PLATFORM_LINUX
+    char token = prb_stbds_arrpop(jobserver->tokens);
+    // NOTE(khvorov) Can't fill up, there are never more tokens than there were to begin with
+    prb_assert(write(jobserver->fd, &token, 1) == 1);
+#else
+#error unimplemented
+#endif
+}
+
 prb_PUBLICDEF void
 prb_sleep(float ms) {
 #if prb_PLATFORM_WINDOWS
@@ -3540,6 +4114,8 @@ static void*
 prb_linux_threadProc(void* data) {
     prb_Job* job = (prb_Job*)data;
     job->proc(&job->arena, job->data);
+    uint64_t done = 1;
+    prb_assert(write(job->donefd, &done, sizeof(done)) == sizeof(done));
     return 0;
 }
 
@@ -3552,6 +4128,9 @@ prb_createJob(prb_JobProc proc, void* data, prb_Arena* arena, int32_t arenaBytes
     job.proc = proc;
     job.data = data;
     job.arena = prb_createArenaFromArena(arena, arenaBytes);
+#if prb_PLATFORM_LINUX
+    job.donefd = -1;
+#endif
     return job;
 }
 
@@ -3582,7 +4161,8 @@ prb_launchJobs(prb_Job* jobs, int32_t jobsCount, prb_Background mode) {
                         result = prb_Failure;
                     }
 #elif prb_PLATFORM_LINUX
-                    if (pthread_create(&job->threadid, 0, prb_linux_threadProc, job) != 0) {
+                    job->donefd = eventfd(0, EFD_CLOEXEC);
+                    if (job->donefd == -1 || pthread_create(&job->threadid, 0, prb_linux_threadProc, job) != 0) {
                         result = prb_Failure;
                     }
 #else
@@ -3614,6 +4194,8 @@ prb_waitForJobs(prb_Job* jobs, int32_t jobsCount) {
 #elif prb_PLATFORM_LINUX
 
             if (pthread_join(job->threadid, 0) == 0) {
+                close(job->donefd);
+                job->donefd = -1;
                 job->status = prb_JobStatus_Completed;
             } else {
                 result = prb_Failure;
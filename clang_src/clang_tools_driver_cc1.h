@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// NOTE(khvorov) In-process cc1 for when spawning clang.exe and going through the disk costs more than the compile itself.
+// Calls can come from any number of threads. Process-wide LLVM options are shared: calls with the same -mllvm list
+// run side by side, a call with a different list (or -ftime-report) waits for everything else and runs alone. Parsed arguments are cached process-wide, so compiles that only
+// differ in their input and output files skip the argument parsing.
+
+typedef struct cc1_File {
+    // NOTE(khvorov) Same path the args refer to it by, relative ones are relative to the working dir
+    const char* path;
+    const char* content;
+    intptr_t    contentLen;
+} cc1_File;
+
+typedef struct cc1_Request {
+    // NOTE(khvorov) What comes after -cc1
+    const char* const* args;
+    int32_t            argCount;
+    // NOTE(khvorov) Shadow the real filesystem for the duration of the call, the caller keeps them alive until it returns
+    const cc1_File*    files;
+    int32_t            fileCount;
+} cc1_Request;
+
+typedef enum cc1_DiagLevel {
+    cc1_DiagLevel_Ignored,
+    cc1_DiagLevel_Note,
+    cc1_DiagLevel_Remark,
+    cc1_DiagLevel_Warning,
+    cc1_DiagLevel_Error,
+    cc1_DiagLevel_Fatal,
+} cc1_DiagLevel;
+
+typedef struct cc1_Diag {
+    cc1_DiagLevel level;
+    // NOTE(khvorov) Empty and 0 when the diagnostic has no location (bad arguments)
+    const char*   file;
+    int32_t       line;
+    int32_t       column;
+    const char*   message;
+} cc1_Diag;
+
+// NOTE(khvorov) Owned by the caller, give it back with cc1_freeResult
+typedef struct cc1_Result {
+    bool      success;
+    // NOTE(khvorov) Whatever codegen would have written to -o (object, assembly or bitcode).
+    // Nothing for actions that don't go through codegen, those still write their outputs to disk.
+    uint8_t*  output;
+    intptr_t  outputLen;
+    cc1_Diag* diags;
+    int32_t   diagCount;
+} cc1_Result;
+
+// NOTE(khvorov) Keeps the FileManager (stats, directory lookups) warm from one compile to the next.
+// It is thrown away when anything it has seen changed on disk, when the working directory is different
+// and for requests that come with in-memory files. One thread at a time per session.
+typedef struct cc1_Session cc1_Session;
+
+cc1_Session* cc1_createSession(void);
+void         cc1_destroySession(cc1_Session* session);
+
+bool cc1_compile(const cc1_Request* request, cc1_Result* result);
+bool cc1_compileInSession(cc1_Session* session, const cc1_Request* request, cc1_Result* result);
+void cc1_freeResult(cc1_Result* result);
+int  cc1_main(int argc, char** argv);
+
+// NOTE(khvorov) clang.exe -batch <manifest> [-j N], compiles every file in the manifest on a thread pool (without -j, as many at a time as make's jobserver allows)
+int cc1_batch(const char* manifestPath, int workerCount);
+
+// NOTE(khvorov) clang.exe --serve <socket> [-j N] and clang.exe -client <socket> <cc1 args>, see clang_tools_driver_cc1_server.c
+int cc1_serve(const char* socketPath, int workerCount);
+int cc1_client(const char* socketPath, const char* argv0, int argCount, char** args);
+
+// NOTE(khvorov) Wall time the one-time target/pass registry init took, 0 until the first compile
+double cc1_getInitSeconds(void);
+
+#ifdef __cplusplus
+}
+#endif
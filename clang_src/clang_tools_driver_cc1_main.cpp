@@ -3,9 +3,33 @@
 #include "llvm_include_llvm_InitializePasses.h"
 #include "llvm_include_llvm_Support_TargetSelect.h"
 #include "clang_include_clang_CodeGen_ObjectFilePCHContainerOperations.h"
+#include "clang_include_clang_Basic_FileManager.h"
+#include "clang_include_clang_Driver_Options.h"
 #include "clang_include_clang_Frontend_CompilerInstance.h"
 #include "clang_include_clang_Frontend_TextDiagnosticBuffer.h"
+#include "clang_include_clang_Frontend_TextDiagnosticPrinter.h"
 #include "clang_include_clang_FrontendTool_Utils.h"
+#include "llvm_include_llvm_ADT_StringExtras.h"
+#include "llvm_include_llvm_Option_ArgList.h"
+#include "llvm_include_llvm_Support_CommandLine.h"
+#include "llvm_include_llvm_Support_Format.h"
+#include "llvm_include_llvm_Support_Path.h"
+#include "llvm_include_llvm_Support_ThreadPool.h"
+#include "llvm_include_llvm_Support_Threading.h"
+#include "llvm_include_llvm_Support_Timer.h"
+#include "llvm_include_llvm_Support_VirtualFileSystem.h"
+#include "llvm_include_llvm_Support_raw_ostream.h"
+#include "clang_tools_driver_cc1.h"
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 // clang-format off
 #define mdc_STR(x) (mdc_Str) { x, mdc_strlen(x) }
@@ -69,58 +93,80 @@ LLVMX86TargetMachineProc(const LLVMTarget& T, const llvm::Triple& TT, llvm::Stri
 
 LLVMTarget* LLVMTargetRegistryTheTarget = 0;
 
+// NOTE(khvorov) The registry keeps pointing at this after init
+static LLVMTarget x8664Target;
+
+// NOTE(khvorov) Pass registration and MC init only need to happen once per process no matter how many compiles run in it
+static llvm::once_flag initTargetOnce;
+static double          initTargetSeconds;
+
+static void
+initTargetOnceBody() {
+    llvm::TimeRecord start = llvm::TimeRecord::getCurrentTime(true);
+
+    x8664Target.Name = "x86-64";
+    x8664Target.ShortDesc = "64-bit X86: EM64T and AMD64";
+    x8664Target.BackendName = "X86";
+    x8664Target.HasJIT = true;
+    x8664Target.TargetMachineCtorFn = LLVMX86TargetMachineProc;
+
+    LLVMTargetRegistryTheTarget = &x8664Target;
+
+    llvm::PassRegistry& PR = *llvm::PassRegistry::getPassRegistry();
+    llvm::initializeX86LowerAMXIntrinsicsLegacyPassPass(PR);
+    llvm::initializeX86LowerAMXTypeLegacyPassPass(PR);
+    llvm::initializeX86PreAMXConfigPassPass(PR);
+    llvm::initializeX86PreTileConfigPass(PR);
+    llvm::initializeGlobalISel(PR);
+    llvm::initializeWinEHStatePassPass(PR);
+    llvm::initializeFixupBWInstPassPass(PR);
+    llvm::initializeEvexToVexInstPassPass(PR);
+    llvm::initializeFixupLEAPassPass(PR);
+    llvm::initializeFPSPass(PR);
+    llvm::initializeX86FixupSetCCPassPass(PR);
+    llvm::initializeX86CallFrameOptimizationPass(PR);
+    llvm::initializeX86CmovConverterPassPass(PR);
+    llvm::initializeX86TileConfigPass(PR);
+    llvm::initializeX86FastPreTileConfigPass(PR);
+    llvm::initializeX86FastTileConfigPass(PR);
+    llvm::initializeX86KCFIPass(PR);
+    llvm::initializeX86LowerTileCopyPass(PR);
+    llvm::initializeX86ExpandPseudoPass(PR);
+    llvm::initializeX86ExecutionDomainFixPass(PR);
+    llvm::initializeX86DomainReassignmentPass(PR);
+    llvm::initializeX86AvoidSFBPassPass(PR);
+    llvm::initializeX86AvoidTrailingCallPassPass(PR);
+    llvm::initializeX86SpeculativeLoadHardeningPassPass(PR);
+    llvm::initializeX86SpeculativeExecutionSideEffectSuppressionPass(PR);
+    llvm::initializeX86FlagsCopyLoweringPassPass(PR);
+    llvm::initializeX86LoadValueInjectionLoadHardeningPassPass(PR);
+    llvm::initializeX86LoadValueInjectionRetHardeningPassPass(PR);
+    llvm::initializeX86OptimizeLEAPassPass(PR);
+    llvm::initializeX86PartialReductionPass(PR);
+    llvm::initializePseudoProbeInserterPass(PR);
+    llvm::initializeX86ReturnThunksPass(PR);
+    llvm::initializeX86DAGToDAGISelPass(PR);
+
+    LLVMInitializeX86TargetMC();
+    LLVMInitializeX86AsmPrinter();
+    LLVMInitializeX86AsmParser();
+
+    initTargetSeconds = llvm::TimeRecord::getCurrentTime(false).getWallTime() - start.getWallTime();
+}
+
+static void
+initTarget() {
+    llvm::call_once(initTargetOnce, initTargetOnceBody);
+}
+
+extern "C" double
+cc1_getInitSeconds() {
+    return initTargetSeconds;
+}
+
 extern "C" int
 cc1_main(int argc, char** argv) {
-    // NOTE(khvorov) Init
-    LLVMTarget x8664Target = {};
-    {
-        x8664Target.Name = "x86-64";
-        x8664Target.ShortDesc = "64-bit X86: EM64T and AMD64";
-        x8664Target.BackendName = "X86";
-        x8664Target.HasJIT = true;
-        x8664Target.TargetMachineCtorFn = LLVMX86TargetMachineProc;
-
-        LLVMTargetRegistryTheTarget = &x8664Target;
-
-        llvm::PassRegistry& PR = *llvm::PassRegistry::getPassRegistry();
-        llvm::initializeX86LowerAMXIntrinsicsLegacyPassPass(PR);
-        llvm::initializeX86LowerAMXTypeLegacyPassPass(PR);
-        llvm::initializeX86PreAMXConfigPassPass(PR);
-        llvm::initializeX86PreTileConfigPass(PR);
-        llvm::initializeGlobalISel(PR);
-        llvm::initializeWinEHStatePassPass(PR);
-        llvm::initializeFixupBWInstPassPass(PR);
-        llvm::initializeEvexToVexInstPassPass(PR);
-        llvm::initializeFixupLEAPassPass(PR);
-        llvm::initializeFPSPass(PR);
-        llvm::initializeX86FixupSetCCPassPass(PR);
-        llvm::initializeX86CallFrameOptimizationPass(PR);
-        llvm::initializeX86CmovConverterPassPass(PR);
-        llvm::initializeX86TileConfigPass(PR);
-        llvm::initializeX86FastPreTileConfigPass(PR);
-        llvm::initializeX86FastTileConfigPass(PR);
-        llvm::initializeX86KCFIPass(PR);
-        llvm::initializeX86LowerTileCopyPass(PR);
-        llvm::initializeX86ExpandPseudoPass(PR);
-        llvm::initializeX86ExecutionDomainFixPass(PR);
-        llvm::initializeX86DomainReassignmentPass(PR);
-        llvm::initializeX86AvoidSFBPassPass(PR);
-        llvm::initializeX86AvoidTrailingCallPassPass(PR);
-        llvm::initializeX86SpeculativeLoadHardeningPassPass(PR);
-        llvm::initializeX86SpeculativeExecutionSideEffectSuppressionPass(PR);
-        llvm::initializeX86FlagsCopyLoweringPassPass(PR);
-        llvm::initializeX86LoadValueInjectionLoadHardeningPassPass(PR);
-        llvm::initializeX86LoadValueInjectionRetHardeningPassPass(PR);
-        llvm::initializeX86OptimizeLEAPassPass(PR);
-        llvm::initializeX86PartialReductionPass(PR);
-        llvm::initializePseudoProbeInserterPass(PR);
-        llvm::initializeX86ReturnThunksPass(PR);
-        llvm::initializeX86DAGToDAGISelPass(PR);
-
-        LLVMInitializeX86TargetMC();
-        LLVMInitializeX86AsmPrinter();
-        LLVMInitializeX86AsmParser();
-    }
+    initTarget();
 
     std::unique_ptr<clang::CompilerInstance>        Clang(new clang::CompilerInstance());
     clang::IntrusiveRefCntPtr<clang::DiagnosticIDs> DiagID(new clang::DiagnosticIDs());
@@ -143,6 +189,9 @@ cc1_main(int argc, char** argv) {
 
     if (Success) {
         DiagsBuffer->FlushDiagnostics(Clang->getDiagnostics());
+        if (Clang->getCodeGenOpts().TimePasses) {
+            llvm::errs() << llvm::format("cc1 target init: %.3fms (once per process)\n", initTargetSeconds * 1000.0);
+        }
         Success = ExecuteCompilerInvocation(Clang.get());
     } else {
         Clang->getDiagnosticClient().finish();
@@ -151,3 +200,721 @@ cc1_main(int argc, char** argv) {
     int result = !Success;
     return result;
 }
+
+// NOTE(khvorov) Keeps diagnostics as records instead of printing them
+class CollectingDiagConsumer : public clang::DiagnosticConsumer {
+public:
+    struct Record {
+        cc1_DiagLevel level;
+        std::string   file;
+        int32_t       line;
+        int32_t       column;
+        std::string   message;
+    };
+
+    std::vector<Record> records;
+
+    void
+    HandleDiagnostic(clang::DiagnosticsEngine::Level level, const clang::Diagnostic& info) override {
+        // NOTE(khvorov) Keeps the error and warning counts
+        clang::DiagnosticConsumer::HandleDiagnostic(level, info);
+
+        Record record = {};
+        switch (level) {
+            case clang::DiagnosticsEngine::Ignored: record.level = cc1_DiagLevel_Ignored; break;
+            case clang::DiagnosticsEngine::Note: record.level = cc1_DiagLevel_Note; break;
+            case clang::DiagnosticsEngine::Remark: record.level = cc1_DiagLevel_Remark; break;
+            case clang::DiagnosticsEngine::Warning: record.level = cc1_DiagLevel_Warning; break;
+            case clang::DiagnosticsEngine::Error: record.level = cc1_DiagLevel_Error; break;
+            case clang::DiagnosticsEngine::Fatal: record.level = cc1_DiagLevel_Fatal; break;
+        }
+
+        llvm::SmallString<256> message;
+        info.FormatDiagnostic(message);
+        record.message = message.str().str();
+
+        if (info.getLocation().isValid() && info.hasSourceManager()) {
+            clang::PresumedLoc loc = info.getSourceManager().getPresumedLoc(info.getLocation());
+            if (loc.isValid()) {
+                record.file = loc.getFilename();
+                record.line = (int32_t)loc.getLine();
+                record.column = (int32_t)loc.getColumn();
+            }
+        }
+
+        records.push_back(std::move(record));
+    }
+};
+
+// NOTE(khvorov) Remembers everything the FileManager asked about so a session can tell when its caches went stale.
+// Missing paths are covered by the directory they would be in (its mtime changes when entries come and go).
+class RecordingFileSystem : public llvm::vfs::ProxyFileSystem {
+public:
+    struct Seen {
+        bool                   exists;
+        uint64_t               size;
+        llvm::sys::TimePoint<> modTime;
+    };
+
+    llvm::StringMap<Seen> seen;
+
+    explicit RecordingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs) : ProxyFileSystem(std::move(fs)) {}
+
+    llvm::ErrorOr<llvm::vfs::Status>
+    status(const llvm::Twine& path) override {
+        llvm::ErrorOr<llvm::vfs::Status> result = ProxyFileSystem::status(path);
+        record(path.str(), result);
+        return result;
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine& path) override {
+        llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> result = ProxyFileSystem::openFileForRead(path);
+        if (result) {
+            record(path.str(), (*result)->status());
+        } else {
+            record(path.str(), result.getError());
+        }
+        return result;
+    }
+
+    bool
+    unchanged() {
+        bool result = true;
+        for (auto entry = seen.begin(); entry != seen.end() && result; ++entry) {
+            llvm::ErrorOr<llvm::vfs::Status> now = getUnderlyingFS().status(entry->first());
+            const Seen&                      was = entry->second;
+            result = (bool)now == was.exists && (!now || (now->getSize() == was.size && now->getLastModificationTime() == was.modTime));
+        }
+        return result;
+    }
+
+private:
+    void
+    record(llvm::StringRef path, const llvm::ErrorOr<llvm::vfs::Status>& status) {
+        Seen seenNow = {};
+        if (status) {
+            seenNow = {true, status->getSize(), status->getLastModificationTime()};
+        }
+        if (seen.try_emplace(path, seenNow).second) {
+            // NOTE(khvorov) Walk up until something exists so that creating any of the missing dirs is noticed too
+            bool parentExists = false;
+            for (llvm::StringRef parent = llvm::sys::path::parent_path(path); !parent.empty() && !parentExists; parent = llvm::sys::path::parent_path(parent)) {
+                auto inserted = seen.try_emplace(parent, Seen {});
+                if (inserted.second) {
+                    llvm::ErrorOr<llvm::vfs::Status> parentStatus = getUnderlyingFS().status(parent);
+                    if (parentStatus) {
+                        inserted.first->second = {true, parentStatus->getSize(), parentStatus->getLastModificationTime()};
+                    }
+                }
+                parentExists = inserted.first->second.exists;
+            }
+        }
+    }
+};
+
+// NOTE(khvorov) What a session keeps warm between compiles. Only touched by whoever owns the session.
+struct cc1_Session {
+    llvm::IntrusiveRefCntPtr<RecordingFileSystem> recordingFS;
+    llvm::IntrusiveRefCntPtr<clang::FileManager>  fileManager;
+};
+
+// NOTE(khvorov) cl::opt values are process-wide. Every cc1 line the driver makes carries the same -mllvm list,
+// so that list stays applied and compiles that want it run side by side with their own LLVMArgs cleared.
+// Only a compile with a different list takes the process for itself to apply it (and runs while it has it).
+// The other options that end up in cl::opt state (-ftime-report, -debug-pass, -limit-float-precision) are rare
+// enough that those compiles just run alone and put the defaults back when done.
+static std::shared_mutex         clOptionsMutex;
+static std::vector<std::string> appliedLLVMArgs;
+
+static bool
+setsOtherClOptions(clang::CompilerInstance* Clang) {
+    const clang::CodeGenOptions& CodeGenOpts = Clang->getCodeGenOpts();
+    bool result = !CodeGenOpts.DebugPass.empty() || !CodeGenOpts.LimitFloatPrecision.empty() || CodeGenOpts.TimePasses;
+    return result;
+}
+
+// NOTE(khvorov) Same thing ExecuteCompilerInvocation does with LLVMArgs, on top of the defaults
+static void
+applyLLVMArgs(const std::vector<std::string>& llvmArgs) {
+    // NOTE(khvorov) cl options complain when they occur twice
+    llvm::cl::ResetAllOptionOccurrences();
+    if (!llvmArgs.empty()) {
+        std::vector<const char*> args;
+        args.push_back("clang (LLVM option parsing)");
+        for (const std::string& arg : llvmArgs) {
+            args.push_back(arg.c_str());
+        }
+        args.push_back(nullptr);
+        llvm::cl::ParseCommandLineOptions((int)args.size() - 1, args.data());
+    }
+    appliedLLVMArgs = llvmArgs;
+}
+
+static bool
+executeInvocation(clang::CompilerInstance* Clang) {
+    bool                     Success = false;
+    bool                     ran = false;
+    std::vector<std::string> llvmArgs = Clang->getFrontendOpts().LLVMArgs;
+    bool                     otherOptions = setsOtherClOptions(Clang);
+
+    if (!otherOptions) {
+        std::shared_lock<std::shared_mutex> lock(clOptionsMutex);
+        if (appliedLLVMArgs == llvmArgs) {
+            Clang->getFrontendOpts().LLVMArgs.clear();
+            Success = ExecuteCompilerInvocation(Clang);
+            ran = true;
+        }
+    }
+
+    if (!ran) {
+        std::unique_lock<std::shared_mutex> lock(clOptionsMutex);
+        applyLLVMArgs(llvmArgs);
+        Clang->getFrontendOpts().LLVMArgs.clear();
+        Success = ExecuteCompilerInvocation(Clang);
+        if (otherOptions) {
+            applyLLVMArgs({});
+        }
+    }
+
+    return Success;
+}
+
+// NOTE(khvorov) Parsed invocations keyed by their args with the per-file slots (inputs, -o, -main-file-name,
+// -dependency-file, -MT, -split-dwarf-file, -split-dwarf-output) masked out. The same flags for a different file
+// become a copy of the cached invocation and a few assignments instead of a full parse.
+static std::mutex                                                        invocationCacheMutex;
+static llvm::StringMap<std::shared_ptr<const clang::CompilerInvocation>> invocationCache;
+static constexpr size_t                                                  invocationCacheMaxEntries = 256;
+
+struct InvocationSlot {
+    unsigned    optionID;
+    std::string value;
+};
+
+// NOTE(khvorov) Only the option table lookup, none of the option marshalling CreateFromArgs does
+static bool
+getInvocationKey(const std::vector<const char*>& args, std::string* key, std::vector<InvocationSlot>* slots) {
+    using namespace clang::driver::options;
+    const llvm::opt::OptTable& opts = clang::driver::getDriverOptTable();
+    unsigned                   missingIndex = 0;
+    unsigned                   missingCount = 0;
+    llvm::opt::InputArgList    parsed = opts.ParseArgs(llvm::makeArrayRef(args).slice(1), missingIndex, missingCount, CC1Option);
+
+    // NOTE(khvorov) -save-temps=obj is derived from -o
+    bool result = missingCount == 0;
+    for (const llvm::opt::Arg* arg : parsed) {
+        unsigned id = arg->getOption().getID();
+        result = result && id != OPT_UNKNOWN && id != OPT_save_temps_EQ;
+
+        bool masked = id == OPT_INPUT || id == OPT_o || id == OPT_main_file_name || id == OPT_dependency_file || id == OPT_MT || id == OPT_split_dwarf_file || id == OPT_split_dwarf_output;
+        if (id != OPT_INPUT) {
+            *key += arg->getSpelling();
+            *key += '\0';
+        }
+        for (const char* value : arg->getValues()) {
+            if (masked) {
+                slots->push_back({id, value});
+                // NOTE(khvorov) Without -x the input kind comes from the extension
+                *key += id == OPT_INPUT ? "<input>." + llvm::StringRef(value).rsplit('.').second.str() : "<slot>";
+            } else {
+                *key += value;
+            }
+            *key += '\0';
+        }
+    }
+    return result;
+}
+
+static void
+patchInvocation(clang::CompilerInvocation* invocation, const std::vector<InvocationSlot>& slots, const std::vector<const char*>& args) {
+    using namespace clang::driver::options;
+    clang::FrontendOptions& FrontendOpts = invocation->getFrontendOpts();
+    clang::CodeGenOptions&  CodeGenOpts = invocation->getCodeGenOpts();
+    size_t                  inputIndex = 0;
+    size_t                  targetIndex = 0;
+    for (const InvocationSlot& slot : slots) {
+        switch (slot.optionID) {
+            case OPT_INPUT: {
+                clang::FrontendInputFile& input = FrontendOpts.Inputs[inputIndex++];
+                input = clang::FrontendInputFile(slot.value, input.getKind(), input.isSystem());
+            } break;
+            case OPT_o: FrontendOpts.OutputFile = slot.value; break;
+            case OPT_main_file_name: CodeGenOpts.MainFileName = slot.value; break;
+            case OPT_dependency_file: invocation->getDependencyOutputOpts().OutputFile = slot.value; break;
+            // NOTE(khvorov) Targets are the -MT values in order and the key has the same number of them
+            case OPT_MT: invocation->getDependencyOutputOpts().Targets[targetIndex++] = slot.value; break;
+            case OPT_split_dwarf_file: CodeGenOpts.SplitDwarfFile = slot.value; break;
+            case OPT_split_dwarf_output: CodeGenOpts.SplitDwarfOutput = slot.value; break;
+        }
+    }
+    // NOTE(khvorov) Only there for CodeView
+    if (!CodeGenOpts.CommandLineArgs.empty()) {
+        CodeGenOpts.CommandLineArgs.assign(args.begin() + 1, args.end());
+    }
+}
+
+// NOTE(khvorov) args include the program name like CreateFromArgs expects
+static bool
+createInvocation(clang::CompilerInstance* Clang, clang::DiagnosticsEngine& Diags, const std::vector<const char*>& args) {
+    std::string                                      key;
+    std::vector<InvocationSlot>                      slots;
+    bool                                             cacheable = getInvocationKey(args, &key, &slots);
+    std::shared_ptr<const clang::CompilerInvocation> cached;
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(invocationCacheMutex);
+        auto                        entry = invocationCache.find(key);
+        if (entry != invocationCache.end()) {
+            cached = entry->second;
+        }
+    }
+
+    bool Success = true;
+    if (cached) {
+        std::shared_ptr<clang::CompilerInvocation> invocation = std::make_shared<clang::CompilerInvocation>(*cached);
+        patchInvocation(invocation.get(), slots, args);
+        Clang->setInvocation(std::move(invocation));
+    } else {
+        unsigned diagsBefore = Diags.getNumErrors() + Diags.getNumWarnings();
+        Success = clang::CompilerInvocation::CreateFromArgs(Clang->getInvocation(), Diags, (int)args.size(), (char**)args.data());
+        // NOTE(khvorov) A hit skips whatever parsing had to say so only the quiet ones go in
+        if (Success && cacheable && Diags.getNumErrors() + Diags.getNumWarnings() == diagsBefore) {
+            std::lock_guard<std::mutex> lock(invocationCacheMutex);
+            if (invocationCache.size() >= invocationCacheMaxEntries) {
+                invocationCache.clear();
+            }
+            invocationCache[key] = std::make_shared<const clang::CompilerInvocation>(Clang->getInvocation());
+        }
+    }
+    return Success;
+}
+
+static char*
+copyToMalloced(const std::string& str) {
+    char* result = (char*)malloc(str.size() + 1);
+    memcpy(result, str.c_str(), str.size() + 1);
+    return result;
+}
+
+extern "C" cc1_Session*
+cc1_createSession() {
+    return new cc1_Session();
+}
+
+extern "C" void
+cc1_destroySession(cc1_Session* session) {
+    delete session;
+}
+
+extern "C" bool
+cc1_compile(const cc1_Request* request, cc1_Result* result) {
+    return cc1_compileInSession(0, request, result);
+}
+
+extern "C" bool
+cc1_compileInSession(cc1_Session* session, const cc1_Request* request, cc1_Result* result) {
+    initTarget();
+    *result = {};
+
+    CollectingDiagConsumer                   diagConsumer;
+    llvm::SmallVector<char, 0>               output;
+    std::unique_ptr<clang::CompilerInstance> Clang(new clang::CompilerInstance());
+
+    auto PCHOps = Clang->getPCHContainerOperations();
+    PCHOps->registerWriter(std::make_unique<clang::ObjectFilePCHContainerWriter>());
+    PCHOps->registerReader(std::make_unique<clang::ObjectFilePCHContainerReader>());
+
+    // NOTE(khvorov) CreateFromArgs skips the program name
+    std::vector<const char*> args;
+    args.push_back("clang");
+    args.insert(args.end(), request->args, request->args + request->argCount);
+
+    clang::IntrusiveRefCntPtr<clang::DiagnosticIDs>     DiagID(new clang::DiagnosticIDs());
+    clang::IntrusiveRefCntPtr<clang::DiagnosticOptions> DiagOpts = new clang::DiagnosticOptions();
+    clang::DiagnosticsEngine                            ArgDiags(DiagID, &*DiagOpts, &diagConsumer, /*ShouldOwnClient=*/false);
+    bool Success = createInvocation(Clang.get(), ArgDiags, args);
+
+    if (Success) {
+        // NOTE(khvorov) -disable-free is fine for a process that exits right after, not for one that keeps compiling
+        Clang->getFrontendOpts().DisableFree = false;
+        Clang->createDiagnostics(&diagConsumer, /*ShouldOwnClient=*/false);
+
+        // NOTE(khvorov) In-memory files only exist for the one request so their FileManager doesn't outlive it
+        if (session && request->fileCount == 0) {
+            bool warm = session->fileManager && session->fileManager->getFileSystemOpts().WorkingDir == Clang->getFileSystemOpts().WorkingDir && session->recordingFS->unchanged();
+            if (!warm) {
+                session->recordingFS = new RecordingFileSystem(llvm::vfs::getRealFileSystem());
+                session->fileManager = new clang::FileManager(Clang->getFileSystemOpts(), session->recordingFS);
+            }
+            Clang->setFileManager(session->fileManager.get());
+        } else {
+            llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem>  OverlayFS(new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
+            llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> MemoryFS(new llvm::vfs::InMemoryFileSystem());
+            OverlayFS->pushOverlay(MemoryFS);
+            for (int32_t fileIndex = 0; fileIndex < request->fileCount; fileIndex++) {
+                const cc1_File* file = request->files + fileIndex;
+                llvm::StringRef content(file->content, (size_t)file->contentLen);
+                MemoryFS->addFile(file->path, 0, llvm::MemoryBuffer::getMemBuffer(content, file->path, /*RequiresNullTerminator=*/false));
+            }
+            Clang->createFileManager(OverlayFS);
+        }
+
+        Clang->setOutputStream(std::make_unique<llvm::raw_svector_ostream>(output));
+        Success = executeInvocation(Clang.get());
+    }
+
+    // NOTE(khvorov) Everything in the result is malloced so the caller doesn't need our allocator to free it
+    result->success = Success;
+    if (!output.empty()) {
+        result->output = (uint8_t*)malloc(output.size());
+        memcpy(result->output, output.data(), output.size());
+        result->outputLen = (intptr_t)output.size();
+    }
+    if (!diagConsumer.records.empty()) {
+        result->diags = (cc1_Diag*)calloc(diagConsumer.records.size(), sizeof(cc1_Diag));
+        result->diagCount = (int32_t)diagConsumer.records.size();
+        for (int32_t diagIndex = 0; diagIndex < result->diagCount; diagIndex++) {
+            const CollectingDiagConsumer::Record& record = diagConsumer.records[diagIndex];
+            cc1_Diag*                             diag = result->diags + diagIndex;
+            diag->level = record.level;
+            diag->file = copyToMalloced(record.file);
+            diag->line = record.line;
+            diag->column = record.column;
+            diag->message = copyToMalloced(record.message);
+        }
+    }
+
+    return Success;
+}
+
+extern "C" void
+cc1_freeResult(cc1_Result* result) {
+    free(result->output);
+    for (int32_t diagIndex = 0; diagIndex < result->diagCount; diagIndex++) {
+        free((void*)result->diags[diagIndex].file);
+        free((void*)result->diags[diagIndex].message);
+    }
+    free(result->diags);
+    *result = {};
+}
+
+// NOTE(khvorov) Stat results and file contents shared by every compile in a batch.
+// Contents are only kept once a second open asks for them, so the main files (read once) don't pile up in memory.
+class SharedCacheFileSystem : public llvm::vfs::ProxyFileSystem {
+public:
+    explicit SharedCacheFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs) : ProxyFileSystem(std::move(fs)) {}
+
+    llvm::ErrorOr<llvm::vfs::Status>
+    status(const llvm::Twine& path) override {
+        std::string                                      pathStr = path.str();
+        llvm::Optional<llvm::ErrorOr<llvm::vfs::Status>> cached;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto                        entry = entries.find(pathStr);
+            if (entry != entries.end() && entry->second.haveStatus) {
+                cached = entry->second.status;
+            }
+        }
+
+        llvm::ErrorOr<llvm::vfs::Status> result = cached ? *cached : ProxyFileSystem::status(pathStr);
+        if (!cached) {
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry&                      entry = entries[pathStr];
+            entry.status = result;
+            entry.haveStatus = true;
+        }
+        return result;
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine& path) override {
+        std::string               pathStr = path.str();
+        const llvm::MemoryBuffer* buffer = 0;
+        llvm::vfs::Status         bufferStatus;
+        bool                      shouldCache = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry&                      entry = entries[pathStr];
+            entry.opens += 1;
+            if (entry.buffer) {
+                buffer = entry.buffer.get();
+                bufferStatus = entry.bufferStatus;
+            }
+            shouldCache = !entry.buffer && entry.opens > 1;
+        }
+
+        llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> result = std::error_code();
+        if (buffer) {
+            result = std::make_unique<CachedFile>(bufferStatus, buffer);
+        } else {
+            result = ProxyFileSystem::openFileForRead(pathStr);
+            if (result && shouldCache) {
+                llvm::ErrorOr<llvm::vfs::Status>                  fileStatus = (*result)->status();
+                llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> fileBuffer = (*result)->getBuffer(pathStr);
+                if (fileStatus && fileBuffer) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    Entry&                      entry = entries[pathStr];
+                    if (!entry.buffer) {
+                        entry.buffer = std::move(*fileBuffer);
+                        entry.bufferStatus = *fileStatus;
+                    }
+                    result = std::make_unique<CachedFile>(entry.bufferStatus, entry.buffer.get());
+                } else {
+                    result = ProxyFileSystem::openFileForRead(pathStr);
+                }
+            }
+        }
+        return result;
+    }
+
+private:
+    struct Entry {
+        bool                                haveStatus = false;
+        llvm::ErrorOr<llvm::vfs::Status>    status = std::error_code();
+        int32_t                             opens = 0;
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+        llvm::vfs::Status                   bufferStatus;
+    };
+
+    // NOTE(khvorov) Hands out views of a buffer the cache keeps alive for the whole batch
+    class CachedFile : public llvm::vfs::File {
+    public:
+        CachedFile(llvm::vfs::Status fileStatus, const llvm::MemoryBuffer* buffer) : fileStatus(fileStatus), buffer(buffer) {}
+
+        llvm::ErrorOr<llvm::vfs::Status>
+        status() override {
+            return fileStatus;
+        }
+
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+        getBuffer(const llvm::Twine& name, int64_t, bool requiresNullTerminator, bool) override {
+            return llvm::MemoryBuffer::getMemBuffer(buffer->getBuffer(), name.str(), requiresNullTerminator);
+        }
+
+        std::error_code
+        close() override {
+            return std::error_code();
+        }
+
+    private:
+        llvm::vfs::Status         fileStatus;
+        const llvm::MemoryBuffer* buffer;
+    };
+
+    std::mutex             mutex;
+    llvm::StringMap<Entry> entries;
+};
+
+struct BatchEntry {
+    std::vector<std::string> args;
+    std::string              input;
+};
+
+// NOTE(khvorov) First line is the base cc1 invocation, every line after is "<input> <output> [per-file args]".
+// Arguments are split on whitespace, same as build.c does it.
+static bool
+readBatchManifest(const char* path, std::vector<BatchEntry>* entries) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> manifest = llvm::MemoryBuffer::getFile(path);
+    bool                                               result = (bool)manifest;
+    if (result) {
+        llvm::SmallVector<llvm::StringRef, 0> lines;
+        (*manifest)->getBuffer().split(lines, '\n', -1, /*KeepEmpty=*/false);
+
+        llvm::SmallVector<llvm::StringRef, 0> baseArgs;
+        for (size_t lineIndex = 0; lineIndex < lines.size() && result; lineIndex++) {
+            llvm::SmallVector<llvm::StringRef, 0> parts;
+            llvm::SplitString(lines[lineIndex], parts);
+            if (lineIndex == 0) {
+                baseArgs = parts;
+            } else if (parts.size() >= 2) {
+                BatchEntry entry;
+                entry.input = parts[0].str();
+                entry.args.push_back("clang");
+                entry.args.insert(entry.args.end(), baseArgs.begin(), baseArgs.end());
+                entry.args.insert(entry.args.end(), parts.begin() + 2, parts.end());
+                entry.args.push_back(parts[0].str());
+                entry.args.push_back("-o");
+                entry.args.push_back(parts[1].str());
+                entries->push_back(std::move(entry));
+            } else if (!parts.empty()) {
+                llvm::errs() << path << ":" << lineIndex + 1 << ": expected <input> <output> [args]\n";
+                result = false;
+            }
+        }
+    } else {
+        llvm::errs() << path << ": " << manifest.getError().message() << "\n";
+    }
+    return result;
+}
+
+static bool
+compileBatchEntry(const BatchEntry& entry, llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs, std::string* diagText) {
+    llvm::raw_string_ostream                 diagStream(*diagText);
+    std::unique_ptr<clang::CompilerInstance> Clang(new clang::CompilerInstance());
+
+    auto PCHOps = Clang->getPCHContainerOperations();
+    PCHOps->registerWriter(std::make_unique<clang::ObjectFilePCHContainerWriter>());
+    PCHOps->registerReader(std::make_unique<clang::ObjectFilePCHContainerReader>());
+
+    std::vector<const char*> args;
+    for (const std::string& arg : entry.args) {
+        args.push_back(arg.c_str());
+    }
+
+    clang::IntrusiveRefCntPtr<clang::DiagnosticIDs>     DiagID(new clang::DiagnosticIDs());
+    clang::IntrusiveRefCntPtr<clang::DiagnosticOptions> DiagOpts = new clang::DiagnosticOptions();
+    clang::TextDiagnosticPrinter                        ArgDiagPrinter(diagStream, &*DiagOpts);
+    clang::DiagnosticsEngine                            ArgDiags(DiagID, &*DiagOpts, &ArgDiagPrinter, /*ShouldOwnClient=*/false);
+    bool Success = createInvocation(Clang.get(), ArgDiags, args);
+
+    if (Success) {
+        Clang->getFrontendOpts().DisableFree = false;
+        Clang->createDiagnostics(new clang::TextDiagnosticPrinter(diagStream, &Clang->getDiagnosticOpts()), /*ShouldOwnClient=*/true);
+        Clang->createFileManager(fs);
+        Success = executeInvocation(Clang.get());
+    }
+
+    diagStream.flush();
+    return Success;
+}
+
+// NOTE(khvorov) Make's jobserver found the same way prb_joinJobserver in cbuild.h does it, -1 when there isn't one
+static int
+joinJobserver() {
+    int         result = -1;
+    const char* makeflags = getenv("MAKEFLAGS");
+    if (makeflags) {
+        llvm::StringRef                       auth;
+        llvm::SmallVector<llvm::StringRef, 0> flags;
+        llvm::SplitString(makeflags, flags);
+        for (llvm::StringRef flag : flags) {
+            if (flag.startswith("--jobserver-auth=") || flag.startswith("--jobserver-fds=")) {
+                auth = flag.split('=').second;
+            }
+        }
+
+        // NOTE(khvorov) Reopening the pipe through /proc gives us our own file description to make non-blocking
+        std::string path;
+        if (auth.startswith("fifo:")) {
+            path = auth.drop_front(strlen("fifo:")).str();
+        } else if (!auth.empty()) {
+            int readFd = -1;
+            if (!auth.split(',').first.getAsInteger(10, readFd) && fcntl(readFd, F_GETFD) != -1) {
+                path = "/proc/self/fd/" + std::to_string(readFd);
+            }
+        }
+        if (!path.empty()) {
+            result = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        }
+    }
+    return result;
+}
+
+// NOTE(khvorov) Every process gets one slot for free, the rest are tokens from the jobserver that go back when the compile is done
+class JobSlots {
+public:
+    explicit JobSlots(int fd) : fd(fd) {}
+
+    ~JobSlots() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    // NOTE(khvorov) noToken is for when there is nothing to give back, no jobserver or it went away mid-wait
+    static constexpr int freeSlot = -1;
+    static constexpr int noToken = -2;
+
+    // NOTE(khvorov) The jobserver token to give back, freeSlot or noToken
+    int
+    acquire() {
+        int  result = noToken;
+        bool acquired = fd == -1;
+        while (!acquired) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                acquired = freeSlotAvailable;
+                freeSlotAvailable = false;
+            }
+            if (acquired) {
+                result = freeSlot;
+            } else {
+                unsigned char token = 0;
+                ssize_t       got = read(fd, &token, 1);
+                if (got == 1) {
+                    result = token;
+                    acquired = true;
+                } else if (got == -1 && errno != EAGAIN && errno != EINTR) {
+                    // NOTE(khvorov) Jobserver went away, nobody to ask anymore
+                    acquired = true;
+                } else {
+                    // NOTE(khvorov) Wake up now and then to check whether the free slot came back
+                    pollfd pfd = {fd, POLLIN, 0};
+                    poll(&pfd, 1, 50);
+                }
+            }
+        }
+        return result;
+    }
+
+    void
+    release(int token) {
+        if (fd != -1 && token != noToken) {
+            if (token == freeSlot) {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeSlotAvailable = true;
+            } else {
+                unsigned char tokenByte = (unsigned char)token;
+                while (write(fd, &tokenByte, 1) == -1 && errno == EINTR) {}
+            }
+        }
+    }
+
+private:
+    int        fd;
+    std::mutex mutex;
+    bool       freeSlotAvailable = true;
+};
+
+// NOTE(khvorov) Every compile gets its own CompilerInstance and FileManager (neither is thread-safe),
+// what they share is the stat/contents cache underneath and the process-wide setup.
+extern "C" int
+cc1_batch(const char* manifestPath, int workerCount) {
+    initTarget();
+
+    std::vector<BatchEntry> entries;
+    bool                    Success = readBatchManifest(manifestPath, &entries);
+    if (Success) {
+        llvm::IntrusiveRefCntPtr<SharedCacheFileSystem> sharedFS(new SharedCacheFileSystem(llvm::vfs::getRealFileSystem()));
+        std::mutex                                      reportMutex;
+        std::atomic<bool>                               allSucceeded(true);
+
+        // NOTE(khvorov) Without -j a thread per core, each of them waiting on make's jobserver when there is one
+        JobSlots         slots(workerCount > 0 ? -1 : joinJobserver());
+        llvm::ThreadPool pool(llvm::hardware_concurrency(workerCount > 0 ? (unsigned)workerCount : 0));
+        for (const BatchEntry& entry : entries) {
+            pool.async([&entry, &sharedFS, &reportMutex, &allSucceeded, &slots]() {
+                std::string diagText;
+                int         token = slots.acquire();
+                bool        entrySucceeded = compileBatchEntry(entry, sharedFS, &diagText);
+                slots.release(token);
+                if (!entrySucceeded) {
+                    allSucceeded = false;
+                }
+                // NOTE(khvorov) Whole compiles at a time so diagnostics from different files don't interleave
+                if (!diagText.empty() || !entrySucceeded) {
+                    std::lock_guard<std::mutex> lock(reportMutex);
+                    llvm::errs() << diagText;
+                    if (!entrySucceeded) {
+                        llvm::errs() << "FAILED: " << entry.input << "\n";
+                    }
+                }
+            });
+        }
+        pool.wait();
+        Success = allSucceeded;
+    }
+
+    int result = !Success;
+    return result;
+}
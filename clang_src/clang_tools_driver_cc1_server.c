@@ -0,0 +1,407 @@
+#include "clang_tools_driver_cc1.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// NOTE(khvorov) One request per connection, everything native-endian since both ends are on the same machine.
+// Request: i64 payloadLen, then i32 argCount, i32 fileCount, args as (i32 len, bytes), files as (i32 len, path, i64 len, content).
+// Response: i64 payloadLen, then i32 success, i32 diagCount, i64 outputLen, output,
+// diags as (i32 level, i32 line, i32 column, i32 len, file, i32 len, message).
+// Every string length counts its null terminator so the receiving end can point straight into the payload.
+// A payload over maxMessageLen is treated like a broken connection.
+
+static const int64_t maxMessageLen = 1ll << 30;
+
+// NOTE(khvorov) A client sends its whole request right after connecting so one that goes quiet for this long is gone
+static const int serverRecvTimeoutSeconds = 30;
+
+typedef struct Buffer {
+    uint8_t* ptr;
+    int64_t  len;
+    int64_t  cap;
+} Buffer;
+
+typedef struct Cursor {
+    const uint8_t* ptr;
+    int64_t        len;
+    int64_t        offset;
+    bool           ok;
+} Cursor;
+
+static void
+bufferAppend(Buffer* buffer, const void* data, int64_t len) {
+    if (len > 0) {
+        if (buffer->len + len > buffer->cap) {
+            buffer->cap = (buffer->len + len) * 2;
+            buffer->ptr = realloc(buffer->ptr, buffer->cap);
+        }
+        memcpy(buffer->ptr + buffer->len, data, len);
+        buffer->len += len;
+    }
+}
+
+static void
+bufferAppendI32(Buffer* buffer, int32_t value) {
+    bufferAppend(buffer, &value, sizeof(value));
+}
+
+static void
+bufferAppendI64(Buffer* buffer, int64_t value) {
+    bufferAppend(buffer, &value, sizeof(value));
+}
+
+static void
+bufferAppendStr(Buffer* buffer, const char* str) {
+    int32_t len = (int32_t)strlen(str) + 1;
+    bufferAppendI32(buffer, len);
+    bufferAppend(buffer, str, len);
+}
+
+static const void*
+cursorTake(Cursor* cursor, int64_t len) {
+    const void* result = 0;
+    cursor->ok = cursor->ok && len >= 0 && cursor->offset + len <= cursor->len;
+    if (cursor->ok) {
+        result = cursor->ptr + cursor->offset;
+        cursor->offset += len;
+    }
+    return result;
+}
+
+static int32_t
+cursorTakeI32(Cursor* cursor) {
+    int32_t     result = 0;
+    const void* ptr = cursorTake(cursor, sizeof(result));
+    if (ptr) {
+        memcpy(&result, ptr, sizeof(result));
+    }
+    return result;
+}
+
+static int64_t
+cursorTakeI64(Cursor* cursor) {
+    int64_t     result = 0;
+    const void* ptr = cursorTake(cursor, sizeof(result));
+    if (ptr) {
+        memcpy(&result, ptr, sizeof(result));
+    }
+    return result;
+}
+
+static const char*
+cursorTakeStr(Cursor* cursor) {
+    int32_t     len = cursorTakeI32(cursor);
+    const char* result = cursorTake(cursor, len);
+    cursor->ok = cursor->ok && len > 0 && result[len - 1] == '\0';
+    return cursor->ok ? result : "";
+}
+
+static bool
+sendAll(int fd, const void* data, int64_t len) {
+    bool result = true;
+    for (int64_t sent = 0; sent < len && result;) {
+        ssize_t sentNow = send(fd, (const uint8_t*)data + sent, len - sent, MSG_NOSIGNAL);
+        result = sentNow > 0;
+        sent += sentNow;
+    }
+    return result;
+}
+
+static bool
+recvAll(int fd, void* data, int64_t len) {
+    bool result = true;
+    for (int64_t got = 0; got < len && result;) {
+        ssize_t gotNow = recv(fd, (uint8_t*)data + got, len - got, 0);
+        result = gotNow > 0;
+        got += gotNow;
+    }
+    return result;
+}
+
+static bool
+sendMessage(int fd, Buffer payload) {
+    bool result = sendAll(fd, &payload.len, sizeof(payload.len)) && sendAll(fd, payload.ptr, payload.len);
+    return result;
+}
+
+// NOTE(khvorov) Malloced, 0 on a broken connection, a payload that is too big or no memory for it
+static uint8_t*
+recvMessage(int fd, int64_t* len) {
+    uint8_t* result = 0;
+    if (recvAll(fd, len, sizeof(*len)) && *len >= 0 && *len <= maxMessageLen) {
+        result = malloc(*len + 1);
+        if (result && !recvAll(fd, result, *len)) {
+            free(result);
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static struct sockaddr_un
+getSocketAddr(const char* socketPath) {
+    struct sockaddr_un result = {.sun_family = AF_UNIX};
+    strncpy(result.sun_path, socketPath, sizeof(result.sun_path) - 1);
+    return result;
+}
+
+static void
+serveRequest(int fd, cc1_Session* session) {
+    int64_t  requestLen = 0;
+    uint8_t* request = recvMessage(fd, &requestLen);
+    if (request) {
+        Cursor       cursor = {.ptr = request, .len = requestLen, .ok = true};
+        int32_t      argCount = cursorTakeI32(&cursor);
+        int32_t      fileCount = cursorTakeI32(&cursor);
+        bool         countsOk = cursor.ok && argCount >= 0 && fileCount >= 0 && (int64_t)argCount + fileCount <= requestLen;
+        const char** args = countsOk ? calloc(argCount + 1, sizeof(*args)) : 0;
+        cc1_File*    files = countsOk ? calloc(fileCount + 1, sizeof(*files)) : 0;
+        for (int32_t argIndex = 0; argIndex < argCount && countsOk; argIndex++) {
+            args[argIndex] = cursorTakeStr(&cursor);
+        }
+        for (int32_t fileIndex = 0; fileIndex < fileCount && countsOk; fileIndex++) {
+            files[fileIndex].path = cursorTakeStr(&cursor);
+            files[fileIndex].contentLen = cursorTakeI64(&cursor);
+            files[fileIndex].content = cursorTake(&cursor, files[fileIndex].contentLen);
+        }
+
+        if (countsOk && cursor.ok) {
+            cc1_Request compileRequest = {.args = args, .argCount = argCount, .files = files, .fileCount = fileCount};
+            cc1_Result  result = {};
+            cc1_compileInSession(session, &compileRequest, &result);
+
+            Buffer response = {};
+            bufferAppendI32(&response, result.success);
+            bufferAppendI32(&response, result.diagCount);
+            bufferAppendI64(&response, result.outputLen);
+            bufferAppend(&response, result.output, result.outputLen);
+            for (int32_t diagIndex = 0; diagIndex < result.diagCount; diagIndex++) {
+                cc1_Diag* diag = result.diags + diagIndex;
+                bufferAppendI32(&response, diag->level);
+                bufferAppendI32(&response, diag->line);
+                bufferAppendI32(&response, diag->column);
+                bufferAppendStr(&response, diag->file);
+                bufferAppendStr(&response, diag->message);
+            }
+            sendMessage(fd, response);
+
+            free(response.ptr);
+            cc1_freeResult(&result);
+        }
+
+        free(args);
+        free(files);
+        free(request);
+    }
+}
+
+static void*
+serveConnections(void* data) {
+    int          listenFd = (int)(intptr_t)data;
+    cc1_Session* session = cc1_createSession();
+    for (;;) {
+        int connFd = accept(listenFd, 0, 0);
+        if (connFd != -1) {
+            struct timeval timeout = {.tv_sec = serverRecvTimeoutSeconds};
+            setsockopt(connFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            serveRequest(connFd, session);
+            close(connFd);
+        }
+    }
+    return 0;
+}
+
+// NOTE(khvorov) Every worker accepts on the same socket and has its own session so warm caches are never shared between threads
+int
+cc1_serve(const char* socketPath, int workerCount) {
+    int                result = 1;
+    int                listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = getSocketAddr(socketPath);
+    unlink(socketPath);
+    if (listenFd != -1 && bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) == 0 && listen(listenFd, 128) == 0) {
+        fprintf(stderr, "serving cc1 on %s with %d workers\n", socketPath, workerCount);
+        for (int workerIndex = 1; workerIndex < workerCount; workerIndex++) {
+            pthread_t thread;
+            if (pthread_create(&thread, 0, serveConnections, (void*)(intptr_t)listenFd) == 0) {
+                pthread_detach(thread);
+            }
+        }
+        serveConnections((void*)(intptr_t)listenFd);
+        result = 0;
+    } else {
+        fprintf(stderr, "%s: %s\n", socketPath, strerror(errno));
+    }
+    return result;
+}
+
+static const char*
+getDiagLevelName(int32_t level) {
+    const char* result = "";
+    switch (level) {
+        case cc1_DiagLevel_Ignored: result = "ignored"; break;
+        case cc1_DiagLevel_Note: result = "note"; break;
+        case cc1_DiagLevel_Remark: result = "remark"; break;
+        case cc1_DiagLevel_Warning: result = "warning"; break;
+        case cc1_DiagLevel_Error: result = "error"; break;
+        case cc1_DiagLevel_Fatal: result = "fatal error"; break;
+    }
+    return result;
+}
+
+// NOTE(khvorov) Joined -o<path>. The option table picks the longest match so these cc1 options are not -o.
+static bool
+isJoinedOutputArg(const char* arg) {
+    const char* longerOptions[] = {"-objc", "-object-file-name", "-opaque-pointers", "-opt-record-"};
+    bool        result = strncmp(arg, "-o", strlen("-o")) == 0 && arg[strlen("-o")] != '\0';
+    for (size_t optionIndex = 0; optionIndex < sizeof(longerOptions) / sizeof(longerOptions[0]) && result; optionIndex++) {
+        result = strncmp(arg, longerOptions[optionIndex], strlen(longerOptions[optionIndex])) != 0;
+    }
+    return result;
+}
+
+// NOTE(khvorov) cc1 options that name a file the compile writes itself. -working-directory only applies to inputs
+// so a relative one of these would land in the server's directory.
+static const char*
+getWrittenPathOption(const char* arg) {
+    const char* options[] = {
+        "-dependency-file",
+        "-split-dwarf-output",
+        "-header-include-file",
+        "-stack-usage-file",
+        "-opt-record-file",
+        "-coverage-notes-file",
+        "-coverage-data-file",
+        "-stats-file=",
+    };
+    const char* result = 0;
+    for (size_t optionIndex = 0; optionIndex < sizeof(options) / sizeof(options[0]) && !result; optionIndex++) {
+        const char* option = options[optionIndex];
+        size_t      optionLen = strlen(option);
+        bool        joined = option[optionLen - 1] == '=';
+        if (joined ? strncmp(arg, option, optionLen) == 0 : strcmp(arg, option) == 0) {
+            result = option;
+        }
+    }
+    return result;
+}
+
+// NOTE(khvorov) prefix then path, with cwd in front of a relative path
+static void
+bufferAppendWrittenPath(Buffer* buffer, const char* cwd, const char* prefix, const char* path) {
+    bool relative = path[0] != '/' && strcmp(path, "-") != 0;
+    bufferAppendI32(buffer, (int32_t)(strlen(prefix) + (relative ? strlen(cwd) + 1 : 0) + strlen(path) + 1));
+    bufferAppend(buffer, prefix, strlen(prefix));
+    if (relative) {
+        bufferAppend(buffer, cwd, strlen(cwd));
+        bufferAppend(buffer, "/", 1);
+    }
+    bufferAppend(buffer, path, strlen(path) + 1);
+}
+
+// NOTE(khvorov) args are what comes after -cc1 (what clang.exe takes on its own). The server may be in a different
+// directory so this sends ours along, relative inputs and -o are ours and every other file the compile writes gets
+// our directory in front (see getWrittenPathOption). With no server the compile runs right here.
+int
+cc1_client(const char* socketPath, const char* argv0, int argCount, char** args) {
+    int                result = 1;
+    int                fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = getSocketAddr(socketPath);
+    if (fd != -1 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        const char* outPath = 0;
+        bool        haveWorkingDir = false;
+        for (int argIndex = 0; argIndex < argCount; argIndex++) {
+            const char* arg = args[argIndex];
+            if (strcmp(arg, "-o") == 0 && argIndex + 1 < argCount) {
+                outPath = args[argIndex + 1];
+            } else if (isJoinedOutputArg(arg)) {
+                outPath = arg + strlen("-o");
+            }
+            haveWorkingDir = haveWorkingDir || strncmp(arg, "-working-directory", strlen("-working-directory")) == 0;
+        }
+
+        char cwd[4096] = {};
+        bool argsOk = getcwd(cwd, sizeof(cwd));
+        if (!argsOk) {
+            fprintf(stderr, "getcwd: %s\n", strerror(errno));
+        }
+
+        Buffer request = {};
+        bufferAppendI32(&request, argCount + (haveWorkingDir ? 0 : 2));
+        bufferAppendI32(&request, 0);
+        for (int argIndex = 0; argIndex < argCount; argIndex++) {
+            const char* arg = args[argIndex];
+            const char* writtenPathOption = getWrittenPathOption(arg);
+            const char* prevWrittenPathOption = argIndex > 0 ? getWrittenPathOption(args[argIndex - 1]) : 0;
+            if (writtenPathOption && writtenPathOption[strlen(writtenPathOption) - 1] == '=') {
+                bufferAppendWrittenPath(&request, cwd, writtenPathOption, arg + strlen(writtenPathOption));
+            } else if (prevWrittenPathOption && prevWrittenPathOption[strlen(prevWrittenPathOption) - 1] != '=') {
+                bufferAppendWrittenPath(&request, cwd, "", arg);
+            } else {
+                bufferAppendStr(&request, arg);
+            }
+        }
+        if (!haveWorkingDir) {
+            bufferAppendStr(&request, "-working-directory");
+            bufferAppendStr(&request, cwd);
+        }
+
+        int64_t  responseLen = 0;
+        uint8_t* response = argsOk && sendMessage(fd, request) ? recvMessage(fd, &responseLen) : 0;
+        if (response) {
+            Cursor         cursor = {.ptr = response, .len = responseLen, .ok = true};
+            bool           success = cursorTakeI32(&cursor);
+            int32_t        diagCount = cursorTakeI32(&cursor);
+            int64_t        outputLen = cursorTakeI64(&cursor);
+            const uint8_t* output = cursorTake(&cursor, outputLen);
+            for (int32_t diagIndex = 0; diagIndex < diagCount && cursor.ok; diagIndex++) {
+                int32_t     level = cursorTakeI32(&cursor);
+                int32_t     line = cursorTakeI32(&cursor);
+                int32_t     column = cursorTakeI32(&cursor);
+                const char* file = cursorTakeStr(&cursor);
+                const char* message = cursorTakeStr(&cursor);
+                if (file[0] != '\0') {
+                    fprintf(stderr, "%s:%d:%d: ", file, line, column);
+                }
+                fprintf(stderr, "%s: %s\n", getDiagLevelName(level), message);
+            }
+
+            // NOTE(khvorov) A failed compile leaves no output behind, same as a local one
+            if (cursor.ok && success && outputLen > 0 && !outPath) {
+                fprintf(stderr, "got %lld bytes of output and no -o to write them to\n", (long long)outputLen);
+                success = false;
+            } else if (cursor.ok && success && outputLen > 0) {
+                FILE* outFile = strcmp(outPath, "-") == 0 ? stdout : fopen(outPath, "wb");
+                bool  written = outFile && fwrite(output, 1, outputLen, outFile) == (size_t)outputLen;
+                if (outFile && outFile != stdout) {
+                    written = fclose(outFile) == 0 && written;
+                }
+                if (!written) {
+                    fprintf(stderr, "%s: %s\n", outPath, strerror(errno));
+                }
+                success = written;
+            }
+            result = cursor.ok && success ? 0 : 1;
+            free(response);
+        } else if (argsOk) {
+            fprintf(stderr, "%s: lost the connection to the server\n", socketPath);
+        }
+        free(request.ptr);
+    } else {
+        char** localArgv = calloc(argCount + 2, sizeof(*localArgv));
+        localArgv[0] = (char*)argv0;
+        memcpy(localArgv + 1, args, argCount * sizeof(*args));
+        result = cc1_main(argCount + 1, localArgv);
+        free(localArgv);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    return result;
+}
@@ -1,6 +1,28 @@
-int cc1_main(int argc, char** argv);
+#include "clang_tools_driver_cc1.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 int
 main(int argc, char** argv) {
-    return cc1_main(argc, argv);
-}
\ No newline at end of file
+    int result = 0;
+    if (argc >= 3 && strcmp(argv[1], "--serve") == 0) {
+        int workerCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (argc >= 5 && strcmp(argv[3], "-j") == 0) {
+            workerCount = atoi(argv[4]);
+        }
+        result = cc1_serve(argv[2], workerCount > 0 ? workerCount : 1);
+    } else if (argc >= 3 && strcmp(argv[1], "-batch") == 0) {
+        int workerCount = 0;
+        if (argc >= 5 && strcmp(argv[3], "-j") == 0) {
+            workerCount = atoi(argv[4]);
+        }
+        result = cc1_batch(argv[2], workerCount);
+    } else if (argc >= 3 && strcmp(argv[1], "-client") == 0) {
+        result = cc1_client(argv[2], argv[0], argc - 3, argv + 3);
+    } else {
+        result = cc1_main(argc, argv);
+    }
+    return result;
+}
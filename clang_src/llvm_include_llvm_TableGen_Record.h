@@ -2002,7 +2002,33 @@ public:
 
   void dump() const;
 
+  //===--------------------------------------------------------------------===//
+  // Analyses that several backends build from the same records.
+
+  /// Return the T built from these records, building it on first use. T needs
+  /// a constructor that takes the RecordKeeper and a `static char SharedID`
+  /// whose address identifies it. It lives until clearSharedAnalyses or the
+  /// RecordKeeper goes away, so only backends that leave it unchanged may use
+  /// it.
+  template <typename T> T &getSharedAnalysis() {
+    std::unique_ptr<SharedAnalysisBase> &Slot = SharedAnalyses[&T::SharedID];
+    if (!Slot)
+      Slot = std::make_unique<SharedAnalysis<T>>(*this);
+    return static_cast<SharedAnalysis<T> &>(*Slot).Value;
+  }
+
+  /// Drop every analysis built by getSharedAnalysis.
+  void clearSharedAnalyses() { SharedAnalyses.clear(); }
+
 private:
+  struct SharedAnalysisBase {
+    virtual ~SharedAnalysisBase() = default;
+  };
+  template <typename T> struct SharedAnalysis : SharedAnalysisBase {
+    explicit SharedAnalysis(RecordKeeper &Records) : Value(Records) {}
+    T Value;
+  };
+
   RecordKeeper(RecordKeeper &&) = delete;
   RecordKeeper(const RecordKeeper &) = delete;
   RecordKeeper &operator=(RecordKeeper &&) = delete;
@@ -2022,6 +2048,9 @@ private:
 
   /// The internal uniquer implementation of the RecordKeeper.
   std::unique_ptr<detail::RecordKeeperImpl> Impl;
+
+  /// Declared last so the analyses go before the records they were built from.
+  std::map<const char *, std::unique_ptr<SharedAnalysisBase>> SharedAnalyses;
 };
 
 /// Sorting predicate to sort record pointers by name.
@@ -16,9 +16,11 @@
 
 #include "llvm_include_llvm_TableGen_Main.h"
 #include "llvm_lib_TableGen_TGParser.h"
+#include "llvm_include_llvm_ADT_ScopeExit.h"
 #include "llvm_include_llvm_Support_CommandLine.h"
 #include "llvm_include_llvm_Support_FileSystem.h"
 #include "llvm_include_llvm_Support_MemoryBuffer.h"
+#include "llvm_include_llvm_Support_StringSaver.h"
 #include "llvm_include_llvm_Support_ToolOutputFile.h"
 #include "llvm_include_llvm_TableGen_Error.h"
 #include "llvm_include_llvm_TableGen_Record.h"
@@ -47,6 +49,13 @@ static cl::list<std::string>
 MacroNames("D", cl::desc("Name of the macro to be defined"),
             cl::value_desc("macro name"), cl::Prefix);
 
+static cl::opt<std::string>
+BackendsFilename("backends",
+                 cl::desc("Parse the input once and run one backend per line "
+                          "of this file. Each line holds the options for that "
+                          "backend, including its own -o"),
+                 cl::value_desc("filename"), cl::init(""));
+
 static cl::opt<bool>
 WriteIfChanged("write-if-changed", cl::desc("Only write output if it changed"));
 
@@ -85,6 +94,92 @@ static int createDependencyFile(const TGParser &Parser, const char *argv0) {
   return 0;
 }
 
+/// Write the depfile and the backend output to the files named by the options
+/// currently in effect.
+static int writeOutputs(const TGParser &Parser, const char *argv0,
+                        RecordKeeper &Records, const std::string &Out) {
+  // Always write the depfile, even if the main output hasn't changed.
+  // If it's missing, Ninja considers the output dirty.  If this was below
+  // the early exit below and someone deleted the .inc.d file but not the .inc
+  // file, tablegen would never write the depfile.
+  if (!DependFilename.empty()) {
+    if (int Ret = createDependencyFile(Parser, argv0))
+      return Ret;
+  }
+
+  Records.startTimer("Write output");
+  bool WriteFile = true;
+  if (WriteIfChanged) {
+    // Only updates the real output file if there are any differences.
+    // This prevents recompilation of all the files depending on it if there
+    // aren't any.
+    if (auto ExistingOrErr =
+            MemoryBuffer::getFile(OutputFilename, /*IsText=*/true))
+      if (std::move(ExistingOrErr.get())->getBuffer() == Out)
+        WriteFile = false;
+  }
+  if (WriteFile) {
+    std::error_code EC;
+    ToolOutputFile OutFile(OutputFilename, EC, sys::fs::OF_Text);
+    if (EC)
+      return reportError(argv0, "error opening " + OutputFilename + ": " +
+                                    EC.message() + "\n");
+    OutFile.os() << Out;
+    if (ErrorsPrinted == 0)
+      OutFile.keep();
+  }
+  Records.stopTimer();
+  return 0;
+}
+
+/// Run MainFn once per line of the -backends file on the records that were
+/// already parsed. Every option is reset and parsed again from the line so that
+/// each backend sees exactly what it would have seen on its own command line.
+/// The backends share one RecordKeeper, which is not thread-safe, so they run
+/// one after another. Backends that only read the CodeGen analyses also share
+/// those (see RecordKeeper::getSharedAnalysis), for this call only.
+static int runBackends(const TGParser &Parser, const char *argv0,
+                       RecordKeeper &Records, TableGenMainFn *MainFn) {
+  auto ClearShared = make_scope_exit([&] { Records.clearSharedAnalyses(); });
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BackendsOrErr =
+      MemoryBuffer::getFile(BackendsFilename, /*IsText=*/true);
+  if (std::error_code EC = BackendsOrErr.getError())
+    return reportError(argv0, "Could not open backends file '" +
+                                  BackendsFilename + "': " + EC.message() +
+                                  "\n");
+  std::unique_ptr<MemoryBuffer> Backends = std::move(*BackendsOrErr);
+
+  SmallVector<StringRef, 16> Lines;
+  Backends->getBuffer().split(Lines, '\n', /*MaxSplit=*/-1,
+                              /*KeepEmpty=*/false);
+  BumpPtrAllocator Alloc;
+  StringSaver Saver(Alloc);
+  for (StringRef Line : Lines) {
+    Line = Line.trim();
+    if (Line.empty())
+      continue;
+
+    SmallVector<const char *, 16> Args = {argv0};
+    cl::TokenizeGNUCommandLine(Line, Saver, Args);
+    cl::ResetAllOptionOccurrences();
+    if (!cl::ParseCommandLineOptions(Args.size(), Args.data(), "", &errs()))
+      return reportError(argv0, "bad backend options '" + Line + "'\n");
+
+    Records.startBackendTimer("Backend " + OutputFilename);
+    std::string OutString;
+    raw_string_ostream Out(OutString);
+    unsigned status = MainFn(Out, Records);
+    Records.stopBackendTimer();
+    if (status)
+      return 1;
+
+    if (int Ret = writeOutputs(Parser, argv0, Records, Out.str()))
+      return Ret;
+  }
+  return 0;
+}
+
 int llvm::TableGenMain(const char *argv0, TableGenMainFn *MainFn) {
   RecordKeeper Records;
 
@@ -115,47 +210,23 @@ int llvm::TableGenMain(const char *argv0, TableGenMainFn *MainFn) {
     return 1;
   Records.stopTimer();
 
-  // Write output to memory.
-  Records.startBackendTimer("Backend overall");
-  std::string OutString;
-  raw_string_ostream Out(OutString);
-  unsigned status = MainFn(Out, Records);
-  Records.stopBackendTimer();
-  if (status)
-    return 1;
-
-  // Always write the depfile, even if the main output hasn't changed.
-  // If it's missing, Ninja considers the output dirty.  If this was below
-  // the early exit below and someone deleted the .inc.d file but not the .inc
-  // file, tablegen would never write the depfile.
-  if (!DependFilename.empty()) {
-    if (int Ret = createDependencyFile(Parser, argv0))
+  if (!BackendsFilename.empty()) {
+    if (int Ret = runBackends(Parser, argv0, Records, MainFn))
+      return Ret;
+  } else {
+    // Write output to memory.
+    Records.startBackendTimer("Backend overall");
+    std::string OutString;
+    raw_string_ostream Out(OutString);
+    unsigned status = MainFn(Out, Records);
+    Records.stopBackendTimer();
+    if (status)
+      return 1;
+
+    if (int Ret = writeOutputs(Parser, argv0, Records, Out.str()))
       return Ret;
   }
 
-  Records.startTimer("Write output");
-  bool WriteFile = true;
-  if (WriteIfChanged) {
-    // Only updates the real output file if there are any differences.
-    // This prevents recompilation of all the files depending on it if there
-    // aren't any.
-    if (auto ExistingOrErr =
-            MemoryBuffer::getFile(OutputFilename, /*IsText=*/true))
-      if (std::move(ExistingOrErr.get())->getBuffer() == Out.str())
-        WriteFile = false;
-  }
-  if (WriteFile) {
-    std::error_code EC;
-    ToolOutputFile OutFile(OutputFilename, EC, sys::fs::OF_Text);
-    if (EC)
-      return reportError(argv0, "error opening " + OutputFilename + ": " +
-                                    EC.message() + "\n");
-    OutFile.os() << Out.str();
-    if (ErrorsPrinted == 0)
-      OutFile.keep();
-  }
-  
-  Records.stopTimer();
   Records.stopPhaseTiming();
 
   if (ErrorsPrinted > 0)
@@ -0,0 +1,59 @@
+#include "llvm_include_llvm_ProfileData_InstrProfReader.h"
+#include "llvm_include_llvm_ProfileData_InstrProfWriter.h"
+#include "llvm_include_llvm_Support_FileSystem.h"
+#include "llvm_include_llvm_Support_raw_ostream.h"
+
+using namespace llvm;
+
+// NOTE(khvorov) The "llvm-profdata merge" part that the PGO build needs and nothing else.
+// Usage: profdata-merge.exe <out.profdata> <in.profraw>...
+// Only reads the raw profile version this tree knows about, build.c hands profiles
+// from a newer profile runtime to the system llvm-profdata instead (see runPgoBuild).
+int
+main(int argc, char** argv) {
+    if (argc < 3) {
+        errs() << "usage: " << argv[0] << " <out.profdata> <in.profraw>...\n";
+        return 1;
+    }
+
+    bool            failed = false;
+    auto            warn = [&](Error err) { errs() << "warning: " << toString(std::move(err)) << "\n"; };
+    InstrProfWriter writer;
+    for (int argIndex = 2; argIndex < argc && !failed; argIndex++) {
+        auto readerOrErr = InstrProfReader::create(argv[argIndex]);
+        if (Error err = readerOrErr.takeError()) {
+            errs() << argv[argIndex] << ": " << toString(std::move(err)) << "\n";
+            failed = true;
+            continue;
+        }
+        std::unique_ptr<InstrProfReader> reader = std::move(readerOrErr.get());
+
+        if (Error err = writer.mergeProfileKind(reader->getProfileKind())) {
+            errs() << argv[argIndex] << ": " << toString(std::move(err)) << "\n";
+            failed = true;
+            continue;
+        }
+
+        for (NamedInstrProfRecord& record : *reader) {
+            writer.addRecord(std::move(record), 1, warn);
+        }
+        if (reader->hasError()) {
+            errs() << argv[argIndex] << ": " << toString(reader->getError()) << "\n";
+            failed = true;
+        }
+    }
+
+    if (!failed) {
+        std::error_code ec;
+        raw_fd_ostream  out(argv[1], ec, sys::fs::OF_None);
+        if (ec) {
+            errs() << argv[1] << ": " << ec.message() << "\n";
+            failed = true;
+        } else if (Error err = writer.write(out)) {
+            errs() << argv[1] << ": " << toString(std::move(err)) << "\n";
+            failed = true;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
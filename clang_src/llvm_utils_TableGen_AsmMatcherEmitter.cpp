@@ -3198,7 +3198,7 @@ getNameForFeatureBitset(const std::vector<Record *> &FeatureBitset) {
 }
 
 void AsmMatcherEmitter::run(raw_ostream &OS) {
-  CodeGenTarget Target(Records);
+  CodeGenTarget &Target = CodeGenTarget::getShared(Records);
   Record *AsmParser = Target.getAsmParser();
   StringRef ClassName = AsmParser->getValueAsString("AsmParserClassName");
 
@@ -55,7 +55,7 @@ namespace {
 
 class AsmWriterEmitter {
   RecordKeeper &Records;
-  CodeGenTarget Target;
+  CodeGenTarget &Target;
   ArrayRef<const CodeGenInstruction *> NumberedInstructions;
   std::vector<AsmWriterInst> Instructions;
 
@@ -1279,7 +1279,7 @@ void AsmWriterEmitter::EmitPrintAliasInstruction(raw_ostream &O) {
   O << "#endif // PRINT_ALIAS_INSTR\n";
 }
 
-AsmWriterEmitter::AsmWriterEmitter(RecordKeeper &R) : Records(R), Target(R) {
+AsmWriterEmitter::AsmWriterEmitter(RecordKeeper &R) : Records(R), Target(CodeGenTarget::getShared(R)) {
   Record *AsmWriter = Target.getAsmWriter();
   unsigned Variant = AsmWriter->getValueAsInt("Variant");
 
@@ -3218,6 +3218,12 @@ CodeGenDAGPatterns::CodeGenDAGPatterns(RecordKeeper &R,
   VerifyInstructionFlags();
 }
 
+char CodeGenDAGPatterns::SharedID = 0;
+
+CodeGenDAGPatterns &CodeGenDAGPatterns::getShared(RecordKeeper &R) {
+  return R.getSharedAnalysis<CodeGenDAGPatterns>();
+}
+
 Record *CodeGenDAGPatterns::getSDNodeNamed(StringRef Name) const {
   Record *N = Records.getDef(Name);
   if (!N || !N->isSubClassOf("SDNode"))
@@ -1132,6 +1132,15 @@ public:
   CodeGenDAGPatterns(RecordKeeper &R,
                      PatternRewriterFn PatternRewriter = nullptr);
 
+  /// Return the CodeGenDAGPatterns without a pattern rewriter shared by every
+  /// backend that runs on R, built on first use (see
+  /// RecordKeeper::getSharedAnalysis), so that backends run on one parse
+  /// (-backends) share it. It has its own CodeGenTarget rather than
+  /// CodeGenTarget::getShared because InferInstructionFlags writes to the
+  /// target's instructions.
+  static CodeGenDAGPatterns &getShared(RecordKeeper &R);
+  static char SharedID;
+
   CodeGenTarget &getTargetInfo() { return Target; }
   const CodeGenTarget &getTargetInfo() const { return Target; }
   const TypeSetByHwMode &getLegalTypes() const { return LegalVTS; }
@@ -291,6 +291,12 @@ CodeGenTarget::CodeGenTarget(RecordKeeper &records)
 CodeGenTarget::~CodeGenTarget() {
 }
 
+char CodeGenTarget::SharedID = 0;
+
+CodeGenTarget &CodeGenTarget::getShared(RecordKeeper &Records) {
+  return Records.getSharedAnalysis<CodeGenTarget>();
+}
+
 StringRef CodeGenTarget::getName() const { return TargetRec->getName(); }
 
 /// getInstNamespace - Find and return the target machine's instruction
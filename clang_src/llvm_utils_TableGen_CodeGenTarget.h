@@ -66,6 +66,13 @@ public:
   CodeGenTarget(RecordKeeper &Records);
   ~CodeGenTarget();
 
+  /// getShared - Return the CodeGenTarget shared by every backend that runs on
+  /// Records, built on first use (see RecordKeeper::getSharedAnalysis).
+  /// Backends that only read the target use this so that running several of
+  /// them on one parse (-backends) builds it once.
+  static CodeGenTarget &getShared(RecordKeeper &Records);
+  static char SharedID;
+
   Record *getTargetRecord() const { return TargetRec; }
   StringRef getName() const;
 
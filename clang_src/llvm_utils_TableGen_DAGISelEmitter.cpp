@@ -25,9 +25,10 @@ namespace {
 /// and emission of the instruction selector.
 class DAGISelEmitter {
   RecordKeeper &Records; // Just so we can get at the timing functions.
-  CodeGenDAGPatterns CGP;
+  CodeGenDAGPatterns &CGP;
 public:
-  explicit DAGISelEmitter(RecordKeeper &R) : Records(R), CGP(R) {}
+  explicit DAGISelEmitter(RecordKeeper &R)
+      : Records(R), CGP(CodeGenDAGPatterns::getShared(R)) {}
   void run(raw_ostream &OS);
 };
 } // End anonymous namespace
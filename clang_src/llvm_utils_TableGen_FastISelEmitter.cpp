@@ -857,7 +857,7 @@ void FastISelMap::printFunctionDefinitions(raw_ostream &OS) {
 namespace llvm {
 
 void EmitFastISel(RecordKeeper &RK, raw_ostream &OS) {
-  CodeGenDAGPatterns CGP(RK);
+  CodeGenDAGPatterns &CGP = CodeGenDAGPatterns::getShared(RK);
   const CodeGenTarget &Target = CGP.getTargetInfo();
   emitSourceFileHeader("\"Fast\" Instruction Selector for the " +
                        Target.getName().str() + " target", OS);
@@ -3569,7 +3569,7 @@ public:
 
 private:
   const RecordKeeper &RK;
-  const CodeGenDAGPatterns CGP;
+  const CodeGenDAGPatterns &CGP;
   const CodeGenTarget &Target;
   CodeGenRegBank &CGRegs;
 
@@ -3805,7 +3805,7 @@ GlobalISelEmitter::getEquivNode(Record &Equiv, const TreePatternNode *N) const {
 }
 
 GlobalISelEmitter::GlobalISelEmitter(RecordKeeper &RK)
-    : RK(RK), CGP(RK), Target(CGP.getTargetInfo()),
+    : RK(RK), CGP(CodeGenDAGPatterns::getShared(RK)), Target(CGP.getTargetInfo()),
       CGRegs(Target.getRegBank()) {}
 
 //===- Emitter ------------------------------------------------------------===//
@@ -48,12 +48,13 @@ namespace {
 
 class InstrInfoEmitter {
   RecordKeeper &Records;
-  CodeGenDAGPatterns CDP;
+  CodeGenDAGPatterns &CDP;
   const CodeGenSchedModels &SchedModels;
 
 public:
   InstrInfoEmitter(RecordKeeper &R):
-    Records(R), CDP(R), SchedModels(CDP.getTargetInfo().getSchedModels()) {}
+    Records(R), CDP(CodeGenDAGPatterns::getShared(R)),
+    SchedModels(CDP.getTargetInfo().getSchedModels()) {}
 
   // run - Output the instruction set description.
   void run(raw_ostream &OS);
@@ -101,7 +101,7 @@ public:
 
 class RegisterBankEmitter {
 private:
-  CodeGenTarget Target;
+  CodeGenTarget &Target;
   RecordKeeper &Records;
 
   void emitHeader(raw_ostream &OS, const StringRef TargetName,
@@ -112,7 +112,8 @@ private:
                                    std::vector<RegisterBank> &Banks);
 
 public:
-  RegisterBankEmitter(RecordKeeper &R) : Target(R), Records(R) {}
+  RegisterBankEmitter(RecordKeeper &R)
+      : Target(CodeGenTarget::getShared(R)), Records(R) {}
 
   void run(raw_ostream &OS);
 };
@@ -1986,7 +1986,7 @@ void SubtargetEmitter::run(raw_ostream &OS) {
 namespace llvm {
 
 void EmitSubtarget(RecordKeeper &RK, raw_ostream &OS) {
-  CodeGenTarget CGTarget(RK);
+  CodeGenTarget &CGTarget = CodeGenTarget::getShared(RK);
   SubtargetEmitter(RK, CGTarget).run(OS);
 }
 
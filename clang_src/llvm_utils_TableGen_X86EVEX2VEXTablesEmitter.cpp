@@ -24,7 +24,7 @@ namespace {
 
 class X86EVEX2VEXTablesEmitter {
   RecordKeeper &Records;
-  CodeGenTarget Target;
+  CodeGenTarget &Target;
 
   // Hold all non-masked & non-broadcasted EVEX encoded instructions
   std::vector<const CodeGenInstruction *> EVEXInsts;
@@ -42,7 +42,8 @@ class X86EVEX2VEXTablesEmitter {
   std::vector<Predicate> EVEX2VEXPredicates;
 
 public:
-  X86EVEX2VEXTablesEmitter(RecordKeeper &R) : Records(R), Target(R) {}
+  X86EVEX2VEXTablesEmitter(RecordKeeper &R)
+      : Records(R), Target(CodeGenTarget::getShared(R)) {}
 
   // run - Output X86 EVEX2VEX tables.
   void run(raw_ostream &OS);
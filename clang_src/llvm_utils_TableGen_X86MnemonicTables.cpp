@@ -22,10 +22,11 @@ using namespace llvm;
 namespace {
 
 class X86MnemonicTablesEmitter {
-  CodeGenTarget Target;
+  CodeGenTarget &Target;
 
 public:
-  X86MnemonicTablesEmitter(RecordKeeper &R) : Target(R) {}
+  X86MnemonicTablesEmitter(RecordKeeper &R)
+      : Target(CodeGenTarget::getShared(R)) {}
 
   // Output X86 mnemonic tables.
   void run(raw_ostream &OS);
@@ -1,4 +1,8 @@
 #include "cbuild.h"
+#include "clang_src/clang_tools_driver_cc1.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #define function static
 #define global_variable static
@@ -20,6 +24,54 @@ execCmd(prb_Arena* arena, prb_Str cmd) {
     prb_endTempMemory(temp);
 }
 
+function prb_Str
+getProgramPath(prb_Arena* arena, i32 counter) {
+    prb_Str name = prb_fmt(arena, "prog%d.c", counter);
+    prb_Str result = prb_pathJoin(arena, globalTestDir, name);
+    return result;
+}
+
+function prb_Str
+getObjPath(prb_Arena* arena, i32 counter) {
+    prb_Str outnameObj = prb_fmt(arena, "prog%d.obj", counter);
+    prb_Str result = prb_pathJoin(arena, globalTestDir, outnameObj);
+    return result;
+}
+
+// NOTE(khvorov) What the driver would hand to cc1, minus the file-specific bits
+function prb_Str
+getCc1BaseArgs(prb_Arena* arena) {
+    prb_Str result = prb_fmt(
+        arena,
+        "-cc1 -triple x86_64-unknown-linux-gnu -emit-obj -mrelax-all -disable-free -clear-ast-before-backend "
+        "-mrelocation-model pic -pic-level 2 -pic-is-pie -mframe-pointer=all -fmath-errno -ffp-contract=on -fno-rounding-math "
+        "-mconstructor-aliases -funwind-tables=2 -target-cpu x86-64 -tune-cpu generic -mllvm -treat-scalable-fixed-error-as-warning "
+        "-debugger-tuning=gdb -fcoverage-compilation-dir=%.*s "
+        "-I %.*s -internal-isystem /usr/local/include "
+        "-internal-isystem /usr/lib/gcc/x86_64-linux-gnu/11/../../../../x86_64-linux-gnu/include "
+        "-internal-externc-isystem /usr/include/x86_64-linux-gnu -internal-externc-isystem /include "
+        "-internal-externc-isystem /usr/include -fdebug-compilation-dir=%.*s -ferror-limit 19 "
+        "-fgnuc-version=4.2.1 -faddrsig -D__GCC_HAVE_DWARF2_CFI_ASM=1 -x c",
+        prb_LIT(globalTestDir),
+        prb_LIT(globalMyClangHeaders),
+        prb_LIT(globalTestDir)
+    );
+    return result;
+}
+
+function prb_Str
+getCc1Args(prb_Arena* arena, prb_Str programFilepath, prb_Str outpathObj) {
+    prb_Str result = prb_fmt(
+        arena,
+        "%.*s -main-file-name %.*s -o %.*s %.*s",
+        prb_LIT(getCc1BaseArgs(arena)),
+        prb_LIT(programFilepath),
+        prb_LIT(outpathObj),
+        prb_LIT(programFilepath)
+    );
+    return result;
+}
+
 function void
 runTestForProgram(prb_Arena* arena, i32 counter, prb_Str program) {
     prb_TempMemory temp = prb_beginTempMemory(arena);
@@ -73,6 +125,214 @@ runTestForProgram(prb_Arena* arena, i32 counter, prb_Str program) {
     prb_endTempMemory(temp);
 }
 
+// NOTE(khvorov) Writes the programs to prog<counter>.c and on, runs every one of compileCmds at the same time (between
+// them they should produce prog<counter>.obj and on), then links and runs each program
+function void
+runTestForPrograms(prb_Arena* arena, i32 counter, prb_Str* programs, i32 programCount, prb_Str* compileCmds, i32 compileCmdCount) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+
+    for (i32 programIndex = 0; programIndex < programCount; programIndex++) {
+        prb_Str program = programs[programIndex];
+        prb_assert(prb_writeEntireFile(arena, getProgramPath(arena, counter + programIndex), program.ptr, program.len));
+        prb_assert(prb_removePathIfExists(arena, getObjPath(arena, counter + programIndex)));
+    }
+
+    prb_Process* compiles = prb_arenaAllocArray(arena, prb_Process, compileCmdCount);
+    for (i32 cmdIndex = 0; cmdIndex < compileCmdCount; cmdIndex++) {
+        prb_writelnToStdout(arena, compileCmds[cmdIndex]);
+        compiles[cmdIndex] = prb_createProcess(compileCmds[cmdIndex], (prb_ProcessSpec) {});
+    }
+    prb_assert(prb_launchProcesses(arena, compiles, compileCmdCount, prb_Background_Yes));
+    prb_assert(prb_waitForProcesses(compiles, compileCmdCount));
+
+    for (i32 programIndex = 0; programIndex < programCount; programIndex++) {
+        prb_Str outnameExe = prb_fmt(arena, "prog%d.exe", counter + programIndex);
+        prb_Str outpathExe = prb_pathJoin(arena, globalTestDir, outnameExe);
+        prb_assert(prb_removePathIfExists(arena, outpathExe));
+
+        prb_Str cmdExe = prb_fmt(arena, "clang %.*s -o %.*s", prb_LIT(getObjPath(arena, counter + programIndex)), prb_LIT(outpathExe));
+        execCmd(arena, cmdExe);
+        execCmd(arena, outpathExe);
+    }
+
+    prb_endTempMemory(temp);
+}
+
+function void
+appendBytes(uint8_t** buffer, const void* data, int64_t len) {
+    memcpy(arraddnptr(*buffer, len), data, len);
+}
+
+function void
+appendStr(uint8_t** buffer, prb_Str str) {
+    i32 len = str.len + 1;
+    appendBytes(buffer, &len, sizeof(len));
+    appendBytes(buffer, str.ptr, str.len);
+    arrput(*buffer, '\0');
+}
+
+function void
+takeBytes(uint8_t* payload, int64_t payloadLen, int64_t* offset, void* dest, int64_t len) {
+    prb_assert(len >= 0 && *offset + len <= payloadLen);
+    memcpy(dest, payload + *offset, len);
+    *offset += len;
+}
+
+function prb_Str
+takeStr(uint8_t* payload, int64_t payloadLen, int64_t* offset) {
+    i32 len = 0;
+    takeBytes(payload, payloadLen, offset, &len, sizeof(len));
+    prb_assert(len > 0 && *offset + len <= payloadLen && payload[*offset + len - 1] == '\0');
+    prb_Str result = {(const char*)payload + *offset, len - 1};
+    *offset += len;
+    return result;
+}
+
+// NOTE(khvorov) Talks to the server the way -client does (wire format is in clang_tools_driver_cc1_server.c) except the
+// source only exists in the request, so this goes through cc1_compile's in-memory files, output and diagnostics
+function void
+runInMemoryServerTest(prb_Arena* arena, prb_Str socketPath) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+
+    prb_Str programFilepath = prb_pathJoin(arena, globalTestDir, prb_STR("in-memory.c"));
+    prb_Str outpathObj = prb_pathJoin(arena, globalTestDir, prb_STR("in-memory.obj"));
+    prb_Str program = prb_STR("#warning from memory\nint answer(void) {return 42;}\n");
+    prb_writelnToStdout(arena, prb_fmt(arena, "in-memory %.*s through %.*s", prb_LIT(programFilepath), prb_LIT(socketPath)));
+
+    // NOTE(khvorov) The request has what comes after -cc1
+    prb_Str* args = 0;
+    for (prb_Str rest = getCc1Args(arena, programFilepath, outpathObj); rest.len > 0;) {
+        prb_StrFindResult space = prb_strFind(rest, (prb_StrFindSpec) {.pattern = prb_STR(" ")});
+        arrput(args, space.found ? space.beforeMatch : rest);
+        rest = space.found ? space.afterMatch : (prb_Str) {};
+    }
+    prb_assert(prb_streq(args[0], prb_STR("-cc1")));
+
+    uint8_t* request = 0;
+    i32      argCount = arrlen(args) - 1;
+    i32      fileCount = 1;
+    int64_t  contentLen = program.len;
+    appendBytes(&request, &argCount, sizeof(argCount));
+    appendBytes(&request, &fileCount, sizeof(fileCount));
+    for (i32 argIndex = 1; argIndex < arrlen(args); argIndex++) {
+        appendStr(&request, args[argIndex]);
+    }
+    appendStr(&request, programFilepath);
+    appendBytes(&request, &contentLen, sizeof(contentLen));
+    appendBytes(&request, program.ptr, program.len);
+
+    int                fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    prb_assert(fd != -1 && socketPath.len < (i32)sizeof(addr.sun_path));
+    memcpy(addr.sun_path, socketPath.ptr, socketPath.len);
+    prb_assert(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    int64_t requestLen = arrlen(request);
+    prb_assert(send(fd, &requestLen, sizeof(requestLen), 0) == sizeof(requestLen));
+    prb_assert(send(fd, request, requestLen, 0) == requestLen);
+
+    int64_t responseLen = 0;
+    prb_assert(recv(fd, &responseLen, sizeof(responseLen), MSG_WAITALL) == sizeof(responseLen));
+    uint8_t* response = prb_arenaAllocArray(arena, uint8_t, responseLen);
+    prb_assert(recv(fd, response, responseLen, MSG_WAITALL) == responseLen);
+    close(fd);
+
+    int64_t offset = 0;
+    i32     success = 0;
+    i32     diagCount = 0;
+    int64_t outputLen = 0;
+    takeBytes(response, responseLen, &offset, &success, sizeof(success));
+    takeBytes(response, responseLen, &offset, &diagCount, sizeof(diagCount));
+    takeBytes(response, responseLen, &offset, &outputLen, sizeof(outputLen));
+    prb_assert(success);
+    prb_assert(outputLen > 4 && offset + outputLen <= responseLen && memcmp(response + offset, "\x7f" "ELF", 4) == 0);
+    offset += outputLen;
+
+    bool gotWarning = false;
+    for (i32 diagIndex = 0; diagIndex < diagCount; diagIndex++) {
+        i32 level = 0;
+        i32 line = 0;
+        i32 column = 0;
+        takeBytes(response, responseLen, &offset, &level, sizeof(level));
+        takeBytes(response, responseLen, &offset, &line, sizeof(line));
+        takeBytes(response, responseLen, &offset, &column, sizeof(column));
+        prb_Str file = takeStr(response, responseLen, &offset);
+        prb_Str message = takeStr(response, responseLen, &offset);
+        gotWarning = gotWarning || (level == cc1_DiagLevel_Warning && line == 1 && prb_streq(file, programFilepath) && prb_streq(message, prb_STR("from memory")));
+    }
+    prb_assert(gotWarning);
+
+    // NOTE(khvorov) Neither the source nor the object ever touched the disk
+    prb_assert(!prb_pathExists(arena, programFilepath));
+    prb_assert(!prb_pathExists(arena, outpathObj));
+
+    arrfree(request);
+    arrfree(args);
+    prb_endTempMemory(temp);
+}
+
+// NOTE(khvorov) Both programs go through clang.exe --serve at the same time, each from its own -client
+function void
+runServerTestForPrograms(prb_Arena* arena, i32 counter, prb_Str program1, prb_Str program2) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+
+    prb_Str socketPath = prb_pathJoin(arena, globalTestDir, prb_STR("cc1.sock"));
+    prb_Str serverCmd = prb_fmt(arena, "%.*s --serve %.*s -j 2", prb_LIT(globalMyClangExe), prb_LIT(socketPath));
+    prb_writelnToStdout(arena, serverCmd);
+    prb_Process server = prb_createProcess(serverCmd, (prb_ProcessSpec) {});
+    prb_assert(prb_launchProcesses(arena, &server, 1, prb_Background_Yes));
+    // NOTE(khvorov) Without a server the client compiles by itself, which would pass without testing anything
+    for (i32 waitIndex = 0; waitIndex < 100 && !prb_pathExists(arena, socketPath); waitIndex++) {
+        prb_sleep(50);
+    }
+    prb_assert(prb_pathExists(arena, socketPath));
+
+    prb_Str programs[] = {program1, program2};
+    prb_Str clientCmds[prb_arrayCount(programs)] = {};
+    for (i32 programIndex = 0; programIndex < prb_arrayCount(programs); programIndex++) {
+        prb_Str cc1Args = getCc1Args(arena, getProgramPath(arena, counter + programIndex), getObjPath(arena, counter + programIndex));
+        clientCmds[programIndex] = prb_fmt(arena, "%.*s -client %.*s %.*s", prb_LIT(globalMyClangExe), prb_LIT(socketPath), prb_LIT(cc1Args));
+    }
+    runTestForPrograms(arena, counter, programs, prb_arrayCount(programs), clientCmds, prb_arrayCount(clientCmds));
+    runInMemoryServerTest(arena, socketPath);
+
+    prb_assert(prb_killProcesses(&server, 1));
+    // NOTE(khvorov) The killed server leaves its socket behind and prb_clearDir only removes regular files
+    prb_assert(unlink(prb_strGetNullTerminated(arena, socketPath)) == 0);
+
+    prb_endTempMemory(temp);
+}
+
+// NOTE(khvorov) Both programs in one manifest for clang.exe -batch
+function void
+runBatchTestForPrograms(prb_Arena* arena, i32 counter, prb_Str program1, prb_Str program2) {
+    prb_TempMemory temp = prb_beginTempMemory(arena);
+
+    prb_Str programs[] = {program1, program2};
+    prb_Str programFilepaths[prb_arrayCount(programs)] = {};
+    prb_Str objs[prb_arrayCount(programs)] = {};
+    for (i32 programIndex = 0; programIndex < prb_arrayCount(programs); programIndex++) {
+        programFilepaths[programIndex] = getProgramPath(arena, counter + programIndex);
+        objs[programIndex] = getObjPath(arena, counter + programIndex);
+    }
+
+    // NOTE(khvorov) First line is shared by every file, then <input> <output> [args] per file
+    prb_Str        manifestPath = prb_pathJoin(arena, globalTestDir, prb_STR("batch.txt"));
+    prb_Str        baseArgs = getCc1BaseArgs(arena);
+    prb_GrowingStr manifest = prb_beginStr(arena);
+    prb_addStrSegment(&manifest, "%.*s\n", prb_LIT(baseArgs));
+    for (i32 programIndex = 0; programIndex < prb_arrayCount(programs); programIndex++) {
+        prb_Str programFilepath = programFilepaths[programIndex];
+        prb_addStrSegment(&manifest, "%.*s %.*s -main-file-name %.*s\n", prb_LIT(programFilepath), prb_LIT(objs[programIndex]), prb_LIT(programFilepath));
+    }
+    prb_Str manifestStr = prb_endStr(&manifest);
+    prb_assert(prb_writeEntireFile(arena, manifestPath, manifestStr.ptr, manifestStr.len));
+
+    prb_Str batchCmd = prb_fmt(arena, "%.*s -batch %.*s -j 2", prb_LIT(globalMyClangExe), prb_LIT(manifestPath));
+    runTestForPrograms(arena, counter, programs, prb_arrayCount(programs), &batchCmd, 1);
+
+    prb_endTempMemory(temp);
+}
+
 int
 main() {
     prb_Arena  arena_ = prb_createArenaFromVmem(1 * prb_GIGABYTE);
@@ -80,7 +340,18 @@ main() {
 
     globalRootDir = prb_getParentDir(arena, prb_STR(__FILE__));
     globalTestDir = prb_pathJoin(arena, globalRootDir, prb_STR("tests"));
-    globalMyClangExe = prb_pathJoin(arena, globalRootDir, prb_STR("build/clang.exe"));
+
+    // NOTE(khvorov) Same --profile=<name> as build.c
+    prb_Str profile = prb_STR("debug");
+    {
+        prb_Str* args = prb_getCmdArgs(arena);
+        for (i32 argIndex = 1; argIndex < arrlen(args); argIndex++) {
+            prb_Str arg = args[argIndex];
+            prb_assert(prb_strStartsWith(arg, prb_STR("--profile=")));
+            profile = prb_strSlice(arg, prb_STR("--profile=").len, arg.len);
+        }
+    }
+    globalMyClangExe = prb_pathJoin(arena, globalRootDir, prb_fmt(arena, "build/%.*s/clang.exe", prb_LIT(profile)));
     globalMyClangHeaders = prb_pathJoin(arena, globalRootDir, prb_STR("llvm-project/clang/lib/Headers"));
 
     prb_assert(prb_clearDir(arena, globalTestDir));
@@ -90,5 +361,21 @@ main() {
     i32 testPostfixCounter = 0;
     runTestForProgram(arena, testPostfixCounter++, prb_STR("#include \"../cbuild.h\"\nint main() {prb_writeToStdout(prb_STR(\"compiled and ran\\n\"));return 0;}"));
 
+    runServerTestForPrograms(
+        arena,
+        testPostfixCounter,
+        prb_STR("#include <stdio.h>\nint main() {printf(\"served 1\\n\");return 0;}"),
+        prb_STR("#include <stdio.h>\nint main() {printf(\"served 2\\n\");return 0;}")
+    );
+    testPostfixCounter += 2;
+
+    runBatchTestForPrograms(
+        arena,
+        testPostfixCounter,
+        prb_STR("#include <stdio.h>\nint main() {printf(\"batched 1\\n\");return 0;}"),
+        prb_STR("#include <stdio.h>\nint main() {printf(\"batched 2\\n\");return 0;}")
+    );
+    testPostfixCounter += 2;
+
     return 0;
 }